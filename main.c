@@ -14,6 +14,33 @@
 #include <stdlib.h>
 #include "seajson.h"
 
+typedef struct {
+  char object_type[32];
+  int object_id;
+  int point[4];
+} platform;
+
+typedef struct {
+  char zone_name[32];
+  int zone_id;
+  int platform_count;
+  platform platforms[16];
+  size_t platformsCount;
+} level;
+
+static const seajson_field platformFields[] = {
+  SEAJSON_STRING_FIELD(platform, object_type),
+  SEAJSON_INT_FIELD(platform, object_id),
+  SEAJSON_INT_ARRAY_FIELD(platform, point),
+};
+
+static const seajson_field levelFields[] = {
+  SEAJSON_STRING_FIELD(level, zone_name),
+  SEAJSON_INT_FIELD(level, zone_id),
+  SEAJSON_INT_FIELD(level, platform_count),
+  SEAJSON_OBJECT_ARRAY_FIELD(level, platforms, platformsCount, platformFields),
+};
+
 int main(void) {
   printf("Hello World\n");
   seajson json = init_json_from_file("level.json");
@@ -29,7 +56,7 @@ int main(void) {
   jarray platforms = get_array(json, "platforms");
   if (platforms.isValid) {
     printf("platforms.arrayString: %s\n",platforms.arrayString);
-    printf("platforms.itemCount: %d\n",platforms.itemCount);
+    printf("platforms.itemCount: %lld\n",platforms.itemCount);
     printf("platforms.isValid: %d\n",platforms.isValid);
   } else {
     printf("error: platforms is not a valid jarray, SeaJSON likely had an error retrieving the dictionary\n");
@@ -77,5 +104,17 @@ int main(void) {
   printf("newJarrayWithItem: %s\n",newJarrayWithItem.arrayString);
   free_jarray(testBlankJarray);
   free_jarray(newJarrayWithItem);
+  /* Same as the above, but decoded straight into a struct in one pass */
+  level decodedLevel;
+  memset(&decodedLevel, 0, sizeof(decodedLevel));
+  seajson levelJson = init_json_from_file("level.json");
+  if (decode_seajson(levelJson, levelFields, SEAJSON_FIELD_COUNT(levelFields), &decodedLevel) != 0) {
+    fprintf(stderr, "failed decoding level");
+    exit(1);
+  }
+  printf("decodedLevel.zone_name: %s\n",decodedLevel.zone_name);
+  printf("decodedLevel.platformsCount: %zu\n",decodedLevel.platformsCount);
+  printf("decodedLevel.platforms[1].point[0]: %d\n",decodedLevel.platforms[1].point[0]);
+  free_json(levelJson);
   return 0;
 }
\ No newline at end of file
@@ -9,7 +9,54 @@
  * Snoolie K / 0xilis.
 */
 
+/* fileno, strnlen and pread are POSIX, not C, so ask for them in case this is built with -std=c99/c11 */
+#ifndef _WIN32
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+/* Asking for POSIX hides everything else, keep the platform extras (MAP_POPULATE, d_type, ...) visible */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#ifndef _DARWIN_C_SOURCE
+#define _DARWIN_C_SOURCE
+#endif
+#endif
+
 #include "seajson.h"
+#include <limits.h>
+#include <ctype.h>
+#include <stdint.h>
+#ifdef SEAJSON_USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef SEAJSON_USE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef SEAJSON_STATS
+#include <time.h>
+#endif
+/* SIMD scanning kernels, picked at runtime so one build runs on any x86 CPU. SEAJSON_SCALAR_ONLY leaves them out. */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && !defined(SEAJSON_SCALAR_ONLY)
+#define SEAJSON_X86_KERNELS
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+#ifndef _WIN32
+#include <sys/types.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#ifdef SEAJSON_USE_IO_URING
+#include <liburing.h>
+#endif
+#else
+#include <windows.h>
+#include <sys/stat.h>
+#endif
 
 /* JSON Pathway Cache Types */
 
@@ -18,1048 +65,7999 @@
 #define STRING_START 3
 #define STRING_END 4
 
-seajson init_json_from_file(const char *restrict filename) {
-  FILE *fp = fopen(filename, "rb");
-  if (fp == NULL) {
-    fprintf(stderr,"SeaJSON Error: Cannot find file.\n");
-    exit(1);
-  }
-  fseek(fp, 0L, SEEK_END);
-  long sz = ftell(fp);
-  fseek(fp, 0L, SEEK_SET);
-  /* sz is now the file size */
-  char *json = malloc(sizeof(char) * (sz + 1));
-  if (json == NULL) {
-    fclose(fp);
-    fprintf(stderr, "SeaJSON Error: Memory allocation failed.\n");
-    exit(1);
-  }
-  size_t bytesRead = fread(json, 1, sz, fp);
-  if (bytesRead < sz) {
-    fclose(fp);
-    free(json);
-    fprintf(stderr, "SeaJSON Error: Failed to read the entire file.\n");
-    exit(1);
-  }
-  /* Null-terminate the string */
-  json[sz] = '\0';
-  /* Close the file pointer */
-  fclose(fp);
-  return json;
+/* Instrumentation */
+
+#if defined(_MSC_VER)
+#define SEAJSON_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define SEAJSON_THREAD_LOCAL __thread
+#else
+#define SEAJSON_THREAD_LOCAL _Thread_local
+#endif
+
+#ifdef SEAJSON_STATS
+
+static SEAJSON_THREAD_LOCAL seajson_stats threadStats;
+
+static unsigned long long stats_now(void) {
+  struct timespec now;
+#ifndef _WIN32
+  clock_gettime(CLOCK_MONOTONIC, &now);
+#else
+  timespec_get(&now, TIME_UTC);
+#endif
+  return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
 }
 
-void free_json(seajson json) {
-  free(json);
-  json = NULL;
+typedef struct {
+  seajson_stat_function function;
+  unsigned long long start;
+} seajson_stat_scope;
+
+static seajson_stat_scope stats_scope_begin(seajson_stat_function function) {
+  seajson_stat_scope scope;
+  threadStats.calls[function]++;
+  scope.function = function;
+  scope.start = stats_now();
+  return scope;
 }
 
-/* TODO: support \'s in strings */
-char* get_string(seajson json, const char *value) {
-  unsigned long jsonSize = strlen(json);
-  char* readString = malloc(sizeof(char) * strlen(value) + 1);
-  int stringProgress = 0;
-  int valueFound = 0;
-  char* returnString = malloc(sizeof(char) * jsonSize + 1);
-  char prev = 0;
-  for (int i = 0; i < jsonSize; i++) {
-    char currentChar = json[i];
-    if (currentChar == '\"') {
-      if (prev == STRING_START) {
-        if (valueFound == 1) {
-          /* We are on the ending " so we got our string */
-          free(readString);
-          returnString[stringProgress] = '\0';
-          return returnString;
-        }
-        if (stringProgress == strlen(value)) {
-          readString[stringProgress] = '\0';
-          if (strcmp(value,readString) == 0) {
-            /* We might have just found the string! */
-            if (json[i+1] == ':') {
-              valueFound = 1;
-              i++;
-            }
-          }
-        }
-        prev = STRING_END;
-      } else {
-        stringProgress = 0;
-        prev = STRING_START;
-      }
-      continue;
-    }
-    /*
-    Remember that if user passes in something like "Apples"
-    Don't just search for apples, as 
-    */
-    if (prev == STRING_START) {
-      if (valueFound) {
-        returnString[stringProgress] = currentChar;
-        stringProgress++;
-      } else if (stringProgress > strlen(value)) {
-        /* The string we are reading is bigger than the string we want - this means it is DEFINITELY not the string */
-        stringProgress = 0;
-      } else {
-        readString[stringProgress] = currentChar;
-        stringProgress++;
-      }
-    }
-  }
-  free(readString);
-  free(returnString);
-  return NULL;
+static void stats_scope_end(seajson_stat_scope *scope) {
+  threadStats.nanoseconds[scope->function] += stats_now() - scope->start;
 }
 
-/* TODO: Add negative support */
-unsigned long get_int(seajson json, const char *value) {
-  unsigned long jsonSize = strlen(json);
-  char* readString = malloc(sizeof(char) * strlen(value) + 1);
-  int stringProgress = 0;
-  int valueFound = 0;
-  unsigned long returnInt = 0;
-  char prev = 0;
-  for (int i = 0; i < jsonSize; i++) {
-    char currentChar = json[i];
-    if (currentChar == '\"') {
-      if (prev == STRING_START) {
-        prev = STRING_END;
-        if (stringProgress == strlen(value)) {
-          readString[stringProgress] = '\0';
-          if (strcmp(value,readString) == 0) {
-            /* We might have just found the string! */
-            if (json[i+1] == ':') {
-              valueFound = 1;
-              i++;
-            }
-          }
-        }
-      } else {
-        stringProgress = 0;
-        prev = STRING_START;
-      }
-      continue;
-    }
-    /*
-    Remember that if user passes in something like "Apples"
-    Don't just search for apples, as 
-    */
-    if (valueFound == 1) {
-      if (currentChar == '}') {
-        free(readString);
-        return returnInt;
-      }
-      if (currentChar == '\"') {
-        free(readString);
-        return returnInt;
-      }
-      if (currentChar == ',') {
-        free(readString);
-        return returnInt;
-      }
-      returnInt *= 10;
-      returnInt += currentChar - '0';
-    } else if (prev == STRING_START) {
-      if (stringProgress > strlen(value)) {
-        /* The string we are reading is bigger than the string we want - this means it is DEFINITELY not the string */
-        stringProgress = 0;
-      } else {
-        readString[stringProgress] = currentChar;
-        stringProgress++;
-      }
-    }
-  }
-  free(readString);
+#if defined(__GNUC__) || defined(__clang__)
+/* cleanup runs stats_scope_end on every return, so timing does not need anything added before each return */
+#define SEAJSON_STAT_SCOPE(function) seajson_stat_scope statScope __attribute__((cleanup(stats_scope_end))) = stats_scope_begin(function)
+#else
+/* No way to run code on return here, so only calls get counted */
+#define SEAJSON_STAT_SCOPE(function) threadStats.calls[function]++
+#endif
+#define SEAJSON_STAT_SCANNED(function, count) (threadStats.bytesScanned[function] += (count))
+#define SEAJSON_STAT_FULL_SCAN(function, count) (threadStats.fullScans++, threadStats.bytesScanned[function] += (count))
+#define SEAJSON_STAT_ALLOCATION(size) (threadStats.allocations++, threadStats.bytesAllocated += (size))
+#define SEAJSON_STAT_CACHE_HIT() (threadStats.cacheHits++)
+#define SEAJSON_STAT_CACHE_MISS() (threadStats.cacheMisses++)
+#define SEAJSON_STAT_POOL_HIT() (threadStats.poolHits++)
+#define SEAJSON_STAT_POOL_MISS() (threadStats.poolMisses++)
+
+#else
+
+#define SEAJSON_STAT_SCOPE(function) ((void)0)
+#define SEAJSON_STAT_SCANNED(function, count) ((void)0)
+#define SEAJSON_STAT_FULL_SCAN(function, count) ((void)0)
+#define SEAJSON_STAT_ALLOCATION(size) ((void)0)
+#define SEAJSON_STAT_CACHE_HIT() ((void)0)
+#define SEAJSON_STAT_CACHE_MISS() ((void)0)
+#define SEAJSON_STAT_POOL_HIT() ((void)0)
+#define SEAJSON_STAT_POOL_MISS() ((void)0)
+
+#endif
+
+/* Locks */
+
+#ifndef _WIN32
+typedef pthread_mutex_t seajson_mutex;
+#define SEAJSON_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define seajson_mutex_lock(mutex) pthread_mutex_lock(mutex)
+#define seajson_mutex_unlock(mutex) pthread_mutex_unlock(mutex)
+#define seajson_mutex_init(mutex) pthread_mutex_init(mutex, NULL)
+#define seajson_mutex_destroy(mutex) pthread_mutex_destroy(mutex)
+typedef pthread_cond_t seajson_cond;
+#define seajson_cond_init(cond) pthread_cond_init(cond, NULL)
+#define seajson_cond_destroy(cond) pthread_cond_destroy(cond)
+#define seajson_cond_wait(cond, mutex) pthread_cond_wait(cond, mutex)
+#define seajson_cond_broadcast(cond) pthread_cond_broadcast(cond)
+#else
+typedef SRWLOCK seajson_mutex;
+#define SEAJSON_MUTEX_INIT SRWLOCK_INIT
+#define seajson_mutex_lock(mutex) AcquireSRWLockExclusive(mutex)
+#define seajson_mutex_unlock(mutex) ReleaseSRWLockExclusive(mutex)
+#define seajson_mutex_init(mutex) InitializeSRWLock(mutex)
+#define seajson_mutex_destroy(mutex) ((void)0)
+typedef CONDITION_VARIABLE seajson_cond;
+#define seajson_cond_init(cond) InitializeConditionVariable(cond)
+#define seajson_cond_destroy(cond) ((void)0)
+#define seajson_cond_wait(cond, mutex) SleepConditionVariableSRW(cond, mutex, INFINITE, 0)
+#define seajson_cond_broadcast(cond) WakeAllConditionVariable(cond)
+#endif
+
+/* Reference counts, atomic so handles can be shared between threads without a lock. release returns the count left. */
+
+#ifndef _WIN32
+typedef long seajson_refcount;
+#define seajson_refcount_retain(count) __atomic_add_fetch(count, 1, __ATOMIC_RELAXED)
+#define seajson_refcount_release(count) __atomic_sub_fetch(count, 1, __ATOMIC_ACQ_REL)
+#define seajson_refcount_load(count) __atomic_load_n(count, __ATOMIC_ACQUIRE)
+#else
+typedef volatile LONG seajson_refcount;
+#define seajson_refcount_retain(count) InterlockedIncrement(count)
+#define seajson_refcount_release(count) InterlockedDecrement(count)
+#define seajson_refcount_load(count) InterlockedCompareExchange(count, 0, 0)
+#endif
+
+/* Atomic pointers, compare_exchange returns whether target was expected and is now desired */
+
+#ifndef _WIN32
+#define seajson_pointer_load(target) __atomic_load_n(target, __ATOMIC_ACQUIRE)
+#define seajson_pointer_store(target, value) __atomic_store_n(target, value, __ATOMIC_RELEASE)
+#define seajson_pointer_exchange(target, value) __atomic_exchange_n(target, value, __ATOMIC_ACQ_REL)
+#define seajson_pointer_compare_exchange(target, expected, desired) __atomic_compare_exchange_n(target, &(expected), desired, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+#else
+#define seajson_pointer_load(target) InterlockedCompareExchangePointer((PVOID volatile *)(target), NULL, NULL)
+#define seajson_pointer_store(target, value) ((void)InterlockedExchangePointer((PVOID volatile *)(target), value))
+#define seajson_pointer_exchange(target, value) InterlockedExchangePointer((PVOID volatile *)(target), value)
+#define seajson_pointer_compare_exchange(target, expected, desired) (InterlockedCompareExchangePointer((PVOID volatile *)(target), desired, expected) == (PVOID)(expected))
+#endif
+
+/* Threads */
+
+#ifndef _WIN32
+typedef pthread_t seajson_thread;
+
+static int seajson_thread_start(seajson_thread *thread, void *(*function)(void *), void *argument) {
+  return pthread_create(thread, NULL, function, argument) == 0;
+}
+
+#define seajson_thread_join(thread) pthread_join(thread, NULL)
+#else
+typedef HANDLE seajson_thread;
+
+typedef struct {
+  void *(*function)(void *);
+  void *argument;
+} seajson_thread_start_info;
+
+static DWORD WINAPI seajson_thread_main(LPVOID parameter) {
+  seajson_thread_start_info info = *(seajson_thread_start_info *)parameter;
+  free(parameter);
+  info.function(info.argument);
   return 0;
 }
 
-seajson get_dictionary(seajson json, const char *value) {
-  unsigned long jsonSize = strlen(json);
-  char* readString = malloc(sizeof(char) * strlen(value) + 1);
-  int stringProgress = 0;
-  int valueFound = 0;
-  char* returnString = malloc(sizeof(char) * jsonSize + 1);
-  int inception = 0;
-  int inceptionInString = 0;
-  char prev = 0;
-  for (int i = 0; i < jsonSize; i++) {
-    char currentChar = json[i];
-    if (currentChar == '\"') {
-      if (prev == STRING_START) {
-        prev = STRING_END;
-        if (stringProgress == strlen(value)) {
-          readString[stringProgress] = '\0';
-          if (strcmp(value,readString) == 0) {
-            /* We might have just found the string! */
-            if (json[i+1] == ':') {
-              valueFound = 1;
-              stringProgress = 0;
-              i++;
-              continue;
-            }
-          }
-        }
-      } else {
-        prev = STRING_START;
-        if (valueFound == 0) {
-          stringProgress = 0;
-          continue;
-        }
-      }
-    } else if (currentChar == '}') {
-      if (valueFound == 1 && inception == 1 && inceptionInString == 0) {
-        /* We are on the ending } so we got our json */
-        /* Append ourselves to the end of the string then ret */
-        returnString[stringProgress] = '}';
-        returnString[stringProgress+1] = '\0';
-        free(readString);
-        return returnString;
-      }
-    }
-    /*
-    Remember that if user passes in something like "Apples"
-    Don't just search for apples, as 
-    */
-    if (valueFound) {
-      returnString[stringProgress] = currentChar;
-      stringProgress++;
-      if (inceptionInString == 0) {
-        if (currentChar == '{') {
-          inception++;
-        } else if (currentChar == '}') {
-          inception--;
-        } else if (currentChar == '\"') {
-          inceptionInString = 1;
-        } else if (currentChar == '[') {
-          inception++;
-        } else if (currentChar == ']') {
-          inception--;
-        }
-      } else {
-        /* We are currently reading chars in a string obj */
-        if (currentChar == '\"') {
-          /* If \" then cancel out */
-          if (json[i-1] != '\\') {
-            inceptionInString = 0;
-          }
-        }
-      }
-    } else if (prev == STRING_START) {
-      if (stringProgress > strlen(value)) {
-        /* The string we are reading is bigger than the string we want - this means it is DEFINITELY not the string */
-        stringProgress = 0;
-      } else {
-        readString[stringProgress] = currentChar;
-        stringProgress++;
-      }
-    }
+static int seajson_thread_start(seajson_thread *thread, void *(*function)(void *), void *argument) {
+  seajson_thread_start_info *info = malloc(sizeof(seajson_thread_start_info));
+  if (info == NULL) {
+    return 0;
   }
-  free(readString);
-  free(returnString);
-  return NULL;
+  info->function = function;
+  info->argument = argument;
+  *thread = CreateThread(NULL, 0, seajson_thread_main, info, 0, NULL);
+  if (*thread == NULL) {
+    free(info);
+    return 0;
+  }
+  return 1;
 }
 
-jarray get_array(seajson json, const char *value) {
-  unsigned long jsonSize = strlen(json);
-  char* readString = malloc(sizeof(char) * strlen(value) + 1);
-  int stringProgress = 0;
-  int valueFound = 0;
-  char* returnString = malloc(sizeof(char) * jsonSize + 1);
-  int inception = 0;
-  int inceptionInString = 0;
-  int itemCount = 0;
-  char prev = 0;
-  for (int i = 0; i < jsonSize; i++) {
-    char currentChar = json[i];
-    if (currentChar == '\"') {
-      if (prev == STRING_START) {
-        prev = STRING_END;
-        if (stringProgress == strlen(value)) {
-          readString[stringProgress] = '\0';
-          if (strcmp(value,readString) == 0) {
-            /* We might have just found the string! */
-            if (json[i+1] == ':') {
-              valueFound = 1;
-              stringProgress = 0;
-              i++;
-              continue;
-            }
-          }
-        }
-      } else {
-        prev = STRING_START;
-        if (valueFound == 0) {
-          stringProgress = 0;
-          continue;
-        }
-      }
-    } else if (currentChar == ']') {
-      if (valueFound == 1 && inception == 1 && inceptionInString == 0) {
-        /* We are on the ending } so we got our json */
-        /* Append ourselves to the end of the string then ret */
-        returnString[stringProgress] = ']';
-        returnString[stringProgress+1] = '\0';
-        free(readString);
-        jarray jsonArray;
-        jsonArray.itemCount = itemCount;
-        jsonArray.arrayString = returnString;
-        jsonArray.isValid = 1;
-        return jsonArray;
-      }
-    }
-    /*
-    Remember that if user passes in something like "Apples"
-    Don't just search for apples, as 
-    */
-    if (valueFound) {
-      returnString[stringProgress] = currentChar;
-      stringProgress++;
-      if (inceptionInString == 0) {
-        if (currentChar == '{') {
-          inception++;
-        } else if (currentChar == '}') {
-          inception--;
-        } else if (currentChar == '\"') {
-          inceptionInString = 1;
-        } else if (currentChar == '[') {
-          inception++;
-          if (inception == 1) {
-            if (itemCount == 0) {
-              itemCount++;
-            }
-          }
-        } else if (currentChar == ']') {
-          inception--;
-        } else if (currentChar == ',') {
-          /* Make sure the , is not inside of {}/[] */
-          if (inception == 1) {
-            itemCount++;
-          }
-        }
-      } else {
-        /* We are currently reading chars in a string obj */
-        if (currentChar == '\"') {
-          /* If \" then cancel out */
-          if (json[i-1] != '\\') {
-            inceptionInString = 0;
-          }
-        }
-      }
-    } else if (prev == STRING_START) {
-      if (stringProgress > strlen(value)) {
-        /* The string we are reading is bigger than the string we want - this means it is DEFINITELY not the string */
-        stringProgress = 0;
-      } else {
-        readString[stringProgress] = currentChar;
-        stringProgress++;
-      }
-    }
-  }
-  free(readString);
-  free(returnString);
-  jarray error;
-  error.itemCount = 0;
-  /* Set isValid to 0 since this is an error and not a valid jarray */
-  error.isValid = 0;
-  return error;
+#define seajson_thread_join(thread) (WaitForSingleObject(thread, INFINITE), CloseHandle(thread))
+#endif
+
+/* Allocation, everything SeaJSON allocates goes through these */
+
+static void *libc_malloc(void *context, size_t size) {
+  (void)context;
+  return malloc(size);
 }
 
-/* This is a very WIP function, it does not allow JSONs such that are formatted with new lines or spaces in the slightest currently - either convert a JSON to not have whitespace and then do rest of the function or modify the function to behave differently. */
-char* get_item_from_jarray(jarray array, int index) {
-  if (array.isValid == 0) {
-    fprintf(stderr, "SeaJSON Error: Non-valid jarray passed into get_item_from_array.\n");
-    exit(1);
-  }
-  if (array.itemCount <= 0) {
-    fprintf(stderr, "SeaJSON Error: jarray with 0 or less items passed into get_item_from_array.\n");
-    exit(1);
-  }
-  if (index >= array.itemCount) {
-    fprintf(stderr,"SeaJSON Error: Requested OOB index from jarray.\n");
-    exit(1);
-  }
-  char *arrayString = array.arrayString;
-  unsigned long arrStrLen = strlen(arrayString);
-  int itemIndex = 0;
-  char* returnItem = malloc(sizeof(char) * arrStrLen);
-  int returnItemIndex = 0;
-  int inception = 0;
-  int inceptionInString = 0;
-  /* Skip the first item since it will just be a [ */
-  for (int i = 1; i < arrStrLen; i++) {
-    char currentChar = arrayString[i];
-    if (inceptionInString == 0) {
-      if (currentChar == '{') {
-        inception++;
-      } else if (currentChar == '}') {
-        inception--;
-      } else if (currentChar == '\"') {
-        inceptionInString = 1;
-      } else if (currentChar == '[') {
-        inception++;
-      } else if (currentChar == ']') {
-        inception--;
-      }
-    } else {
-      /* We are currently reading chars in a string obj */
-      if (currentChar == '\"') {
-        /* If \" then cancel out */
-        if (arrayString[i-1] != '\\') {
-          inceptionInString = 0;
-        }
-      }
-    }
-    char futureChar = arrayString[i+1];
-    if (itemIndex == index) {
-      returnItem[returnItemIndex] = currentChar;
-      returnItemIndex++;
-      if ((futureChar == ',' && inception == 0 && inceptionInString == 0) || i == (strlen(arrayString)-2)) {
-        returnItem[returnItemIndex] = '\0';
-        return returnItem;
-      }
-    } else {
-      if (i == (strlen(arrayString)-2)) {
-        fprintf(stderr, "SeaJSON Error: Failed to find item in array.\n");
-        exit(1);
-      }
-      if (futureChar == ',' && inception == 0 && inceptionInString == 0) {
-        i++;
-        itemIndex++;
-      }
-    }
-  }
-  free(returnItem);
-  return NULL;
+static void *libc_realloc(void *context, void *ptr, size_t size) {
+  (void)context;
+  return realloc(ptr, size);
 }
 
-void free_jarray(jarray array) {
-  free(array.arrayString);
+static void libc_free(void *context, void *ptr) {
+  (void)context;
+  free(ptr);
 }
 
-seajson remove_whitespace_from_json(seajson json) {
-  unsigned long jsonSize = strlen(json);
-  seajson returnJson = malloc(sizeof(char) * (jsonSize + 1));
-  int returnJsonIndex = 0;
-  int stringInception = 0;
-  for (int i = 0; i < jsonSize; i++) {
-    char currentChar = json[i];
-    if (!stringInception) {
-      if (currentChar == '\n') {
-        /* Newline */
-        continue;
-      } else if (currentChar == ' ') {
-        /* Space */
-        continue;
-      } else if (currentChar == ' ') {
-        /* Tab (i think) */
-        continue;
-      } else if (currentChar == '\"') {
-        stringInception = 1;
-      }
-    } else if (currentChar == '\"') {
-      stringInception = 0;
-    }
-    returnJson[returnJsonIndex] = currentChar;
-    returnJsonIndex++;
-  }
-  returnJson[returnJsonIndex] = '\0';
-  return returnJson;
+static seajson_allocator globalAllocator = { libc_malloc, libc_realloc, libc_free, NULL };
+
+/* Set at the start of every public function, to the allocator of the document it works on */
+static SEAJSON_THREAD_LOCAL seajson_allocator documentAllocator;
+static SEAJSON_THREAD_LOCAL int usingDocumentAllocator;
+
+/*
+ * Documents with their own allocator carry it in a header right in front
+ * of the json, so finding it reads the bytes before the document rather
+ * than a table every thread has to share. Plain strings have no header,
+ * so only a pointer SEAJSON_DOCUMENT_HEADER_SIZE past a 64 byte boundary
+ * is looked at (the header is then in the same 64 bytes as the json, so
+ * reading it can never fault), and a header only counts if its check is
+ * the process's secret mixed with the document's address and allocator,
+ * which whatever happens to be in front of a plain string will not be.
+ */
+#define SEAJSON_DOCUMENT_ALIGNMENT 64
+
+typedef struct {
+  uint64_t check;
+  size_t offset;  /* From the start of the allocation to the json */
+  seajson_allocator allocator;
+} document_header;
+
+#define SEAJSON_DOCUMENT_HEADER_SIZE sizeof(document_header)
+/* Room for the header and for lining the json up after it */
+#define SEAJSON_DOCUMENT_OVERHEAD (SEAJSON_DOCUMENT_HEADER_SIZE + SEAJSON_DOCUMENT_ALIGNMENT - 1)
+
+/* The read in front of a plain string is outside of it as far as sanitizers can tell */
+#if defined(__clang__)
+#define SEAJSON_NO_SANITIZE __attribute__((no_sanitize("address", "hwaddress", "thread", "memory")))
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define SEAJSON_NO_SANITIZE __attribute__((no_sanitize("address", "thread")))
+#else
+#define SEAJSON_NO_SANITIZE
+#endif
+
+static void *documentSecret;
+
+static uint64_t mix_document_bits(uint64_t bits) {
+  bits ^= bits >> 30;
+  bits *= 0xBF58476D1CE4E5B9ULL;
+  bits ^= bits >> 27;
+  bits *= 0x94D049BB133111EBULL;
+  return bits ^ (bits >> 31);
 }
 
-jarray remove_whitespace_from_jarray(jarray array) {
-  if (array.isValid == 0) {
-    fprintf(stderr, "SeaJSON Error: Non-valid jarray passed into removeWhitespaceFromJarray.\n");
-    exit(1);
+/* Made the first time it is needed from whatever differs between runs, the first thread to set it wins */
+static uint64_t document_secret(void) {
+  void *secret = seajson_pointer_load(&documentSecret);
+  if (secret == NULL) {
+    int local = 0;
+    void *heap = malloc(1);
+    uint64_t bits = mix_document_bits((uint64_t)time(NULL) ^ ((uint64_t)clock() << 32));
+    bits = mix_document_bits(bits ^ (uint64_t)(uintptr_t)&local);
+    bits = mix_document_bits(bits ^ (uint64_t)(uintptr_t)&documentSecret);
+    bits = mix_document_bits(bits ^ (uint64_t)(uintptr_t)heap);
+    free(heap);
+    void *candidate = (void *)(uintptr_t)(bits | 1);
+    void *expected = NULL;
+    secret = seajson_pointer_compare_exchange(&documentSecret, expected, candidate) ? candidate : seajson_pointer_load(&documentSecret);
   }
-  jarray returnJarray;
-  returnJarray.itemCount = array.itemCount;
-  returnJarray.isValid = array.isValid;
-  returnJarray.arrayString = remove_whitespace_from_json(array.arrayString);
-  return returnJarray;
+  return (uint64_t)(uintptr_t)secret;
 }
 
-char* get_string_from_jarray(jarray array, int index) {
-  char* rawItem = get_item_from_jarray(array, index);
-  unsigned long rawItemLen = strlen(rawItem);
-  if (rawItem[0] == '\"') {
-    if (rawItem[rawItemLen - 1] == '\"') {
-      /* Cut the beginning and ending " */
-      char *start = &rawItem[1];
-      char *end = &rawItem[rawItemLen - 1];
-      /* Note the + 1 here, to have a null terminated substring */
-      char *substr = (char *)calloc(1, end - start + 1);
-      memcpy(substr, start, end - start);
-      free(rawItem);
-      return substr;
-    }
+static uint64_t document_check(const char *json, const seajson_allocator *allocator) {
+  uint64_t check = mix_document_bits(document_secret() ^ (uint64_t)(uintptr_t)json);
+  unsigned char bytes[sizeof(seajson_allocator)];
+  memcpy(bytes, allocator, sizeof(bytes));
+  for (size_t i = 0; i + sizeof(uint64_t) <= sizeof(bytes); i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    check = mix_document_bits(check ^ word);
   }
-  return rawItem;
+  return check;
 }
 
-int get_int_from_jarray(jarray array, int index) {
-  char* rawItem = get_item_from_jarray(array, index);
-  unsigned long stringNumberLen = strlen(rawItem);
-  int returnInt = 0;
-  int isNeg = 0;
-  if (rawItem[0] == '-') {
-    isNeg = 1;
+/* Returns 1 and fills in header if json has one */
+SEAJSON_NO_SANITIZE static int read_document_header(const char *json, document_header *header) {
+  if (json == NULL || ((uintptr_t)json & (SEAJSON_DOCUMENT_ALIGNMENT - 1)) != SEAJSON_DOCUMENT_HEADER_SIZE) {
+    return 0;
   }
-  for (int i = isNeg; i < stringNumberLen; i++) {
-    char currentChar = rawItem[i];
-    returnInt *= 10;
-    returnInt += currentChar - '0';
+  /* Byte by byte through volatile so it is not turned into a memcpy call a sanitizer would check anyway */
+  const volatile unsigned char *source = (const volatile unsigned char *)(json - SEAJSON_DOCUMENT_HEADER_SIZE);
+  unsigned char *destination = (unsigned char *)header;
+  for (size_t i = 0; i < SEAJSON_DOCUMENT_HEADER_SIZE; i++) {
+    destination[i] = source[i];
   }
-  if (isNeg) {
-    returnInt *= -1;
+  return header->check == document_check(json, &header->allocator) && header->offset <= SEAJSON_DOCUMENT_OVERHEAD;
+}
+
+/* Where the json goes in an allocation starting at base, always SEAJSON_DOCUMENT_HEADER_SIZE past a 64 byte boundary */
+static char *document_json_start(char *base) {
+  uintptr_t aligned = ((uintptr_t)base + SEAJSON_DOCUMENT_ALIGNMENT - 1) & ~(uintptr_t)(SEAJSON_DOCUMENT_ALIGNMENT - 1);
+  return base + (aligned - (uintptr_t)base) + SEAJSON_DOCUMENT_HEADER_SIZE;
+}
+
+static void write_document_header(char *base, char *json, const seajson_allocator *allocator) {
+  document_header header;
+  header.offset = (size_t)(json - base);
+  header.allocator = *allocator;
+  header.check = document_check(json, allocator);
+  memcpy(json - SEAJSON_DOCUMENT_HEADER_SIZE, &header, sizeof(header));
+}
+
+/* Every public function that allocates starts with this, NULL means the global allocator */
+static void use_document_allocator(const void *document) {
+  document_header header;
+  usingDocumentAllocator = read_document_header(document, &header);
+  if (usingDocumentAllocator) {
+    documentAllocator = header.allocator;
   }
-  free(rawItem);
-  return returnInt;
 }
 
-jarray remove_item_of_jarray(jarray array, int index) {
-  if (array.isValid == 0) {
-    fprintf(stderr, "SeaJSON Error: Non-valid jarray passed into remove_item_of_jarray.\n");
-    exit(1);
+static const seajson_allocator *current_allocator(void) {
+  return usingDocumentAllocator ? &documentAllocator : &globalAllocator;
+}
+
+/* Moves json, which allocator made, behind a header of its own, returns NULL (having freed it) if that can not be allocated */
+static char *attach_document_header(char *json, const seajson_allocator *allocator) {
+  size_t size = strlen(json) + 1;
+  if (size > SIZE_MAX - SEAJSON_DOCUMENT_OVERHEAD) {
+    allocator->free(allocator->context, json);
+    return NULL;
   }
-  if (array.itemCount <= 0) {
-    fprintf(stderr, "SeaJSON Error: jarray with 0 or less items passed into remove_item_of_jarray.\n");
-    exit(1);
+  char *base = allocator->realloc(allocator->context, json, size + SEAJSON_DOCUMENT_OVERHEAD);
+  if (base == NULL) {
+    allocator->free(allocator->context, json);
+    fprintf(stderr, "SeaJSON Error: Memory allocation failed.\n");
+    return NULL;
   }
-  if (index >= array.itemCount) {
-    fprintf(stderr,"SeaJSON Error: Requested OOB index from jarray (remove_item_of_jarray).\n");
-    exit(1);
+  char *moved = document_json_start(base);
+  memmove(moved, base, size);
+  write_document_header(base, moved, allocator);
+  return moved;
+}
+
+/* Sub-documents made from a document with its own allocator came from that allocator, so they get its header too */
+static seajson adopt_document(seajson result) {
+  document_header header;
+  if (result == NULL || !usingDocumentAllocator || read_document_header(result, &header)) {
+    return result;
   }
-  char *arrayString = array.arrayString;
-  unsigned long arrStrLen = strlen(arrayString);
-  int itemIndex = 0;
-  char* returnItem = malloc(sizeof(char) * arrStrLen);
-  int returnItemIndex = 0;
-  int inception = 0;
-  int inceptionInString = 0;
-  /* Skip the first item since it will just be a [ */
-  for (int i = 0; i < arrStrLen; i++) {
-    char currentChar = arrayString[i];
-    if (inceptionInString == 0) {
-      if (currentChar == '{') {
-        inception++;
-      } else if (currentChar == '}') {
-        inception--;
-      } else if (currentChar == '\"') {
-        inceptionInString = 1;
-      } else if (currentChar == '[') {
-        inception++;
-      } else if (currentChar == ']') {
-        inception--;
-      }
-    } else {
-      /* We are currently reading chars in a string obj */
-      if (currentChar == '\"') {
-        /* If \" then cancel out */
-        if (arrayString[i-1] != '\\') {
-          inceptionInString = 0;
-        }
-      }
+  return attach_document_header(result, &documentAllocator);
+}
+
+static void *sea_malloc(size_t size) {
+  const seajson_allocator *allocator = current_allocator();
+  SEAJSON_STAT_ALLOCATION(size);
+  return allocator->malloc(allocator->context, size);
+}
+
+static void *sea_realloc(void *ptr, size_t size) {
+  const seajson_allocator *allocator = current_allocator();
+  SEAJSON_STAT_ALLOCATION(size);
+  return allocator->realloc(allocator->context, ptr, size);
+}
+
+static void sea_free(void *ptr) {
+  const seajson_allocator *allocator = current_allocator();
+  allocator->free(allocator->context, ptr);
+}
+
+/* A buffer for a new document, with its header already in front when it has its own allocator so adopt_document never has to move it */
+static char *new_document_buffer(size_t size) {
+  if (!usingDocumentAllocator) {
+    return sea_malloc(size);
+  }
+  if (size > SIZE_MAX - SEAJSON_DOCUMENT_OVERHEAD) {
+    return NULL;
+  }
+  char *base = sea_malloc(size + SEAJSON_DOCUMENT_OVERHEAD);
+  if (base == NULL) {
+    return NULL;
+  }
+  char *json = document_json_start(base);
+  write_document_header(base, json, &documentAllocator);
+  return json;
+}
+
+/* Frees a document, header and all */
+static void free_document(char *json) {
+  document_header header;
+  if (read_document_header(json, &header)) {
+    header.allocator.free(header.allocator.context, json - header.offset);
+  } else {
+    sea_free(json);
+  }
+}
+
+/* Scanning kernels */
+
+/*
+ * The hot scanning loops (strings, brackets, whitespace) all come down to
+ * finding the next byte out of a small set, which each kernel does with a
+ * different instruction set. The best one the CPU has is picked when
+ * SeaJSON is loaded (or first used, where there are no constructors),
+ * unless SEAJSON_KERNEL names another one.
+ */
+typedef struct {
+  unsigned char classBit;  /* The set's bit in byteClasses, for the scalar kernel */
+  int count;
+  char chars[16];          /* Padded to 16 so SSE4.2 can load it as is */
+} seajson_byte_set;
+
+#define SEAJSON_CLASS_STRING 1
+#define SEAJSON_CLASS_STRUCTURAL 2
+#define SEAJSON_CLASS_MINIFY 4
+#define SEAJSON_CLASS_ESCAPE 8
+#define SEAJSON_CLASS_PRETTY 16
+
+/* Bytes that end a run inside of a string */
+static const seajson_byte_set stringChars = { SEAJSON_CLASS_STRING, 2, { '\"', '\\' } };
+/* Bytes that matter for bracket depth outside of strings */
+static const seajson_byte_set structuralChars = { SEAJSON_CLASS_STRUCTURAL, 5, { '\"', '{', '}', '[', ']' } };
+/* Bytes that end a run when dropping whitespace outside of strings */
+static const seajson_byte_set minifyChars = { SEAJSON_CLASS_MINIFY, 5, { ' ', '\n', '\t', '\r', '\"' } };
+static const seajson_byte_set escapeChars = { SEAJSON_CLASS_ESCAPE, 1, { '\\' } };
+/* Bytes that end a run when pretty printing outside of strings */
+static const seajson_byte_set prettyChars = { SEAJSON_CLASS_PRETTY, 11, { ' ', '\n', '\t', '\r', '\"', '{', '}', '[', ']', ',', ':' } };
+
+static const unsigned char byteClasses[256] = {
+  ['\"'] = SEAJSON_CLASS_STRING | SEAJSON_CLASS_STRUCTURAL | SEAJSON_CLASS_MINIFY | SEAJSON_CLASS_PRETTY,
+  ['\\'] = SEAJSON_CLASS_STRING | SEAJSON_CLASS_ESCAPE,
+  ['{'] = SEAJSON_CLASS_STRUCTURAL | SEAJSON_CLASS_PRETTY,
+  ['}'] = SEAJSON_CLASS_STRUCTURAL | SEAJSON_CLASS_PRETTY,
+  ['['] = SEAJSON_CLASS_STRUCTURAL | SEAJSON_CLASS_PRETTY,
+  [']'] = SEAJSON_CLASS_STRUCTURAL | SEAJSON_CLASS_PRETTY,
+  [','] = SEAJSON_CLASS_PRETTY,
+  [':'] = SEAJSON_CLASS_PRETTY,
+  [' '] = SEAJSON_CLASS_MINIFY | SEAJSON_CLASS_PRETTY,
+  ['\n'] = SEAJSON_CLASS_MINIFY | SEAJSON_CLASS_PRETTY,
+  ['\t'] = SEAJSON_CLASS_MINIFY | SEAJSON_CLASS_PRETTY,
+  ['\r'] = SEAJSON_CLASS_MINIFY | SEAJSON_CLASS_PRETTY
+};
+
+/* Every kernel returns the offset of the first byte of data in set, or length if there is none */
+static size_t find_byte_scalar(const char *data, size_t length, const seajson_byte_set *set) {
+  size_t i = 0;
+  while (i < length && !(byteClasses[(unsigned char)data[i]] & set->classBit)) {
+    i++;
+  }
+  return i;
+}
+
+#ifdef SEAJSON_X86_KERNELS
+#define SEAJSON_CPU_SSE42 1
+#define SEAJSON_CPU_AVX2 2
+#define SEAJSON_CPU_AVX512 4
+
+__attribute__((target("sse4.2")))
+static size_t find_byte_sse42(const char *data, size_t length, const seajson_byte_set *set) {
+  __m128i needles = _mm_loadu_si128((const __m128i *)set->chars);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+    int found = _mm_cmpestri(needles, set->count, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+    if (found < 16) {
+      return i + (size_t)found;
     }
-    if (itemIndex != index) {
-      returnItem[returnItemIndex] = currentChar;
-      returnItemIndex++;
+  }
+  return i + find_byte_scalar(data + i, length - i, set);
+}
+
+__attribute__((target("avx2")))
+static size_t find_byte_avx2(const char *data, size_t length, const seajson_byte_set *set) {
+  __m256i needles[16];
+  for (int n = 0; n < set->count; n++) {
+    needles[n] = _mm256_set1_epi8(set->chars[n]);
+  }
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+    __m256i matches = _mm256_cmpeq_epi8(chunk, needles[0]);
+    for (int n = 1; n < set->count; n++) {
+      matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(chunk, needles[n]));
     }
-    char futureChar = arrayString[i+1];
-    if (i == (strlen(arrayString)-2)) {
-      returnItem[returnItemIndex] = futureChar;
-      returnItem[returnItemIndex+1] = '\0';
-      jarray newJarray;
-      newJarray.itemCount = array.itemCount - 1;
-      newJarray.isValid = array.isValid;
-      newJarray.arrayString = returnItem;
-      return newJarray;
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(matches);
+    if (mask) {
+      return i + (size_t)__builtin_ctz(mask);
     }
-    if (futureChar == ',' && inception == 1 && inceptionInString == 0) {
-      i++;
-      itemIndex++;
-      if (itemIndex != index) {
-        returnItem[returnItemIndex] = ',';
-        returnItemIndex++;
-      }
+  }
+  return i + find_byte_scalar(data + i, length - i, set);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t find_byte_avx512(const char *data, size_t length, const seajson_byte_set *set) {
+  __m512i needles[16];
+  for (int n = 0; n < set->count; n++) {
+    needles[n] = _mm512_set1_epi8(set->chars[n]);
+  }
+  size_t i = 0;
+  for (; i + 64 <= length; i += 64) {
+    __m512i chunk = _mm512_loadu_si512((const void *)(data + i));
+    __mmask64 mask = _mm512_cmpeq_epi8_mask(chunk, needles[0]);
+    for (int n = 1; n < set->count; n++) {
+      mask |= _mm512_cmpeq_epi8_mask(chunk, needles[n]);
+    }
+    if (mask) {
+      return i + (size_t)__builtin_ctzll(mask);
     }
   }
-  free(returnItem);
-  printf("SeaJSON Error: remove_item_of_jarray has encounter a problem. Returning original jarray...\n");
-  return array;
+  /* AVX-512 always comes with AVX2, so the tail can still do 32 at a time */
+  return i + find_byte_avx2(data + i, length - i, set);
 }
 
-jarray add_item_to_jarray(jarray array, char* item) {
-  if (array.isValid == 0) {
-    fprintf(stderr, "SeaJSON Error: Non-valid jarray passed into add_item_to_jarray.\n");
-    exit(1);
+/* Where the quotes, backslashes and brackets are in a 64 byte block, one bit per byte */
+typedef struct {
+  uint64_t quotes;
+  uint64_t backslashes;
+  uint64_t brackets;
+} seajson_block_masks;
+
+__attribute__((target("sse4.2")))
+static void classify_block_sse42(const char *block, seajson_block_masks *masks) {
+  masks->quotes = 0;
+  masks->backslashes = 0;
+  masks->brackets = 0;
+  for (int part = 0; part < 4; part++) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(block + part * 16));
+    __m128i brackets = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('{')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('}'))),
+                                    _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('[')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(']'))));
+    masks->quotes |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\"'))) << (part * 16);
+    masks->backslashes |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))) << (part * 16);
+    masks->brackets |= (uint64_t)(unsigned int)_mm_movemask_epi8(brackets) << (part * 16);
   }
-  char *arrayString = array.arrayString;
-  unsigned long arrStrLen = strlen(arrayString);
-  if (arrayString[arrStrLen - 1] == ']' && arrayString[0] == '[') {
-    unsigned long itemLen = strlen(item);
-    if (arrStrLen == 2) {
-      /* A blank jarray has been passed in */
-      char* returnItem = malloc(sizeof(char) * (3 + itemLen));
-      returnItem[0] = '[';
-      /*
-      I was gonna do strncat(returnItem, item, strlen(item));
-      But for some reason that seems buggy
-      */
-      for (int i = 0; i < itemLen; i++) {
-        returnItem[i+1] = item[i];
-      }
-      returnItem[itemLen+1] = ']';
-      returnItem[itemLen+2] = '\0';
-      jarray newJarray;
-      newJarray.arrayString = returnItem;
-      newJarray.isValid = 1;
-      newJarray.itemCount = 1;
-      return newJarray;
-    } else {
-      char* returnItem = malloc(sizeof(char) * (arrStrLen + strlen(item) + 2));
-      for (int i = 0; i < arrStrLen; i++) {
-        returnItem[i] = arrayString[i];
-      }
-      returnItem[arrStrLen-1] = ',';
-      for (int i = 0; i < itemLen; i++) {
-        returnItem[arrStrLen+i] = item[i];
+}
+
+__attribute__((target("avx2")))
+static void classify_block_avx2(const char *block, seajson_block_masks *masks) {
+  masks->quotes = 0;
+  masks->backslashes = 0;
+  masks->brackets = 0;
+  for (int part = 0; part < 2; part++) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(block + part * 32));
+    __m256i brackets = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('}'))),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('[')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(']'))));
+    masks->quotes |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\"'))) << (part * 32);
+    masks->backslashes |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'))) << (part * 32);
+    masks->brackets |= (uint64_t)(unsigned int)_mm256_movemask_epi8(brackets) << (part * 32);
+  }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void classify_block_avx512(const char *block, seajson_block_masks *masks) {
+  __m512i chunk = _mm512_loadu_si512((const void *)block);
+  masks->quotes = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\"'));
+  masks->backslashes = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\\'));
+  masks->brackets = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('{')) | _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('}')) |
+                    _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('[')) | _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(']'));
+}
+
+static unsigned long long read_xcr0(void) {
+  unsigned int low;
+  unsigned int high;
+  __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+  return ((unsigned long long)high << 32) | low;
+}
+
+/* cpuid says what the CPU has, xgetbv says if the OS saves the wider registers so they can actually be used */
+static int read_cpu_features(void) {
+  unsigned int eax;
+  unsigned int ebx;
+  unsigned int ecx;
+  unsigned int edx;
+  int features = 0;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return 0;
+  }
+  if (ecx & (1u << 20)) {
+    features |= SEAJSON_CPU_SSE42;
+  }
+  int hasOsxsave = (ecx & (1u << 27)) != 0;
+  int hasAvx = (ecx & (1u << 28)) != 0;
+  if (!hasOsxsave || !hasAvx) {
+    return features;
+  }
+  unsigned long long xcr0 = read_xcr0();
+  if ((xcr0 & 0x6) != 0x6 || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return features;
+  }
+  if (ebx & (1u << 5)) {
+    features |= SEAJSON_CPU_AVX2;
+  }
+  if ((ebx & (1u << 16)) && (ebx & (1u << 30)) && (xcr0 & 0xe6) == 0xe6) {
+    features |= SEAJSON_CPU_AVX512;
+  }
+  return features;
+}
+#else
+static int read_cpu_features(void) {
+  return 0;
+}
+#endif
+
+typedef struct {
+  const char *name;
+  size_t (*find)(const char *data, size_t length, const seajson_byte_set *set);
+#ifdef SEAJSON_X86_KERNELS
+  void (*classify)(const char *block, seajson_block_masks *masks);  /* NULL for scalar, which goes byte by byte */
+#endif
+  int requiredFeatures;
+} seajson_kernel;
+
+/* Best first */
+static const seajson_kernel kernels[] = {
+#ifdef SEAJSON_X86_KERNELS
+  { "avx512", find_byte_avx512, classify_block_avx512, SEAJSON_CPU_AVX512 | SEAJSON_CPU_AVX2 },
+  { "avx2", find_byte_avx2, classify_block_avx2, SEAJSON_CPU_AVX2 },
+  { "sse4.2", find_byte_sse42, classify_block_sse42, SEAJSON_CPU_SSE42 },
+  { "scalar", find_byte_scalar, NULL, 0 }
+#else
+  { "scalar", find_byte_scalar, 0 }
+#endif
+};
+
+#define SEAJSON_KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+static const seajson_kernel *activeKernel = NULL;
+
+/* Returns the kernel called name if this CPU can run it, or NULL */
+static const seajson_kernel *find_kernel(const char *name) {
+  int features = read_cpu_features();
+  for (size_t i = 0; i < SEAJSON_KERNEL_COUNT; i++) {
+    if (strcmp(kernels[i].name, name) == 0) {
+      return ((kernels[i].requiredFeatures & features) == kernels[i].requiredFeatures) ? &kernels[i] : NULL;
+    }
+  }
+  return NULL;
+}
+
+static const seajson_kernel *select_kernel(void) {
+  const char *requested = getenv("SEAJSON_KERNEL");
+  const seajson_kernel *kernel = (requested && *requested) ? find_kernel(requested) : NULL;
+  if (kernel == NULL) {
+    int features = read_cpu_features();
+    for (size_t i = 0; i < SEAJSON_KERNEL_COUNT; i++) {
+      if ((kernels[i].requiredFeatures & features) == kernels[i].requiredFeatures) {
+        kernel = &kernels[i];
+        break;
       }
-      returnItem[arrStrLen+itemLen] = ']';
-      returnItem[arrStrLen+itemLen+1] = '\0';
-      jarray newJarray;
-      newJarray.itemCount = array.itemCount + 1;
-      newJarray.arrayString = returnItem;
-      newJarray.isValid = 1;
-      return newJarray;
     }
-  } else {
-    fprintf(stderr, "SeaJSON Error: Failed to find end of jarray (add_item_to_jarray).");
-    exit(1);
+    if (requested && *requested) {
+      fprintf(stderr, "SeaJSON Error: SEAJSON_KERNEL=%s is not available here, using %s\n", requested, kernel->name);
+    }
   }
-  return array;
+  activeKernel = kernel;
+  return kernel;
 }
 
-/*
- * ONLY supports adding. Not setting.
- * Use this in the case where you only
- * need to add an item to a json, as it
- * is faster than using set_string_seajson().
- */
-seajson add_string_seajson(seajson json, char* key, char *value) {
-  unsigned long jsonLen = strlen(json);
-  unsigned long keyLen = strlen(key);
-  unsigned long valueLen = strlen(value);
-  seajson returnJson = malloc(sizeof(char) * (jsonLen + keyLen + valueLen + 6));
-  for (int i = 0; i < jsonLen; i++) {
-    returnJson[i] = json[i];
+#if defined(__GNUC__) || defined(__clang__)
+/* Picking it at load means it is set before any thread could race to pick it */
+__attribute__((constructor)) static void select_kernel_at_load(void) {
+  if (activeKernel == NULL) {
+    select_kernel();
   }
-  returnJson[jsonLen - 1] = ',';
-  returnJson[jsonLen] = '\"';
-  for (int i = 1; i <= keyLen; i++) {
-    returnJson[i+jsonLen] = key[i-1];
+}
+#endif
+
+static const seajson_kernel *current_kernel(void) {
+  return activeKernel ? activeKernel : select_kernel();
+}
+
+static size_t find_byte_of(const char *data, size_t length, const seajson_byte_set *set) {
+  /* Most runs are short keys and numbers, those are over before a kernel call would pay for itself */
+  size_t quickLength = (length < 16) ? length : 16;
+  for (size_t i = 0; i < quickLength; i++) {
+    if (byteClasses[(unsigned char)data[i]] & set->classBit) {
+      return i;
+    }
   }
-  returnJson[jsonLen+keyLen+1] = '\"';
-  returnJson[jsonLen+keyLen+2] = ':';
-  returnJson[jsonLen+keyLen+3] = '\"';
-  for (int i = 0; i < valueLen; i++) {
-    returnJson[jsonLen+keyLen+4+i] = value[i];
+  if (quickLength == length) {
+    return length;
   }
-  returnJson[jsonLen+keyLen+valueLen+4] = '\"';
-  returnJson[jsonLen+keyLen+valueLen+5] = '}';
-  returnJson[jsonLen+keyLen+valueLen+6] = '\0';
-  return returnJson;
+  return quickLength + current_kernel()->find(data + quickLength, length - quickLength, set);
 }
 
-/*
- * ONLY supports adding. Not setting.
- * Use this in the case where you only
- * need to add an item to a json, as it
- * is faster than using set_item_seajson().
- */
-seajson add_item_seajson(seajson json, char* key, char *value) {
-  unsigned long jsonLen = strlen(json);
-  unsigned long keyLen = strlen(key);
-  unsigned long valueLen = strlen(value);
-  seajson returnJson = malloc(sizeof(char) * (jsonLen + keyLen + valueLen + 4));
-  for (int i = 0; i < jsonLen; i++) {
-    returnJson[i] = json[i];
+const char *seajson_kernel_name(void) {
+  return current_kernel()->name;
+}
+
+int seajson_set_kernel(const char *name) {
+  const seajson_kernel *kernel = find_kernel(name);
+  if (kernel == NULL) {
+    fprintf(stderr, "SeaJSON Error: seajson_set_kernel has no %s kernel for this CPU\n", name);
+    return -1;
   }
-  returnJson[jsonLen - 1] = ',';
-  returnJson[jsonLen] = '\"';
-  for (int i = 1; i <= keyLen; i++) {
-    returnJson[i+jsonLen] = key[i-1];
+  activeKernel = kernel;
+  return 0;
+}
+
+/* Scanning helpers */
+
+#define SEAJSON_SCAN_FAILED ((size_t)-1)
+
+static int is_json_whitespace(char currentChar) {
+  return currentChar == ' ' || currentChar == '\n' || currentChar == '\t' || currentChar == '\r';
+}
+
+static size_t skip_json_whitespace(const char *json, size_t length, size_t pos) {
+  while (pos < length && is_json_whitespace(json[pos])) {
+    pos++;
   }
-  returnJson[jsonLen+keyLen+1] = '\"';
-  returnJson[jsonLen+keyLen+2] = ':';
-  for (int i = 0; i < valueLen; i++) {
-    returnJson[jsonLen+keyLen+3+i] = value[i];
+  return pos;
+}
+
+/* pos should be right after the opening ", returns the pos of the closing " (or length if it is never closed) */
+static size_t find_json_string_end(const char *json, size_t length, size_t pos) {
+  while (pos < length) {
+    pos += find_byte_of(json + pos, length - pos, &stringChars);
+    if (pos >= length) {
+      break;
+    }
+    if (json[pos] == '\"') {
+      return pos;
+    }
+    /* Skip whatever is escaped, this is how \" does not end the string */
+    pos += 2;
   }
-  returnJson[jsonLen+keyLen+valueLen+3] = '}';
-  returnJson[jsonLen+keyLen+valueLen+4] = '\0';
-  return returnJson;
+  return length;
 }
 
-int get_pos_string_seajson(seajson json, const char *value) {
-  unsigned long jsonSize = strlen(json);
-  char* readString = malloc(sizeof(char) * strlen(value) + 1);
-  int stringProgress = 0;
-  int valueFound = 0;
-  char prev = 0;
-  for (int i = 0; i < jsonSize; i++) {
-    char currentChar = json[i];
-    if (currentChar == '\"') {
-      if (prev == STRING_START) {
-        if (valueFound == 1) {
-          /* We are on the ending " so we got our string */
-          free(readString);
-          fprintf(stderr,"SeaJSON Error: Found end of string (get_pos_string_seajson).\n");
-          return 0;
+static int hex_digit_value(char hexChar) {
+  if (hexChar >= '0' && hexChar <= '9') {
+    return hexChar - '0';
+  } else if (hexChar >= 'a' && hexChar <= 'f') {
+    return hexChar - 'a' + 10;
+  } else if (hexChar >= 'A' && hexChar <= 'F') {
+    return hexChar - 'A' + 10;
+  }
+  return -1;
+}
+
+static long read_json_hex4(const char *hex) {
+  long codepoint = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = hex_digit_value(hex[i]);
+    if (digit < 0) {
+      return -1;
+    }
+    codepoint = (codepoint << 4) | digit;
+  }
+  return codepoint;
+}
+
+/*
+ * Unescapes the body of a JSON string (without its quotes) into out,
+ * writing at most outSize - 1 chars plus a NULL terminator. The
+ * unescaped string is never longer than the escaped one, so length + 1
+ * is always enough room. Returns the unescaped length, or -1 if the
+ * string has a broken escape.
+ */
+static long long unescape_json_string(const char *string, size_t length, char *out, size_t outSize) {
+  size_t outIndex = 0;
+  size_t outLimit = outSize - 1;
+  for (size_t i = 0; i < length; i++) {
+    char currentChar = string[i];
+    if (currentChar != '\\') {
+      /* Copy everything up to the next escape in one go */
+      size_t run = find_byte_of(string + i, length - i, &escapeChars);
+      if (run > outLimit - outIndex) {
+        run = outLimit - outIndex;
+        memcpy(out + outIndex, string + i, run);
+        outIndex += run;
+        break;
+      }
+      memcpy(out + outIndex, string + i, run);
+      outIndex += run;
+      i += run - 1;
+      continue;
+    }
+    i++;
+    if (i >= length) {
+      return -1;
+    }
+    char encoded[4];
+    size_t encodedLength = 1;
+    switch (string[i]) {
+      case '\"': encoded[0] = '\"'; break;
+      case '\\': encoded[0] = '\\'; break;
+      case '/': encoded[0] = '/'; break;
+      case 'b': encoded[0] = '\b'; break;
+      case 'f': encoded[0] = '\f'; break;
+      case 'n': encoded[0] = '\n'; break;
+      case 'r': encoded[0] = '\r'; break;
+      case 't': encoded[0] = '\t'; break;
+      case 'u': {
+        if (i + 4 >= length) {
+          return -1;
         }
-        if (stringProgress == strlen(value)) {
-          readString[stringProgress] = '\0';
-          if (strcmp(value,readString) == 0) {
-            /* We might have just found the string! */
-            if (json[i+1] == ':') {
-              valueFound = 1;
-              i++;
-            }
+        long codepoint = read_json_hex4(string + i + 1);
+        if (codepoint < 0) {
+          return -1;
+        }
+        i += 4;
+        if (codepoint >= 0xD800 && codepoint <= 0xDBFF && i + 6 < length && string[i+1] == '\\' && string[i+2] == 'u') {
+          /* Surrogate pair */
+          long lowSurrogate = read_json_hex4(string + i + 3);
+          if (lowSurrogate >= 0xDC00 && lowSurrogate <= 0xDFFF) {
+            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (lowSurrogate - 0xDC00);
+            i += 6;
           }
         }
-        prev = STRING_END;
-      } else {
-        stringProgress = 0;
-        prev = STRING_START;
+        if (codepoint < 0x80) {
+          encoded[0] = (char)codepoint;
+        } else if (codepoint < 0x800) {
+          encoded[0] = (char)(0xC0 | (codepoint >> 6));
+          encoded[1] = (char)(0x80 | (codepoint & 0x3F));
+          encodedLength = 2;
+        } else if (codepoint < 0x10000) {
+          encoded[0] = (char)(0xE0 | (codepoint >> 12));
+          encoded[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+          encoded[2] = (char)(0x80 | (codepoint & 0x3F));
+          encodedLength = 3;
+        } else {
+          encoded[0] = (char)(0xF0 | (codepoint >> 18));
+          encoded[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+          encoded[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+          encoded[3] = (char)(0x80 | (codepoint & 0x3F));
+          encodedLength = 4;
+        }
+        break;
       }
-      continue;
+      default:
+        return -1;
     }
-    /*
-    Remember that if user passes in something like "Apples"
-    Don't just search for apples, as 
-    */
-    if (prev == STRING_START) {
-      if (valueFound) {
-        free(readString);
-        return i;
-      } else if (stringProgress > strlen(value)) {
-        /* The string we are reading is bigger than the string we want - this means it is DEFINITELY not the string */
-        stringProgress = 0;
-      } else {
-        readString[stringProgress] = currentChar;
-        stringProgress++;
-      }
+    if (outIndex + encodedLength > outLimit) {
+      /* Never cut a char in half when truncating */
+      break;
     }
+    memcpy(out + outIndex, encoded, encodedLength);
+    outIndex += encodedLength;
   }
-  free(readString);
-  return -1;
+  out[outIndex] = '\0';
+  return (long long)outIndex;
 }
 
-int get_pos_item_seajson(seajson json, const char *value) {
-  unsigned long jsonSize = strlen(json);
-  char* readString = malloc(sizeof(char) * strlen(value) + 1);
-  int stringProgress = 0;
-  int valueFound = 0;
-  char prev = 0;
-  for (int i = 0; i < jsonSize; i++) {
-    char currentChar = json[i];
-    if (currentChar == '\"') {
-      if (prev == STRING_START) {
-        if (valueFound == 1) {
-          /* We are on the ending " so we got our string */
-          free(readString);
-          fprintf(stderr,"SeaJSON Error: Found end of string (get_pos_string_seajson).\n");
-          return 0;
-        }
-        if (stringProgress == strlen(value)) {
-          readString[stringProgress] = '\0';
-          if (strcmp(value,readString) == 0) {
-            /* We might have just found the string! */
-            if (json[i+1] == ':') {
-              free(readString);
-              return i;
-            }
-          }
-        }
-        prev = STRING_END;
-      } else {
-        stringProgress = 0;
-        prev = STRING_START;
+/* Copies json without the whitespace between its tokens, returns the new length. out can be json itself, since it never gets ahead of it. */
+static size_t copy_json_minified(const char *json, size_t length, char *out) {
+  size_t outLength = 0;
+  int inString = 0;
+  int escaped = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (!escaped) {
+      /* Runs that can not change anything are copied as they are */
+      size_t run = find_byte_of(json + i, length - i, inString ? &stringChars : &minifyChars);
+      memmove(out + outLength, json + i, run);
+      outLength += run;
+      i += run;
+      if (i >= length) {
+        break;
       }
-      continue;
     }
-    /*
-    Remember that if user passes in something like "Apples"
-    Don't just search for apples, as 
-    */
-    if (prev == STRING_START) {
-      if (stringProgress > strlen(value)) {
-        /* The string we are reading is bigger than the string we want - this means it is DEFINITELY not the string */
-        stringProgress = 0;
-      } else {
-        readString[stringProgress] = currentChar;
-        stringProgress++;
+    char currentChar = json[i];
+    if (inString) {
+      if (escaped) {
+        escaped = 0;
+      } else if (currentChar == '\\') {
+        escaped = 1;
+      } else if (currentChar == '\"') {
+        inString = 0;
       }
+    } else if (is_json_whitespace(currentChar)) {
+      continue;
+    } else if (currentChar == '\"') {
+      inString = 1;
     }
+    out[outLength++] = currentChar;
   }
-  free(readString);
-  return -1;
+  return outLength;
+}
+
+/* Returns the pos right after the value starting at pos, or SEAJSON_SCAN_FAILED. Nested values are skipped by only tracking bracket depth and strings. */
+static size_t skip_json_value(const char *json, size_t length, size_t pos) {
+  if (pos >= length) {
+    return SEAJSON_SCAN_FAILED;
+  }
+  char currentChar = json[pos];
+  if (currentChar == '\"') {
+    size_t end = find_json_string_end(json, length, pos + 1);
+    return (end < length) ? end + 1 : SEAJSON_SCAN_FAILED;
+  }
+  if (currentChar == '{' || currentChar == '[') {
+    size_t inception = 0;
+    for (; pos < length; pos++) {
+      pos += find_byte_of(json + pos, length - pos, &structuralChars);
+      if (pos >= length) {
+        break;
+      }
+      currentChar = json[pos];
+      if (currentChar == '\"') {
+        pos = find_json_string_end(json, length, pos + 1);
+      } else if (currentChar == '{' || currentChar == '[') {
+        inception++;
+      } else if (currentChar == '}' || currentChar == ']') {
+        inception--;
+        if (inception == 0) {
+          return pos + 1;
+        }
+      }
+    }
+    return SEAJSON_SCAN_FAILED;
+  }
+  /* Numbers and true/false/null end at the next structural char or whitespace */
+  size_t start = pos;
+  while (pos < length) {
+    currentChar = json[pos];
+    if (currentChar == ',' || currentChar == '}' || currentChar == ']' || currentChar == ' ' || currentChar == '\n' || currentChar == '\t' || currentChar == '\r') {
+      break;
+    }
+    pos++;
+  }
+  return (pos > start) ? pos : SEAJSON_SCAN_FAILED;
+}
+
+typedef seajson_number json_number;
+
+/* Parses the number at pos, returns the pos right after it or SEAJSON_SCAN_FAILED */
+static size_t scan_json_number(const char *json, size_t length, size_t pos, json_number *number) {
+  size_t start = pos;
+  int isNeg = 0;
+  if (pos < length && json[pos] == '-') {
+    isNeg = 1;
+    pos++;
+  }
+  if (pos >= length || json[pos] < '0' || json[pos] > '9') {
+    return SEAJSON_SCAN_FAILED;
+  }
+  /* JSON numbers do not have leading zeros */
+  if (json[pos] == '0' && pos + 1 < length && json[pos + 1] >= '0' && json[pos + 1] <= '9') {
+    return SEAJSON_SCAN_FAILED;
+  }
+  unsigned long long magnitude = 0;
+  int isDouble = 0;
+  while (pos < length && json[pos] >= '0' && json[pos] <= '9') {
+    unsigned int digit = json[pos] - '0';
+    if (magnitude > (ULLONG_MAX - digit) / 10) {
+      /* Too big for an int, treat it as a double */
+      isDouble = 1;
+    } else {
+      magnitude = magnitude * 10 + digit;
+    }
+    pos++;
+  }
+  if (pos < length && (json[pos] == '.' || json[pos] == 'e' || json[pos] == 'E')) {
+    isDouble = 1;
+    /* strtod takes 1. and 1e+ too, json wants digits after both */
+    size_t check = pos;
+    if (json[check] == '.') {
+      check++;
+      if (check >= length || json[check] < '0' || json[check] > '9') {
+        return SEAJSON_SCAN_FAILED;
+      }
+      while (check < length && json[check] >= '0' && json[check] <= '9') {
+        check++;
+      }
+    }
+    if (check < length && (json[check] == 'e' || json[check] == 'E')) {
+      check++;
+      if (check < length && (json[check] == '+' || json[check] == '-')) {
+        check++;
+      }
+      if (check >= length || json[check] < '0' || json[check] > '9') {
+        return SEAJSON_SCAN_FAILED;
+      }
+    }
+  }
+  if (magnitude > (isNeg ? (unsigned long long)LLONG_MAX + 1 : (unsigned long long)LLONG_MAX)) {
+    isDouble = 1;
+  }
+  number->isDouble = isDouble;
+  if (isDouble) {
+    char *numberEnd;
+    number->number = strtod(json + start, &numberEnd);
+    /* Casting a double out of long long range is undefined, so those saturate */
+    if (number->number >= 9223372036854775808.0) {
+      number->integer = LLONG_MAX;
+    } else if (number->number < -9223372036854775808.0) {
+      number->integer = LLONG_MIN;
+    } else {
+      number->integer = (long long)number->number;
+    }
+    return (size_t)(numberEnd - json);
+  }
+  number->integer = isNeg ? (long long)(0 - magnitude) : (long long)magnitude;
+  number->number = (double)number->integer;
+  return pos;
+}
+
+/* Finds the container starting at pos in index, hint is checked first since scanning siblings usually asks for the next one. Returns its number or SEAJSON_SCAN_FAILED. */
+static size_t find_indexed_container(const seajson_index *index, uint64_t pos, uint64_t hint) {
+  if (hint < index->containerCount && index->containers[hint].start == pos) {
+    return (size_t)hint;
+  }
+  uint64_t low = 0;
+  uint64_t high = index->containerCount;
+  while (low < high) {
+    uint64_t middle = low + (high - low) / 2;
+    if (index->containers[middle].start < pos) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low < index->containerCount && index->containers[low].start == pos) {
+    return (size_t)low;
+  }
+  return SEAJSON_SCAN_FAILED;
+}
+
+/* Walks the direct members of an object or array, nested values are skipped over without looking inside of them */
+typedef struct {
+  const char *json;
+  size_t length;
+  const seajson_index *index;  /* When set, nested containers are jumped over using it instead of being read */
+  uint64_t indexHint;
+  size_t pos;
+  int isObject;
+  int done;
+  int failed;
+  size_t keyStart;      /* Key without its quotes, objects only */
+  size_t keyEnd;
+  size_t memberStart;   /* The key's opening " for objects, the value for arrays */
+  size_t valueStart;
+  size_t valueEnd;
+  size_t commaPos;      /* The , after the member, or SEAJSON_SCAN_FAILED for the last member */
+  size_t closePos;      /* The } or ], once done */
+  int unbounded;        /* length is only how much of a NULL terminated json is known so far, see extend_json_window */
+} member_scanner;
+
+/* containerPos should be on the { or [ */
+static void member_scanner_init(member_scanner *scanner, const char *json, size_t length, size_t containerPos) {
+  scanner->json = json;
+  scanner->length = length;
+  scanner->index = NULL;
+  scanner->indexHint = 0;
+  scanner->isObject = (json[containerPos] == '{');
+  scanner->done = 0;
+  scanner->failed = 0;
+  scanner->closePos = SEAJSON_SCAN_FAILED;
+  scanner->unbounded = 0;
+  scanner->pos = skip_json_whitespace(json, length, containerPos + 1);
+  if (scanner->pos < length && json[scanner->pos] == (scanner->isObject ? '}' : ']')) {
+    scanner->closePos = scanner->pos;
+    scanner->done = 1;
+  }
+}
+
+/*
+ * Lookups on a plain NULL terminated json do not strlen it first, that
+ * would read all of a big document to find its first key. Instead they
+ * know it in windows that double each time a scan runs off the end of
+ * the last one, so only about twice what the lookup needed is read.
+ */
+#define SEAJSON_FIRST_WINDOW ((size_t)4096)
+
+/* Returns how much of json is known after growing the window past length, or length if the NULL terminator is already there */
+static size_t extend_json_window(const char *json, size_t length) {
+  size_t grow = (length < SEAJSON_FIRST_WINDOW) ? SEAJSON_FIRST_WINDOW : length;
+  return length + strnlen(json + length, grow);
+}
+
+/* Returns the pos of the first value of a NULL terminated json with length set to how much of it is known, or SEAJSON_SCAN_FAILED if it is only whitespace */
+static size_t start_terminated_json(const char *json, size_t *length) {
+  size_t known = extend_json_window(json, 0);
+  size_t pos = skip_json_whitespace(json, known, 0);
+  while (pos >= known) {
+    size_t longer = extend_json_window(json, known);
+    if (longer == known) {
+      return SEAJSON_SCAN_FAILED;
+    }
+    known = longer;
+    pos = skip_json_whitespace(json, known, pos);
+  }
+  *length = known;
+  return pos;
+}
+
+/* member_scanner_init for a NULL terminated json that is only known up to length */
+static void member_scanner_init_terminated(member_scanner *scanner, const char *json, size_t length, size_t containerPos) {
+  /* The window has to reach the first member (or the close) for an empty container to be told apart */
+  while (skip_json_whitespace(json, length, containerPos + 1) >= length) {
+    size_t longer = extend_json_window(json, length);
+    if (longer == length) {
+      break;
+    }
+    length = longer;
+  }
+  member_scanner_init(scanner, json, length, containerPos);
+  scanner->unbounded = 1;
+}
+
+static int read_next_member(member_scanner *scanner);
+
+/* Returns 1 if it read another member, 0 once it hits the end (or failed is set) */
+static int member_scanner_next(member_scanner *scanner) {
+  for (;;) {
+    size_t memberPos = scanner->pos;
+    if (read_next_member(scanner)) {
+      return 1;
+    }
+    if (!scanner->failed || !scanner->unbounded) {
+      return 0;
+    }
+    /* It might only have run off the end of the window, read the member again with more of json */
+    size_t longer = extend_json_window(scanner->json, scanner->length);
+    if (longer == scanner->length) {
+      return 0;
+    }
+    scanner->length = longer;
+    scanner->failed = 0;
+    scanner->pos = memberPos;
+  }
+}
+
+static int read_next_member(member_scanner *scanner) {
+  const char *json = scanner->json;
+  size_t length = scanner->length;
+  if (scanner->done || scanner->failed) {
+    return 0;
+  }
+  size_t pos = skip_json_whitespace(json, length, scanner->pos);
+  scanner->memberStart = pos;
+  if (scanner->isObject) {
+    if (pos >= length || json[pos] != '\"') {
+      scanner->failed = 1;
+      return 0;
+    }
+    scanner->keyStart = pos + 1;
+    scanner->keyEnd = find_json_string_end(json, length, pos + 1);
+    pos = skip_json_whitespace(json, length, scanner->keyEnd + 1);
+    if (pos >= length || json[pos] != ':') {
+      scanner->failed = 1;
+      return 0;
+    }
+    pos = skip_json_whitespace(json, length, pos + 1);
+  }
+  scanner->valueStart = pos;
+  scanner->valueEnd = SEAJSON_SCAN_FAILED;
+  if (scanner->index && pos < length && (json[pos] == '{' || json[pos] == '[')) {
+    size_t container = find_indexed_container(scanner->index, pos, scanner->indexHint);
+    if (container != SEAJSON_SCAN_FAILED && scanner->index->containers[container].end) {
+      scanner->valueEnd = (size_t)scanner->index->containers[container].end;
+      scanner->indexHint = scanner->index->containers[container].after;
+    }
+  }
+  if (scanner->valueEnd == SEAJSON_SCAN_FAILED) {
+    scanner->valueEnd = skip_json_value(json, length, pos);
+  }
+  if (scanner->valueEnd == SEAJSON_SCAN_FAILED) {
+    scanner->failed = 1;
+    return 0;
+  }
+  pos = skip_json_whitespace(json, length, scanner->valueEnd);
+  if (pos < length && json[pos] == ',') {
+    scanner->commaPos = pos;
+    scanner->pos = pos + 1;
+  } else if (pos < length && json[pos] == (scanner->isObject ? '}' : ']')) {
+    scanner->commaPos = SEAJSON_SCAN_FAILED;
+    scanner->closePos = pos;
+    scanner->done = 1;
+  } else {
+    scanner->failed = 1;
+    return 0;
+  }
+  return 1;
+}
+
+/* Compares the raw key json[keyStart, keyEnd) with an unescaped key, only unescaping if the raw key has a \\ in it */
+static int json_key_equals(const char *json, size_t keyStart, size_t keyEnd, const char *key, size_t keyLength) {
+  size_t rawLength = keyEnd - keyStart;
+  if (memchr(json + keyStart, '\\', rawLength) == NULL) {
+    return rawLength == keyLength && memcmp(json + keyStart, key, keyLength) == 0;
+  }
+  if (rawLength < keyLength) {
+    /* Unescaping only ever makes it shorter */
+    return 0;
+  }
+  char stackKey[256];
+  char *unescaped = (rawLength < sizeof(stackKey)) ? stackKey : sea_malloc(rawLength + 1);
+  if (unescaped == NULL) {
+    return 0;
+  }
+  long long unescapedLength = unescape_json_string(json + keyStart, rawLength, unescaped, rawLength + 1);
+  int equal = (unescapedLength == (long long)keyLength && memcmp(unescaped, key, keyLength) == 0);
+  if (unescaped != stackKey) {
+    sea_free(unescaped);
+  }
+  return equal;
+}
+
+static int find_scanned_member(member_scanner *scanner, const char *key) {
+  size_t keyLength = strlen(key);
+  while (member_scanner_next(scanner)) {
+    if (json_key_equals(scanner->json, scanner->keyStart, scanner->keyEnd, key, keyLength)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Finds key among the direct members of the top level object, nested values are skipped by bracket depth so a key inside of them never matches. Returns 1 with scanner on the member, or 0. */
+static int find_top_level_member(const char *json, size_t length, const char *key, member_scanner *scanner) {
+  size_t pos = skip_json_whitespace(json, length, 0);
+  if (pos >= length || json[pos] != '{') {
+    scanner->pos = pos;
+    return 0;
+  }
+  member_scanner_init(scanner, json, length, pos);
+  return find_scanned_member(scanner, key);
+}
+
+/* find_top_level_member for a NULL terminated json, reading only as much of it as it has to (scanner->length is how much that was) */
+static int find_top_level_member_terminated(const char *json, const char *key, member_scanner *scanner) {
+  size_t length;
+  size_t pos = start_terminated_json(json, &length);
+  if (pos == SEAJSON_SCAN_FAILED || json[pos] != '{') {
+    scanner->pos = (pos == SEAJSON_SCAN_FAILED) ? 0 : pos;
+    return 0;
+  }
+  member_scanner_init_terminated(scanner, json, length, pos);
+  return find_scanned_member(scanner, key);
+}
+
+/* Growable byte buffer, once an allocation fails it stays failed so callers can check once at the end */
+typedef struct {
+  unsigned char *data;
+  size_t length;
+  size_t capacity;
+  int failed;
+} byte_buffer;
+
+static int byte_buffer_reserve(byte_buffer *buffer, size_t extra) {
+  if (buffer->failed) {
+    return 0;
+  }
+  if (buffer->length + extra <= buffer->capacity) {
+    return 1;
+  }
+  size_t newCapacity = buffer->capacity ? buffer->capacity * 2 : 256;
+  while (newCapacity < buffer->length + extra) {
+    newCapacity *= 2;
+  }
+  unsigned char *newData = sea_realloc(buffer->data, newCapacity);
+  if (newData == NULL) {
+    buffer->failed = 1;
+    return 0;
+  }
+  buffer->data = newData;
+  buffer->capacity = newCapacity;
+  return 1;
+}
+
+static void byte_buffer_append(byte_buffer *buffer, const void *bytes, size_t count) {
+  if (byte_buffer_reserve(buffer, count)) {
+    memcpy(buffer->data + buffer->length, bytes, count);
+    buffer->length += count;
+  }
+}
+
+static void byte_buffer_push(byte_buffer *buffer, unsigned char byte) {
+  if (byte_buffer_reserve(buffer, 1)) {
+    buffer->data[buffer->length++] = byte;
+  }
+}
+
+static void byte_buffer_insert(byte_buffer *buffer, size_t pos, const void *bytes, size_t count) {
+  if (byte_buffer_reserve(buffer, count)) {
+    memmove(buffer->data + pos + count, buffer->data + pos, buffer->length - pos);
+    memcpy(buffer->data + pos, bytes, count);
+    buffer->length += count;
+  }
+}
+
+static void write_escaped_json_string(byte_buffer *out, const char *string, size_t length) {
+  byte_buffer_push(out, '\"');
+  size_t runStart = 0;
+  for (size_t i = 0; i < length; i++) {
+    unsigned char currentChar = (unsigned char)string[i];
+    if (currentChar != '\"' && currentChar != '\\' && currentChar >= 0x20) {
+      continue;
+    }
+    byte_buffer_append(out, string + runStart, i - runStart);
+    runStart = i + 1;
+    char escape[7];
+    switch (currentChar) {
+      case '\"': byte_buffer_append(out, "\\\"", 2); break;
+      case '\\': byte_buffer_append(out, "\\\\", 2); break;
+      case '\n': byte_buffer_append(out, "\\n", 2); break;
+      case '\r': byte_buffer_append(out, "\\r", 2); break;
+      case '\t': byte_buffer_append(out, "\\t", 2); break;
+      case '\b': byte_buffer_append(out, "\\b", 2); break;
+      case '\f': byte_buffer_append(out, "\\f", 2); break;
+      default:
+        snprintf(escape, sizeof(escape), "\\u%04x", currentChar);
+        byte_buffer_append(out, escape, 6);
+        break;
+    }
+  }
+  byte_buffer_append(out, string + runStart, length - runStart);
+  byte_buffer_push(out, '\"');
+}
+
+/* How long string will be once write_escaped_json_string escapes it, including the quotes */
+static size_t escaped_json_string_length(const char *string, size_t length) {
+  size_t escapedLength = length + 2;
+  for (size_t i = 0; i < length; i++) {
+    unsigned char currentChar = (unsigned char)string[i];
+    if (currentChar == '\"' || currentChar == '\\' || currentChar == '\n' || currentChar == '\r' || currentChar == '\t' || currentChar == '\b' || currentChar == '\f') {
+      escapedLength += 1;
+    } else if (currentChar < 0x20) {
+      escapedLength += 5;
+    }
+  }
+  return escapedLength;
+}
+
+/* Big reads are split up into chunks, since some platforms can not do a single read over 2GB */
+#define SEAJSON_READ_CHUNK_SIZE ((size_t)64 * 1024 * 1024)
+
+/* The size of an open file in 64 bits (even where long, and so ftell, is 32) and when it was last modified in nanoseconds */
+static int get_file_identity(FILE *fp, uint64_t *size, int64_t *modified) {
+#ifdef _WIN32
+  struct _stat64 fileStat;
+  if (_fstat64(_fileno(fp), &fileStat) != 0) {
+    return 0;
+  }
+  *modified = (int64_t)fileStat.st_mtime * 1000000000;
+#else
+  struct stat fileStat;
+  if (fstat(fileno(fp), &fileStat) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  *modified = (int64_t)fileStat.st_mtimespec.tv_sec * 1000000000 + fileStat.st_mtimespec.tv_nsec;
+#elif defined(st_mtime)
+  /* st_mtim is POSIX 2008 (asked for at the top of the file), libcs that have it define st_mtime on top of it */
+  *modified = (int64_t)fileStat.st_mtim.tv_sec * 1000000000 + fileStat.st_mtim.tv_nsec;
+#else
+  *modified = (int64_t)fileStat.st_mtime * 1000000000;
+#endif
+#endif
+  *size = (uint64_t)fileStat.st_size;
+  return 1;
+}
+
+static int get_file_size(FILE *fp, uint64_t *size) {
+  int64_t modified;
+  return get_file_identity(fp, size, &modified);
+}
+
+/* Reads size bytes in chunks, feeding each one to index as it comes in if there is one */
+static int read_file_chunks(FILE *fp, char *buffer, uint64_t size, seajson_index *index) {
+  uint64_t bytesRead = 0;
+  while (bytesRead < size) {
+    size_t chunkSize = (size - bytesRead < SEAJSON_READ_CHUNK_SIZE) ? (size_t)(size - bytesRead) : SEAJSON_READ_CHUNK_SIZE;
+    size_t chunkRead = fread(buffer + bytesRead, 1, chunkSize, fp);
+    if (chunkRead == 0) {
+      return 0;
+    }
+    if (index) {
+      seajson_index_feed(index, buffer + bytesRead, chunkRead);
+    }
+    bytesRead += chunkRead;
+  }
+  return 1;
+}
+
+static seajson read_json_file(const char *restrict filename, seajson_index *index) {
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    fprintf(stderr,"SeaJSON Error: Cannot find file.\n");
+    exit(1);
+  }
+  uint64_t sz;
+  if (!get_file_size(fp, &sz) || sz >= SIZE_MAX) {
+    fclose(fp);
+    fprintf(stderr, "SeaJSON Error: Failed to get the size of the file.\n");
+    exit(1);
+  }
+  /* sz is now the file size */
+  char *json = new_document_buffer(sizeof(char) * (size_t)(sz + 1));
+  if (json == NULL) {
+    fclose(fp);
+    fprintf(stderr, "SeaJSON Error: Memory allocation failed.\n");
+    exit(1);
+  }
+  if (!read_file_chunks(fp, json, sz, index)) {
+    fclose(fp);
+    free_document(json);
+    fprintf(stderr, "SeaJSON Error: Failed to read the entire file.\n");
+    exit(1);
+  }
+  /* Null-terminate the string */
+  json[sz] = '\0';
+  /* Close the file pointer */
+  fclose(fp);
+  return json;
+}
+
+seajson init_json_from_file(const char *restrict filename) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_INIT_JSON_FROM_FILE);
+  use_document_allocator(NULL);
+  return read_json_file(filename, NULL);
+}
+
+seajson init_json_from_file_with_allocator(const char *filename, const seajson_allocator *allocator) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_INIT_JSON_FROM_FILE);
+  documentAllocator = *allocator;
+  usingDocumentAllocator = 1;
+  /* read_json_file puts the header in front of it as it allocates */
+  return read_json_file(filename, NULL);
+}
+
+void free_json(seajson json) {
+  /* Its allocator may be gone right after this, so nothing else can be left using it */
+  use_document_allocator(NULL);
+  free_document(json);
+  json = NULL;
+}
+
+char* get_string(seajson json, const char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_STRING);
+  use_document_allocator(json);
+  member_scanner scanner;
+  if (!find_top_level_member_terminated(json, value, &scanner)) {
+    SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_STRING, scanner.pos);
+    return NULL;
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_STRING, scanner.valueEnd);
+  if (json[scanner.valueStart] != '\"') {
+    return NULL;
+  }
+  /* Unescaping never makes it longer, so the escaped length is enough room */
+  size_t rawLength = scanner.valueEnd - scanner.valueStart - 2;
+  char* returnString = sea_malloc(sizeof(char) * (rawLength + 1));
+  if (returnString == NULL) {
+    return NULL;
+  }
+  if (unescape_json_string(json + scanner.valueStart + 1, rawLength, returnString, rawLength + 1) < 0) {
+    sea_free(returnString);
+    return NULL;
+  }
+  return returnString;
+}
+
+/* Negative values come back as their two's complement, cast the result to long for them */
+unsigned long get_int(seajson json, const char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_INT);
+  use_document_allocator(json);
+  member_scanner scanner;
+  if (!find_top_level_member_terminated(json, value, &scanner)) {
+    SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_INT, scanner.pos);
+    return 0;
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_INT, scanner.valueEnd);
+  json_number number;
+  if (scan_json_number(json, scanner.valueEnd, scanner.valueStart, &number) == SEAJSON_SCAN_FAILED) {
+    return 0;
+  }
+  return (unsigned long)number.integer;
+}
+
+seajson get_dictionary(seajson json, const char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_DICTIONARY);
+  use_document_allocator(json);
+  member_scanner scanner;
+  if (!find_top_level_member_terminated(json, value, &scanner)) {
+    SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_DICTIONARY, scanner.pos);
+    return NULL;
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_DICTIONARY, scanner.valueEnd);
+  if (json[scanner.valueStart] != '{') {
+    return NULL;
+  }
+  size_t dictionaryLength = scanner.valueEnd - scanner.valueStart;
+  char* returnString = sea_malloc(sizeof(char) * (dictionaryLength + 1));
+  if (returnString == NULL) {
+    return NULL;
+  }
+  memcpy(returnString, json + scanner.valueStart, dictionaryLength);
+  returnString[dictionaryLength] = '\0';
+  return adopt_document(returnString);
+}
+
+jarray get_array(seajson json, const char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_ARRAY);
+  use_document_allocator(json);
+  jarray jsonArray;
+  jsonArray.itemCount = 0;
+  jsonArray.arrayString = NULL;
+  /* Set isValid to 0 until it is found, since not finding it is an error and not a valid jarray */
+  jsonArray.isValid = 0;
+  member_scanner scanner;
+  if (!find_top_level_member_terminated(json, value, &scanner)) {
+    SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_ARRAY, scanner.pos);
+    return jsonArray;
+  }
+  if (json[scanner.valueStart] != '[') {
+    SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_ARRAY, scanner.valueEnd);
+    return jsonArray;
+  }
+  /* Count the items by skipping over them, then copy the array out in one go */
+  member_scanner items;
+  member_scanner_init(&items, json, scanner.valueEnd, scanner.valueStart);
+  long long itemCount = 0;
+  while (member_scanner_next(&items)) {
+    itemCount++;
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_ARRAY, scanner.valueEnd);
+  if (items.failed) {
+    return jsonArray;
+  }
+  size_t arrayLength = scanner.valueEnd - scanner.valueStart;
+  char* returnString = sea_malloc(sizeof(char) * (arrayLength + 1));
+  if (returnString == NULL) {
+    return jsonArray;
+  }
+  memcpy(returnString, json + scanner.valueStart, arrayLength);
+  returnString[arrayLength] = '\0';
+  jsonArray.itemCount = itemCount;
+  jsonArray.arrayString = adopt_document(returnString);
+  jsonArray.isValid = 1;
+  return jsonArray;
+}
+
+/* Finds where item index of array starts and how long it is without copying it */
+static int find_jarray_item(jarray array, long long index, size_t *itemStart, size_t *itemLength, const char *functionName, seajson_stat_function statFunction) {
+  (void)statFunction;
+  if (array.isValid == 0) {
+    fprintf(stderr, "SeaJSON Error: Non-valid jarray passed into %s.\n", functionName);
+    exit(1);
+  }
+  if (array.itemCount <= 0) {
+    fprintf(stderr, "SeaJSON Error: jarray with 0 or less items passed into %s.\n", functionName);
+    exit(1);
+  }
+  if (index < 0 || index >= array.itemCount) {
+    fprintf(stderr,"SeaJSON Error: Requested OOB index from jarray.\n");
+    exit(1);
+  }
+  char *arrayString = array.arrayString;
+  size_t arrStrLen = strlen(arrayString);
+  SEAJSON_STAT_FULL_SCAN(statFunction, arrStrLen);
+  long long itemIndex = 0;
+  size_t currentItemStart = 1;
+  int inception = 0;
+  int inceptionInString = 0;
+  /* Skip the first item since it will just be a [ */
+  for (size_t i = 1; i < arrStrLen; i++) {
+    char currentChar = arrayString[i];
+    if (inceptionInString == 0) {
+      if (currentChar == '{') {
+        inception++;
+      } else if (currentChar == '}') {
+        inception--;
+      } else if (currentChar == '\"') {
+        inceptionInString = 1;
+      } else if (currentChar == '[') {
+        inception++;
+      } else if (currentChar == ']') {
+        inception--;
+      }
+    } else {
+      /* We are currently reading chars in a string obj */
+      if (currentChar == '\"') {
+        /* If \" then cancel out */
+        if (arrayString[i-1] != '\\') {
+          inceptionInString = 0;
+        }
+      }
+    }
+    char futureChar = arrayString[i+1];
+    if (itemIndex == index) {
+      if ((futureChar == ',' && inception == 0 && inceptionInString == 0) || i == (arrStrLen-2)) {
+        *itemStart = currentItemStart;
+        *itemLength = i + 1 - currentItemStart;
+        SEAJSON_STAT_SCANNED(statFunction, i + 1);
+        return 1;
+      }
+    } else {
+      if (i == (arrStrLen-2)) {
+        fprintf(stderr, "SeaJSON Error: Failed to find item in array.\n");
+        exit(1);
+      }
+      if (futureChar == ',' && inception == 0 && inceptionInString == 0) {
+        i++;
+        itemIndex++;
+        currentItemStart = i + 1;
+      }
+    }
+  }
+  SEAJSON_STAT_SCANNED(statFunction, arrStrLen);
+  return 0;
+}
+
+/* This is a very WIP function, it does not allow JSONs such that are formatted with new lines or spaces in the slightest currently - either convert a JSON to not have whitespace and then do rest of the function or modify the function to behave differently. */
+char* get_item_from_jarray(jarray array, long long index) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_ITEM_FROM_JARRAY);
+  use_document_allocator(array.arrayString);
+  size_t itemStart;
+  size_t itemLength;
+  if (!find_jarray_item(array, index, &itemStart, &itemLength, "get_item_from_array", SEAJSON_STAT_GET_ITEM_FROM_JARRAY)) {
+    return NULL;
+  }
+  /* Only allocate what the item needs, not the whole array */
+  char* returnItem = sea_malloc(sizeof(char) * (itemLength + 1));
+  memcpy(returnItem, array.arrayString + itemStart, itemLength);
+  returnItem[itemLength] = '\0';
+  return returnItem;
+}
+
+void free_jarray(jarray array) {
+  free_json(array.arrayString);
+}
+
+seajson remove_whitespace_from_json(seajson json) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_REMOVE_WHITESPACE_FROM_JSON);
+  use_document_allocator(json);
+  size_t jsonSize = strlen(json);
+  seajson returnJson = sea_malloc(sizeof(char) * (jsonSize + 1));
+  if (returnJson == NULL) {
+    return NULL;
+  }
+  size_t returnJsonLength = copy_json_minified(json, jsonSize, returnJson);
+  returnJson[returnJsonLength] = '\0';
+  if (returnJsonLength < jsonSize) {
+    /* Give back what the whitespace took up */
+    seajson shrunk = sea_realloc(returnJson, returnJsonLength + 1);
+    if (shrunk) {
+      returnJson = shrunk;
+    }
+  }
+  return adopt_document(returnJson);
+}
+
+jarray remove_whitespace_from_jarray(jarray array) {
+  if (array.isValid == 0) {
+    fprintf(stderr, "SeaJSON Error: Non-valid jarray passed into removeWhitespaceFromJarray.\n");
+    exit(1);
+  }
+  jarray returnJarray;
+  returnJarray.itemCount = array.itemCount;
+  returnJarray.isValid = array.isValid;
+  returnJarray.arrayString = remove_whitespace_from_json(array.arrayString);
+  return returnJarray;
+}
+
+char* get_string_from_jarray(jarray array, long long index) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_STRING_FROM_JARRAY);
+  use_document_allocator(array.arrayString);
+  size_t itemStart;
+  size_t itemLength;
+  if (!find_jarray_item(array, index, &itemStart, &itemLength, "get_item_from_array", SEAJSON_STAT_GET_STRING_FROM_JARRAY)) {
+    return NULL;
+  }
+  const char *rawItem = array.arrayString + itemStart;
+  if (itemLength >= 2 && rawItem[0] == '\"' && rawItem[itemLength - 1] == '\"') {
+    /* Cut the beginning and ending " */
+    rawItem++;
+    itemLength -= 2;
+  }
+  /* One right sized allocation, no copy of the quoted item first */
+  char *substr = sea_malloc(sizeof(char) * (itemLength + 1));
+  memcpy(substr, rawItem, itemLength);
+  substr[itemLength] = '\0';
+  return substr;
+}
+
+int get_int_from_jarray(jarray array, long long index) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_INT_FROM_JARRAY);
+  use_document_allocator(array.arrayString);
+  size_t itemStart;
+  size_t itemLength;
+  if (!find_jarray_item(array, index, &itemStart, &itemLength, "get_item_from_array", SEAJSON_STAT_GET_INT_FROM_JARRAY)) {
+    return 0;
+  }
+  /* Parsed straight out of the array, no need to copy the item */
+  const char *rawItem = array.arrayString + itemStart;
+  int returnInt = 0;
+  int isNeg = 0;
+  if (rawItem[0] == '-') {
+    isNeg = 1;
+  }
+  for (size_t i = isNeg; i < itemLength; i++) {
+    char currentChar = rawItem[i];
+    returnInt *= 10;
+    returnInt += currentChar - '0';
+  }
+  if (isNeg) {
+    returnInt *= -1;
+  }
+  return returnInt;
+}
+
+jarray remove_item_of_jarray(jarray array, long long index) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_REMOVE_ITEM_OF_JARRAY);
+  use_document_allocator(array.arrayString);
+  if (array.isValid == 0) {
+    fprintf(stderr, "SeaJSON Error: Non-valid jarray passed into remove_item_of_jarray.\n");
+    exit(1);
+  }
+  if (array.itemCount <= 0) {
+    fprintf(stderr, "SeaJSON Error: jarray with 0 or less items passed into remove_item_of_jarray.\n");
+    exit(1);
+  }
+  if (index < 0 || index >= array.itemCount) {
+    fprintf(stderr,"SeaJSON Error: Requested OOB index from jarray (remove_item_of_jarray).\n");
+    exit(1);
+  }
+  char *arrayString = array.arrayString;
+  size_t arrStrLen = strlen(arrayString);
+  long long itemIndex = 0;
+  char* returnItem = sea_malloc(sizeof(char) * arrStrLen);
+  int returnItemIndex = 0;
+  int inception = 0;
+  int inceptionInString = 0;
+  /* Skip the first item since it will just be a [ */
+  for (size_t i = 0; i < arrStrLen; i++) {
+    char currentChar = arrayString[i];
+    if (inceptionInString == 0) {
+      if (currentChar == '{') {
+        inception++;
+      } else if (currentChar == '}') {
+        inception--;
+      } else if (currentChar == '\"') {
+        inceptionInString = 1;
+      } else if (currentChar == '[') {
+        inception++;
+      } else if (currentChar == ']') {
+        inception--;
+      }
+    } else {
+      /* We are currently reading chars in a string obj */
+      if (currentChar == '\"') {
+        /* If \" then cancel out */
+        if (arrayString[i-1] != '\\') {
+          inceptionInString = 0;
+        }
+      }
+    }
+    if (itemIndex != index) {
+      returnItem[returnItemIndex] = currentChar;
+      returnItemIndex++;
+    }
+    char futureChar = arrayString[i+1];
+    if (i == (strlen(arrayString)-2)) {
+      returnItem[returnItemIndex] = futureChar;
+      returnItem[returnItemIndex+1] = '\0';
+      jarray newJarray;
+      newJarray.itemCount = array.itemCount - 1;
+      newJarray.isValid = array.isValid;
+      newJarray.arrayString = adopt_document(returnItem);
+      return newJarray;
+    }
+    if (futureChar == ',' && inception == 1 && inceptionInString == 0) {
+      i++;
+      itemIndex++;
+      if (itemIndex != index) {
+        returnItem[returnItemIndex] = ',';
+        returnItemIndex++;
+      }
+    }
+  }
+  sea_free(returnItem);
+  printf("SeaJSON Error: remove_item_of_jarray has encounter a problem. Returning original jarray...\n");
+  return array;
+}
+
+jarray add_item_to_jarray(jarray array, char* item) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_ADD_ITEM_TO_JARRAY);
+  use_document_allocator(array.arrayString);
+  if (array.isValid == 0) {
+    fprintf(stderr, "SeaJSON Error: Non-valid jarray passed into add_item_to_jarray.\n");
+    exit(1);
+  }
+  char *arrayString = array.arrayString;
+  size_t arrStrLen = strlen(arrayString);
+  if (arrayString[arrStrLen - 1] == ']' && arrayString[0] == '[') {
+    size_t itemLen = strlen(item);
+    if (arrStrLen == 2) {
+      /* A blank jarray has been passed in */
+      char* returnItem = sea_malloc(sizeof(char) * (3 + itemLen));
+      returnItem[0] = '[';
+      /*
+      I was gonna do strncat(returnItem, item, strlen(item));
+      But for some reason that seems buggy
+      */
+      for (size_t i = 0; i < itemLen; i++) {
+        returnItem[i+1] = item[i];
+      }
+      returnItem[itemLen+1] = ']';
+      returnItem[itemLen+2] = '\0';
+      jarray newJarray;
+      newJarray.arrayString = adopt_document(returnItem);
+      newJarray.isValid = 1;
+      newJarray.itemCount = 1;
+      return newJarray;
+    } else {
+      char* returnItem = sea_malloc(sizeof(char) * (arrStrLen + strlen(item) + 2));
+      for (size_t i = 0; i < arrStrLen; i++) {
+        returnItem[i] = arrayString[i];
+      }
+      returnItem[arrStrLen-1] = ',';
+      for (size_t i = 0; i < itemLen; i++) {
+        returnItem[arrStrLen+i] = item[i];
+      }
+      returnItem[arrStrLen+itemLen] = ']';
+      returnItem[arrStrLen+itemLen+1] = '\0';
+      jarray newJarray;
+      newJarray.itemCount = array.itemCount + 1;
+      newJarray.arrayString = adopt_document(returnItem);
+      newJarray.isValid = 1;
+      return newJarray;
+    }
+  } else {
+    fprintf(stderr, "SeaJSON Error: Failed to find end of jarray (add_item_to_jarray).");
+    exit(1);
+  }
+  return array;
+}
+
+/* Returns the pos of the closing } of the root object (the last byte if there is none), needsComma is 0 when the object is empty */
+static size_t find_add_item_position(const char *json, size_t length, int *needsComma) {
+  size_t closePos = length;
+  while (closePos > 0 && is_json_whitespace(json[closePos - 1])) {
+    closePos--;
+  }
+  closePos = closePos ? closePos - 1 : 0;
+  size_t previous = closePos;
+  while (previous > 0 && is_json_whitespace(json[previous - 1])) {
+    previous--;
+  }
+  *needsComma = !(previous > 0 && json[previous - 1] == '{');
+  return closePos;
+}
+
+/*
+ * ONLY supports adding. Not setting.
+ * Use this in the case where you only
+ * need to add an item to a json, as it
+ * is faster than using set_string_seajson().
+ */
+seajson add_string_seajson(seajson json, char* key, char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_ADD_STRING_SEAJSON);
+  use_document_allocator(json);
+  size_t jsonLen = strlen(json);
+  size_t keyLen = strlen(key);
+  size_t valueLen = strlen(value);
+  seajson returnJson = sea_malloc(sizeof(char) * (jsonLen + keyLen + valueLen + 6));
+  for (size_t i = 0; i < jsonLen; i++) {
+    returnJson[i] = json[i];
+  }
+  returnJson[jsonLen - 1] = ',';
+  returnJson[jsonLen] = '\"';
+  for (size_t i = 1; i <= keyLen; i++) {
+    returnJson[i+jsonLen] = key[i-1];
+  }
+  returnJson[jsonLen+keyLen+1] = '\"';
+  returnJson[jsonLen+keyLen+2] = ':';
+  returnJson[jsonLen+keyLen+3] = '\"';
+  for (size_t i = 0; i < valueLen; i++) {
+    returnJson[jsonLen+keyLen+4+i] = value[i];
+  }
+  returnJson[jsonLen+keyLen+valueLen+4] = '\"';
+  returnJson[jsonLen+keyLen+valueLen+5] = '}';
+  returnJson[jsonLen+keyLen+valueLen+6] = '\0';
+  return adopt_document(returnJson);
+}
+
+/*
+ * ONLY supports adding. Not setting.
+ * Use this in the case where you only
+ * need to add an item to a json, as it
+ * is faster than using set_item_seajson().
+ */
+seajson add_item_seajson(seajson json, char* key, char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_ADD_ITEM_SEAJSON);
+  use_document_allocator(json);
+  size_t jsonLen = strlen(json);
+  size_t keyLen = strlen(key);
+  size_t valueLen = strlen(value);
+  int needsComma;
+  size_t closePos = find_add_item_position(json, jsonLen, &needsComma);
+  seajson returnJson = sea_malloc(sizeof(char) * (jsonLen + keyLen + valueLen + needsComma + 4));
+  if (returnJson == NULL) {
+    return NULL;
+  }
+  size_t outPos = closePos;
+  memcpy(returnJson, json, closePos);
+  if (needsComma) {
+    returnJson[outPos++] = ',';
+  }
+  returnJson[outPos++] = '\"';
+  memcpy(returnJson + outPos, key, keyLen);
+  outPos += keyLen;
+  returnJson[outPos++] = '\"';
+  returnJson[outPos++] = ':';
+  memcpy(returnJson + outPos, value, valueLen);
+  outPos += valueLen;
+  /* The closing } and whatever comes after it */
+  memcpy(returnJson + outPos, json + closePos, jsonLen - closePos + 1);
+  return adopt_document(returnJson);
+}
+
+/* Returns the pos of the first char of the string value of key, or -1 */
+long long get_pos_string_seajson(seajson json, const char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_POS_STRING_SEAJSON);
+  use_document_allocator(json);
+  member_scanner scanner;
+  if (!find_top_level_member_terminated(json, value, &scanner)) {
+    SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_POS_STRING_SEAJSON, scanner.pos);
+    return -1;
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_POS_STRING_SEAJSON, scanner.valueEnd);
+  if (json[scanner.valueStart] != '\"') {
+    return -1;
+  }
+  if (scanner.valueEnd - scanner.valueStart == 2) {
+    /* We are on the ending " so the string is empty */
+    fprintf(stderr,"SeaJSON Error: Found end of string (get_pos_string_seajson).\n");
+    return 0;
+  }
+  return (long long)(scanner.valueStart + 1);
+}
+
+/* Returns the pos of the closing " of key, or -1 */
+long long get_pos_item_seajson(seajson json, const char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_POS_ITEM_SEAJSON);
+  use_document_allocator(json);
+  member_scanner scanner;
+  if (!find_top_level_member_terminated(json, value, &scanner)) {
+    SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_POS_ITEM_SEAJSON, scanner.pos);
+    return -1;
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_POS_ITEM_SEAJSON, scanner.keyEnd + 1);
+  return (long long)scanner.keyEnd;
+}
+
+/* The bytes an edit changed, json[start, oldEnd) became result[start, newEnd) */
+typedef struct {
+  size_t start;
+  size_t oldEnd;
+  size_t newEnd;
+} edit_range;
+
+static seajson apply_patch_ops(seajson json, const seajson_index *index, const seajson_patch_op *ops, size_t opCount, edit_range *changed, int *error, size_t *appliedCount);
+
+/* Makes the JSON Pointer for a top level key, escaping ~ and / */
+static char *pointer_for_key(const char *key) {
+  size_t keyLength = strlen(key);
+  char *path = sea_malloc(keyLength * 2 + 2);
+  if (path == NULL) {
+    return NULL;
+  }
+  size_t pathLength = 0;
+  path[pathLength++] = '/';
+  for (size_t i = 0; i < keyLength; i++) {
+    if (key[i] == '~') {
+      path[pathLength++] = '~';
+      path[pathLength++] = '0';
+    } else if (key[i] == '/') {
+      path[pathLength++] = '~';
+      path[pathLength++] = '1';
+    } else {
+      path[pathLength++] = key[i];
+    }
+  }
+  path[pathLength] = '\0';
+  return path;
+}
+
+seajson remove_item_seajson(seajson json, const char *key) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_REMOVE_ITEM_SEAJSON);
+  use_document_allocator(json);
+  seajson_patch_op op;
+  op.type = SEAJSON_PATCH_REMOVE;
+  op.path = pointer_for_key(key);
+  op.value = NULL;
+  if (op.path == NULL) {
+    fprintf(stderr, "SeaJSON Error: remove_item_seajson could not allocate\n");
+    return NULL;
+  }
+  int error;
+  seajson returnJson = apply_patch_ops(json, NULL, &op, 1, NULL, &error, NULL);
+  sea_free(op.path);
+  if (returnJson == NULL) {
+    /* key not in remove_item_seajson */
+    /* TODO: Allocate new json and return it, for now just return our pointer */
+    return json;
+  }
+  return adopt_document(returnJson);
 }
 
 seajson remove_string_seajson(seajson json, const char *key) {
-  int stringPos = get_pos_string_seajson(json,key);
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_REMOVE_STRING_SEAJSON);
+  use_document_allocator(json);
+  if (get_pos_string_seajson(json, key) == -1) {
+    /* key not in remove_string_seajson */
+    /* TODO: Allocate new json and return it, for now just return our pointer */
+    return json;
+  }
+  return remove_item_seajson(json, key);
+}
+
+seajson set_item_seajson(seajson json, const char *key, const char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_SET_ITEM_SEAJSON);
+  use_document_allocator(json);
+  /* add replaces the value if the key is already there, whatever type of value it is */
+  seajson_patch_op op;
+  op.type = SEAJSON_PATCH_ADD;
+  op.path = pointer_for_key(key);
+  op.value = (char *)value;
+  if (op.path == NULL) {
+    fprintf(stderr, "SeaJSON Error: set_item_seajson could not allocate\n");
+    return NULL;
+  }
+  int error;
+  seajson returnJson = apply_patch_ops(json, NULL, &op, 1, NULL, &error, NULL);
+  sea_free(op.path);
+  if (returnJson == NULL) {
+    fprintf(stderr, "SeaJSON Error: set_item_seajson json is not an object\n");
+    return NULL;
+  }
+  return adopt_document(returnJson);
+}
+
+#if 0
+
+/* from a failed attempt to make set_item_seajson, I made a function which renames a key... */
+seajson set_item_seajson(seajson json, const char *key, const char *value) {
+  int stringPos = get_pos_item_seajson(json,key); /* TODO: This ONLY works on strings !!! */
   if (stringPos != -1) {
     unsigned long keyLen = strlen(key);
+    unsigned long valueLen = strlen(value);
     unsigned long jsonLen = strlen(json);
-    unsigned long offset = (keyLen + 5);
-    stringPos -= offset;
-    seajson returnJson = malloc(sizeof(char) * (jsonLen - keyLen - 5));
+    unsigned long offset = 0;
+    seajson returnJson = sea_malloc(sizeof(char) * (jsonLen + keyLen + valueLen + 6));
     for (int i = 0; i < stringPos; i++) {
       returnJson[i] = json[i];
     }
-    /* TODO: Handle if the ending " cannot be found */
-    int inception = 0;
-    int inceptionInString = 0;
-    for (int i = stringPos + offset; i < jsonLen; i++) {
-      if (json[i] == '\"') {
-        if (json[i-1] != '\\') {
-          if (inception == 0) {
-            offset++;
-            break;
-          } else {
-            inceptionInString = !inceptionInString;
-          }
-        }
-      } else if (json[i] == '{') {
-        if (!inceptionInString) {
-          inception++;
-        }
-      } else if (json[i] == '}') {
-        if (!inceptionInString) {
-          inception--;
-        }
-      } else if (json[i] == '[') {
-        if (!inceptionInString) {
-          inception++;
-        }
-      } else if (json[i] == ']') {
-        if (!inceptionInString) {
-          inception--;
-        }
+    /* TODO: Handle if the ending " cannot be found */
+    int inception = 0;
+    int inceptionInString = 0;
+    for (int i = stringPos; i < jsonLen; i++) {
+      if (json[i] == '\"') {
+        if (json[i-1] != '\\') {
+          if (inception == 0) {
+            offset++;
+            break;
+          } else {
+            inceptionInString = !inceptionInString;
+          }
+        }
+      } else if (json[i] == '{') {
+        if (!inceptionInString) {
+          inception++;
+        }
+      } else if (json[i] == '}') {
+        if (!inceptionInString) {
+          inception--;
+        }
+      } else if (json[i] == '[') {
+        if (!inceptionInString) {
+          inception++;
+        }
+      } else if (json[i] == ']') {
+        if (!inceptionInString) {
+          inception--;
+        }
+      } else if (json[i] == ',') {
+        if (!inceptionInString) {
+          if (inception == 0) {
+            offset++;
+            break;
+          }
+        }
+      }
+      offset++;
+    }
+    /* Copy value to returnJson */
+    for (int i = 0; i < valueLen; i++) {
+      returnJson[i+stringPos] = value[i];
+    }
+    /* Copy rest of json */
+    for (int i = stringPos + offset; i < jsonLen; i++) {
+      returnJson[(i-offset)+valueLen] = json[i];
+    }
+    /* TODO: NULL terminate returnJson */
+    return returnJson;
+  } else {
+    /* key not in remove_string_seajson, call add_item_seajson */
+    return add_item_seajson(json, key, value);
+  }
+}
+#endif
+
+jarray new_jarray(void) {
+  jarray returnJarray;
+  returnJarray.arrayString = "[]";
+  returnJarray.itemCount = 0;
+  returnJarray.isValid = 1;
+  return returnJarray;
+}
+
+/* SeaJSON Binary */
+
+/*
+ * File layout: "SJB1", u32 version, u64 size of the root value, then the root value.
+ * A value is a one byte seajson_type tag followed by:
+ *  INT: zigzag varint
+ *  DOUBLE: 8 byte little endian IEEE 754
+ *  STRING: varint length, the unescaped bytes, then a NULL terminator
+ *  ARRAY/OBJECT: varint count, varint byte size of the items, then the items
+ *    (object items are a key, stored like a string without the tag, and a value)
+ *  NULL/FALSE/TRUE: nothing
+ * All varints are LEB128.
+ */
+
+#define SEAJSON_BINARY_VERSION 1
+#define SEAJSON_BINARY_HEADER_SIZE 16
+#define SEAJSON_BINARY_MAX_DEPTH 1024
+
+static size_t binary_encode_varint(unsigned long long value, unsigned char *out) {
+  size_t count = 0;
+  while (value >= 0x80) {
+    out[count++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  out[count++] = (unsigned char)value;
+  return count;
+}
+
+static void binary_write_varint(byte_buffer *out, unsigned long long value) {
+  unsigned char bytes[10];
+  byte_buffer_append(out, bytes, binary_encode_varint(value, bytes));
+}
+
+static int binary_read_varint(const unsigned char **cursor, const unsigned char *end, unsigned long long *value) {
+  const unsigned char *bytes = *cursor;
+  unsigned long long result = 0;
+  for (int shift = 0; bytes < end && shift < 64; shift += 7) {
+    unsigned char byte = *bytes++;
+    result |= (unsigned long long)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *cursor = bytes;
+      *value = result;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void binary_write_u64(unsigned char *out, unsigned long long value) {
+  for (int i = 0; i < 8; i++) {
+    out[i] = (unsigned char)(value >> (i * 8));
+  }
+}
+
+static unsigned long long binary_read_u64(const unsigned char *bytes) {
+  unsigned long long value = 0;
+  for (int i = 0; i < 8; i++) {
+    value |= (unsigned long long)bytes[i] << (i * 8);
+  }
+  return value;
+}
+
+static void binary_write_header(unsigned char *out, unsigned long long rootSize) {
+  memcpy(out, "SJB1", 4);
+  out[4] = SEAJSON_BINARY_VERSION;
+  out[5] = 0;
+  out[6] = 0;
+  out[7] = 0;
+  binary_write_u64(out + 8, rootSize);
+}
+
+typedef struct {
+  const char *json;
+  size_t length;
+  size_t pos;
+  int depth;
+} binary_parser;
+
+static int binary_emit_value(binary_parser *parser, byte_buffer *out);
+
+/* parser->pos should be on the opening ", writes varint length + unescaped string + NULL terminator */
+static int binary_emit_string_body(binary_parser *parser, byte_buffer *out) {
+  size_t start = parser->pos + 1;
+  size_t end = find_json_string_end(parser->json, parser->length, start);
+  if (end >= parser->length) {
+    return 0;
+  }
+  size_t rawLength = end - start;
+  if (!byte_buffer_reserve(out, rawLength + 1)) {
+    return 0;
+  }
+  /* Unescape straight into the tape, then put the length in front of it */
+  size_t bodyPos = out->length;
+  long long bodyLength = unescape_json_string(parser->json + start, rawLength, (char *)out->data + bodyPos, rawLength + 1);
+  if (bodyLength < 0) {
+    return 0;
+  }
+  out->length += bodyLength + 1;
+  unsigned char lengthBytes[10];
+  byte_buffer_insert(out, bodyPos, lengthBytes, binary_encode_varint(bodyLength, lengthBytes));
+  parser->pos = end + 1;
+  return !out->failed;
+}
+
+static int binary_emit_container(binary_parser *parser, byte_buffer *out, int isObject) {
+  const char *json = parser->json;
+  char closer = isObject ? '}' : ']';
+  if (++parser->depth > SEAJSON_BINARY_MAX_DEPTH) {
+    return 0;
+  }
+  byte_buffer_push(out, isObject ? SEAJSON_TYPE_OBJECT : SEAJSON_TYPE_ARRAY);
+  size_t contentStart = out->length;
+  unsigned long long count = 0;
+  parser->pos = skip_json_whitespace(json, parser->length, parser->pos + 1);
+  if (parser->pos < parser->length && json[parser->pos] == closer) {
+    parser->pos++;
+  } else {
+    for (;;) {
+      if (isObject) {
+        parser->pos = skip_json_whitespace(json, parser->length, parser->pos);
+        if (parser->pos >= parser->length || json[parser->pos] != '\"') {
+          return 0;
+        }
+        if (!binary_emit_string_body(parser, out)) {
+          return 0;
+        }
+        parser->pos = skip_json_whitespace(json, parser->length, parser->pos);
+        if (parser->pos >= parser->length || json[parser->pos] != ':') {
+          return 0;
+        }
+        parser->pos++;
+      }
+      if (!binary_emit_value(parser, out)) {
+        return 0;
+      }
+      count++;
+      parser->pos = skip_json_whitespace(json, parser->length, parser->pos);
+      if (parser->pos >= parser->length) {
+        return 0;
+      }
+      if (json[parser->pos] == ',') {
+        parser->pos++;
+      } else if (json[parser->pos] == closer) {
+        parser->pos++;
+        break;
+      } else {
+        return 0;
+      }
+    }
+  }
+  unsigned char header[20];
+  size_t headerLength = binary_encode_varint(count, header);
+  headerLength += binary_encode_varint(out->length - contentStart, header + headerLength);
+  byte_buffer_insert(out, contentStart, header, headerLength);
+  parser->depth--;
+  return !out->failed;
+}
+
+static int binary_emit_number(binary_parser *parser, byte_buffer *out) {
+  json_number number;
+  size_t end = scan_json_number(parser->json, parser->length, parser->pos, &number);
+  if (end == SEAJSON_SCAN_FAILED) {
+    return 0;
+  }
+  if (number.isDouble) {
+    unsigned long long bits;
+    unsigned char bytes[8];
+    memcpy(&bits, &number.number, sizeof(bits));
+    binary_write_u64(bytes, bits);
+    byte_buffer_push(out, SEAJSON_TYPE_DOUBLE);
+    byte_buffer_append(out, bytes, 8);
+  } else {
+    byte_buffer_push(out, SEAJSON_TYPE_INT);
+    binary_write_varint(out, ((unsigned long long)number.integer << 1) ^ (unsigned long long)(number.integer >> 63));
+  }
+  parser->pos = end;
+  return !out->failed;
+}
+
+static int binary_emit_literal(binary_parser *parser, byte_buffer *out, const char *literal, seajson_type type) {
+  size_t literalLength = strlen(literal);
+  if (parser->pos + literalLength > parser->length || strncmp(parser->json + parser->pos, literal, literalLength) != 0) {
+    return 0;
+  }
+  byte_buffer_push(out, type);
+  parser->pos += literalLength;
+  return !out->failed;
+}
+
+static int binary_emit_value(binary_parser *parser, byte_buffer *out) {
+  parser->pos = skip_json_whitespace(parser->json, parser->length, parser->pos);
+  if (parser->pos >= parser->length) {
+    return 0;
+  }
+  switch (parser->json[parser->pos]) {
+    case '{':
+      return binary_emit_container(parser, out, 1);
+    case '[':
+      return binary_emit_container(parser, out, 0);
+    case '\"':
+      byte_buffer_push(out, SEAJSON_TYPE_STRING);
+      return binary_emit_string_body(parser, out);
+    case 't':
+      return binary_emit_literal(parser, out, "true", SEAJSON_TYPE_TRUE);
+    case 'f':
+      return binary_emit_literal(parser, out, "false", SEAJSON_TYPE_FALSE);
+    case 'n':
+      return binary_emit_literal(parser, out, "null", SEAJSON_TYPE_NULL);
+    default:
+      return binary_emit_number(parser, out);
+  }
+}
+
+static seajson_binary invalid_binary(void) {
+  seajson_binary binary;
+  binary.value = NULL;
+  binary.end = NULL;
+  binary.mapping = NULL;
+  binary.mappingSize = 0;
+  binary.isMapped = 0;
+  /* Set isValid to 0 since this is an error and not a valid seajson_binary */
+  binary.isValid = 0;
+  return binary;
+}
+
+/* Returns the pointer right after the value, or NULL if the value is broken */
+static const unsigned char *binary_skip_value(const unsigned char *value, const unsigned char *end) {
+  if (value == NULL || value >= end) {
+    return NULL;
+  }
+  unsigned char tag = *value++;
+  unsigned long long number;
+  unsigned long long size;
+  switch (tag) {
+    case SEAJSON_TYPE_NULL:
+    case SEAJSON_TYPE_FALSE:
+    case SEAJSON_TYPE_TRUE:
+      return value;
+    case SEAJSON_TYPE_INT:
+      return binary_read_varint(&value, end, &number) ? value : NULL;
+    case SEAJSON_TYPE_DOUBLE:
+      return (end - value >= 8) ? value + 8 : NULL;
+    case SEAJSON_TYPE_STRING:
+      /* The NULL terminator has to be there too, or a corrupt file would have callers read past it */
+      if (!binary_read_varint(&value, end, &size) || size >= (unsigned long long)(end - value) || value[size] != '\0') {
+        return NULL;
+      }
+      return value + size + 1;
+    case SEAJSON_TYPE_ARRAY:
+    case SEAJSON_TYPE_OBJECT:
+      if (!binary_read_varint(&value, end, &number) || !binary_read_varint(&value, end, &size) || size > (unsigned long long)(end - value)) {
+        return NULL;
+      }
+      return value + size;
+    default:
+      return NULL;
+  }
+}
+
+/* Returns the first item of an array/object and fills in count and contentEnd, or NULL if binary is not a container */
+static const unsigned char *binary_container_items(seajson_binary binary, seajson_type type, unsigned long long *count, const unsigned char **contentEnd) {
+  if (!binary.isValid || binary.value >= binary.end || *binary.value != type) {
+    return NULL;
+  }
+  const unsigned char *cursor = binary.value + 1;
+  unsigned long long size;
+  if (!binary_read_varint(&cursor, binary.end, count) || !binary_read_varint(&cursor, binary.end, &size) || size > (unsigned long long)(binary.end - cursor)) {
+    return NULL;
+  }
+  *contentEnd = cursor + size;
+  return cursor;
+}
+
+static seajson_binary binary_view(const unsigned char *value, const unsigned char *end) {
+  const unsigned char *valueEnd = binary_skip_value(value, end);
+  if (valueEnd == NULL) {
+    return invalid_binary();
+  }
+  seajson_binary view = invalid_binary();
+  view.value = value;
+  view.end = valueEnd;
+  view.isValid = 1;
+  return view;
+}
+
+seajson_binary seajson_to_binary(seajson json) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_SEAJSON_TO_BINARY);
+  use_document_allocator(NULL);
+  binary_parser parser;
+  parser.json = json;
+  parser.length = strlen(json);
+  parser.pos = 0;
+  parser.depth = 0;
+  byte_buffer out = {NULL, 0, 0, 0};
+  /* Binary is usually smaller than the text so this is normally the only allocation */
+  byte_buffer_reserve(&out, SEAJSON_BINARY_HEADER_SIZE + parser.length);
+  out.length = SEAJSON_BINARY_HEADER_SIZE;
+  if (!binary_emit_value(&parser, &out) || skip_json_whitespace(json, parser.length, parser.pos) != parser.length || out.failed) {
+    sea_free(out.data);
+    fprintf(stderr, "SeaJSON Error: Failed to parse json (seajson_to_binary).\n");
+    return invalid_binary();
+  }
+  binary_write_header(out.data, out.length - SEAJSON_BINARY_HEADER_SIZE);
+  seajson_binary binary = invalid_binary();
+  binary.mapping = out.data;
+  binary.mappingSize = out.length;
+  binary.value = out.data + SEAJSON_BINARY_HEADER_SIZE;
+  binary.end = out.data + out.length;
+  binary.isValid = 1;
+  return binary;
+}
+
+static const unsigned char *binary_write_text(const unsigned char *value, const unsigned char *end, byte_buffer *out) {
+  const unsigned char *cursor = value + 1;
+  unsigned long long number;
+  unsigned long long count;
+  switch (*value) {
+    case SEAJSON_TYPE_NULL:
+      byte_buffer_append(out, "null", 4);
+      return cursor;
+    case SEAJSON_TYPE_FALSE:
+      byte_buffer_append(out, "false", 5);
+      return cursor;
+    case SEAJSON_TYPE_TRUE:
+      byte_buffer_append(out, "true", 4);
+      return cursor;
+    case SEAJSON_TYPE_INT: {
+      if (!binary_read_varint(&cursor, end, &number)) {
+        return NULL;
+      }
+      char digits[24];
+      long long decoded = (long long)(number >> 1) ^ -(long long)(number & 1);
+      byte_buffer_append(out, digits, snprintf(digits, sizeof(digits), "%lld", decoded));
+      return cursor;
+    }
+    case SEAJSON_TYPE_DOUBLE: {
+      if (end - cursor < 8) {
+        return NULL;
+      }
+      double decoded;
+      number = binary_read_u64(cursor);
+      memcpy(&decoded, &number, sizeof(decoded));
+      char digits[32];
+      int digitCount = snprintf(digits, sizeof(digits), "%.17g", decoded);
+      if (strpbrk(digits, "inf") != NULL) {
+        /* JSON has no inf/nan */
+        byte_buffer_append(out, "null", 4);
+      } else {
+        byte_buffer_append(out, digits, digitCount);
+        if (strpbrk(digits, ".e") == NULL) {
+          /* Keep it a double if it gets converted back */
+          byte_buffer_append(out, ".0", 2);
+        }
+      }
+      return cursor + 8;
+    }
+    case SEAJSON_TYPE_STRING:
+      if (!binary_read_varint(&cursor, end, &number) || number >= (unsigned long long)(end - cursor)) {
+        return NULL;
+      }
+      write_escaped_json_string(out, (const char *)cursor, number);
+      return cursor + number + 1;
+    case SEAJSON_TYPE_ARRAY:
+    case SEAJSON_TYPE_OBJECT: {
+      int isObject = (*value == SEAJSON_TYPE_OBJECT);
+      if (!binary_read_varint(&cursor, end, &count) || !binary_read_varint(&cursor, end, &number) || number > (unsigned long long)(end - cursor)) {
+        return NULL;
+      }
+      const unsigned char *contentEnd = cursor + number;
+      byte_buffer_push(out, isObject ? '{' : '[');
+      for (unsigned long long i = 0; i < count; i++) {
+        if (i) {
+          byte_buffer_push(out, ',');
+        }
+        if (isObject) {
+          unsigned long long keyLength;
+          if (!binary_read_varint(&cursor, contentEnd, &keyLength) || keyLength >= (unsigned long long)(contentEnd - cursor)) {
+            return NULL;
+          }
+          write_escaped_json_string(out, (const char *)cursor, keyLength);
+          byte_buffer_push(out, ':');
+          cursor += keyLength + 1;
+        }
+        if (cursor >= contentEnd) {
+          return NULL;
+        }
+        cursor = binary_write_text(cursor, contentEnd, out);
+        if (cursor == NULL) {
+          return NULL;
+        }
+      }
+      byte_buffer_push(out, isObject ? '}' : ']');
+      return contentEnd;
+    }
+    default:
+      return NULL;
+  }
+}
+
+seajson binary_to_seajson(seajson_binary binary) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_BINARY_TO_SEAJSON);
+  use_document_allocator(NULL);
+  if (!binary.isValid) {
+    fprintf(stderr, "SeaJSON Error: Non-valid seajson_binary passed into binary_to_seajson.\n");
+    return NULL;
+  }
+  byte_buffer out = {NULL, 0, 0, 0};
+  byte_buffer_reserve(&out, (binary.end - binary.value) + 1);
+  if (binary_write_text(binary.value, binary.end, &out) == NULL) {
+    sea_free(out.data);
+    fprintf(stderr, "SeaJSON Error: Corrupted seajson_binary passed into binary_to_seajson.\n");
+    return NULL;
+  }
+  byte_buffer_push(&out, '\0');
+  if (out.failed) {
+    sea_free(out.data);
+    fprintf(stderr, "SeaJSON Error: Memory allocation failed.\n");
+    return NULL;
+  }
+  return (seajson)out.data;
+}
+
+int write_binary_to_file(seajson_binary binary, const char *filename) {
+  if (!binary.isValid) {
+    fprintf(stderr, "SeaJSON Error: Non-valid seajson_binary passed into write_binary_to_file.\n");
+    return -1;
+  }
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    fprintf(stderr, "SeaJSON Error: Cannot open file for writing.\n");
+    return -1;
+  }
+  unsigned char header[SEAJSON_BINARY_HEADER_SIZE];
+  size_t rootSize = binary.end - binary.value;
+  binary_write_header(header, rootSize);
+  int failed = (fwrite(header, 1, sizeof(header), fp) != sizeof(header));
+  failed |= (fwrite(binary.value, 1, rootSize, fp) != rootSize);
+  failed |= (fclose(fp) != 0);
+  return failed ? -1 : 0;
+}
+
+/* Maps the file when possible so loading is just the mmap, values are then read straight out of the page cache */
+seajson_binary init_binary_from_file(const char *filename) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_INIT_BINARY_FROM_FILE);
+  use_document_allocator(NULL);
+  seajson_binary binary = invalid_binary();
+#ifndef _WIN32
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr,"SeaJSON Error: Cannot find file.\n");
+    return binary;
+  }
+  struct stat fileInfo;
+  if (fstat(fd, &fileInfo) != 0 || fileInfo.st_size < SEAJSON_BINARY_HEADER_SIZE) {
+    close(fd);
+    fprintf(stderr, "SeaJSON Error: File is not SeaJSON binary.\n");
+    return binary;
+  }
+  size_t size = (size_t)fileInfo.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    fprintf(stderr, "SeaJSON Error: Failed to map file.\n");
+    return binary;
+  }
+  binary.isMapped = 1;
+#else
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    fprintf(stderr,"SeaJSON Error: Cannot find file.\n");
+    return binary;
+  }
+  uint64_t sz;
+  if (!get_file_size(fp, &sz) || sz < SEAJSON_BINARY_HEADER_SIZE || sz > SIZE_MAX) {
+    fclose(fp);
+    fprintf(stderr, "SeaJSON Error: File is not SeaJSON binary.\n");
+    return binary;
+  }
+  size_t size = (size_t)sz;
+  void *mapping = sea_malloc(size);
+  if (mapping == NULL || !read_file_chunks(fp, mapping, size, NULL)) {
+    fclose(fp);
+    sea_free(mapping);
+    fprintf(stderr, "SeaJSON Error: Failed to read the entire file.\n");
+    return binary;
+  }
+  fclose(fp);
+#endif
+  binary.mapping = mapping;
+  binary.mappingSize = size;
+  const unsigned char *bytes = mapping;
+  unsigned long long rootSize = binary_read_u64(bytes + 8);
+  if (memcmp(bytes, "SJB1", 4) != 0 || bytes[4] != SEAJSON_BINARY_VERSION || rootSize > size - SEAJSON_BINARY_HEADER_SIZE) {
+    fprintf(stderr, "SeaJSON Error: File is not SeaJSON binary.\n");
+    free_binary(binary);
+    return invalid_binary();
+  }
+  binary.value = bytes + SEAJSON_BINARY_HEADER_SIZE;
+  binary.end = binary.value + rootSize;
+  binary.isValid = 1;
+  return binary;
+}
+
+void free_binary(seajson_binary binary) {
+  if (binary.mapping == NULL) {
+    /* Views do not own anything */
+    return;
+  }
+  use_document_allocator(NULL);
+#ifndef _WIN32
+  if (binary.isMapped) {
+    munmap(binary.mapping, binary.mappingSize);
+    return;
+  }
+#endif
+  sea_free(binary.mapping);
+}
+
+seajson_type get_type_of_binary(seajson_binary binary) {
+  if (!binary.isValid || binary.value >= binary.end) {
+    return SEAJSON_TYPE_INVALID;
+  }
+  return (seajson_type)*binary.value;
+}
+
+seajson_binary get_value_from_binary(seajson_binary binary, const char *key) {
+  unsigned long long count;
+  const unsigned char *contentEnd;
+  const unsigned char *cursor = binary_container_items(binary, SEAJSON_TYPE_OBJECT, &count, &contentEnd);
+  if (cursor == NULL) {
+    return invalid_binary();
+  }
+  size_t keyLength = strlen(key);
+  for (unsigned long long i = 0; i < count; i++) {
+    unsigned long long memberKeyLength;
+    if (!binary_read_varint(&cursor, contentEnd, &memberKeyLength) || memberKeyLength >= (unsigned long long)(contentEnd - cursor)) {
+      return invalid_binary();
+    }
+    const unsigned char *memberKey = cursor;
+    cursor += memberKeyLength + 1;
+    if (memberKeyLength == keyLength && memcmp(memberKey, key, keyLength) == 0) {
+      return binary_view(cursor, contentEnd);
+    }
+    cursor = binary_skip_value(cursor, contentEnd);
+    if (cursor == NULL) {
+      return invalid_binary();
+    }
+  }
+  return invalid_binary();
+}
+
+const char* get_string_from_binary(seajson_binary binary, const char *key) {
+  return binary_as_string(get_value_from_binary(binary, key));
+}
+
+long long get_int_from_binary(seajson_binary binary, const char *key) {
+  return binary_as_int(get_value_from_binary(binary, key));
+}
+
+double get_double_from_binary(seajson_binary binary, const char *key) {
+  return binary_as_double(get_value_from_binary(binary, key));
+}
+
+size_t get_count_of_binary(seajson_binary binary) {
+  unsigned long long count;
+  const unsigned char *contentEnd;
+  if (binary_container_items(binary, SEAJSON_TYPE_ARRAY, &count, &contentEnd) != NULL || binary_container_items(binary, SEAJSON_TYPE_OBJECT, &count, &contentEnd) != NULL) {
+    return (size_t)count;
+  }
+  return 0;
+}
+
+seajson_binary get_item_from_binary(seajson_binary binary, size_t index) {
+  unsigned long long count;
+  const unsigned char *contentEnd;
+  const unsigned char *cursor = binary_container_items(binary, SEAJSON_TYPE_ARRAY, &count, &contentEnd);
+  if (cursor == NULL || index >= count) {
+    return invalid_binary();
+  }
+  /* Arrays and objects know their size, so skipping over them is cheap */
+  for (size_t i = 0; i < index && cursor != NULL; i++) {
+    cursor = binary_skip_value(cursor, contentEnd);
+  }
+  return binary_view(cursor, contentEnd);
+}
+
+const char* binary_as_string(seajson_binary binary) {
+  if (get_type_of_binary(binary) != SEAJSON_TYPE_STRING) {
+    return NULL;
+  }
+  const unsigned char *cursor = binary.value + 1;
+  unsigned long long length;
+  /* Strings are handed out as is, so they have to end with their NULL terminator inside of the data */
+  if (!binary_read_varint(&cursor, binary.end, &length) || length >= (unsigned long long)(binary.end - cursor) || cursor[length] != '\0') {
+    return NULL;
+  }
+  return (const char *)cursor;
+}
+
+long long binary_as_int(seajson_binary binary) {
+  const unsigned char *cursor = binary.value + 1;
+  unsigned long long number;
+  switch (get_type_of_binary(binary)) {
+    case SEAJSON_TYPE_INT:
+      if (!binary_read_varint(&cursor, binary.end, &number)) {
+        return 0;
+      }
+      return (long long)(number >> 1) ^ -(long long)(number & 1);
+    case SEAJSON_TYPE_DOUBLE:
+      return (long long)binary_as_double(binary);
+    case SEAJSON_TYPE_TRUE:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+double binary_as_double(seajson_binary binary) {
+  switch (get_type_of_binary(binary)) {
+    case SEAJSON_TYPE_DOUBLE: {
+      if (binary.end - binary.value < 9) {
+        return 0;
+      }
+      unsigned long long bits = binary_read_u64(binary.value + 1);
+      double number;
+      memcpy(&number, &bits, sizeof(number));
+      return number;
+    }
+    case SEAJSON_TYPE_INT:
+    case SEAJSON_TYPE_TRUE:
+      return (double)binary_as_int(binary);
+    default:
+      return 0;
+  }
+}
+
+int binary_as_bool(seajson_binary binary) {
+  return get_type_of_binary(binary) == SEAJSON_TYPE_TRUE;
+}
+
+/* Schema decoding */
+
+static void store_field_integer(unsigned char *dest, size_t size, long long value) {
+  if (size == sizeof(long long)) {
+    long long converted = value;
+    memcpy(dest, &converted, size);
+  } else if (size == sizeof(int)) {
+    int converted = (int)value;
+    memcpy(dest, &converted, size);
+  } else if (size == sizeof(short)) {
+    short converted = (short)value;
+    memcpy(dest, &converted, size);
+  } else if (size == sizeof(char)) {
+    signed char converted = (signed char)value;
+    memcpy(dest, &converted, size);
+  }
+}
+
+static void store_field_double(unsigned char *dest, size_t size, double value) {
+  if (size == sizeof(double)) {
+    memcpy(dest, &value, size);
+  } else if (size == sizeof(float)) {
+    float converted = (float)value;
+    memcpy(dest, &converted, size);
+  }
+}
+
+static size_t decode_schema_object(const char *json, size_t length, size_t pos, const seajson_field *fields, size_t fieldCount, unsigned char *base);
+
+/* Decodes one item of a numeric array field, anything that is not a number is skipped */
+static size_t decode_schema_number(const char *json, size_t length, size_t pos, const seajson_field *field, unsigned char *dest) {
+  json_number number;
+  size_t end = scan_json_number(json, length, pos, &number);
+  if (end == SEAJSON_SCAN_FAILED) {
+    return skip_json_value(json, length, pos);
+  }
+  if (dest != NULL) {
+    if (field->type == SEAJSON_FIELD_DOUBLE || field->type == SEAJSON_FIELD_DOUBLE_ARRAY) {
+      store_field_double(dest, field->size, number.number);
+    } else {
+      store_field_integer(dest, field->size, number.integer);
+    }
+  }
+  return end;
+}
+
+/* Decodes the items of an array field, items past capacity are skipped */
+static size_t decode_schema_array(const char *json, size_t length, size_t pos, const seajson_field *field, unsigned char *base) {
+  unsigned char *dest = base + field->offset;
+  size_t itemCount = 0;
+  pos = skip_json_whitespace(json, length, pos + 1);
+  if (pos < length && json[pos] == ']') {
+    pos++;
+  } else {
+    for (;;) {
+      pos = skip_json_whitespace(json, length, pos);
+      if (pos >= length) {
+        return SEAJSON_SCAN_FAILED;
+      }
+      unsigned char *itemDest = (itemCount < field->capacity) ? dest + itemCount * field->size : NULL;
+      if (itemDest == NULL) {
+        pos = skip_json_value(json, length, pos);
+      } else if (field->type == SEAJSON_FIELD_OBJECT_ARRAY) {
+        if (json[pos] == '{') {
+          pos = decode_schema_object(json, length, pos, field->fields, field->fieldCount, itemDest);
+        } else {
+          pos = skip_json_value(json, length, pos);
+        }
+      } else {
+        pos = decode_schema_number(json, length, pos, field, itemDest);
+      }
+      if (pos == SEAJSON_SCAN_FAILED) {
+        return SEAJSON_SCAN_FAILED;
+      }
+      if (itemDest != NULL) {
+        itemCount++;
+      }
+      pos = skip_json_whitespace(json, length, pos);
+      if (pos >= length) {
+        return SEAJSON_SCAN_FAILED;
+      }
+      if (json[pos] == ']') {
+        pos++;
+        break;
+      }
+      if (json[pos] != ',') {
+        return SEAJSON_SCAN_FAILED;
+      }
+      pos++;
+    }
+  }
+  if (field->countOffset != SEAJSON_NO_COUNT) {
+    memcpy(base + field->countOffset, &itemCount, sizeof(itemCount));
+  }
+  return pos;
+}
+
+/* pos is on the value for field, returns the pos after it. Values of the wrong type are skipped. */
+static size_t decode_schema_field(const char *json, size_t length, size_t pos, const seajson_field *field, unsigned char *base) {
+  unsigned char *dest = base + field->offset;
+  char currentChar = json[pos];
+  switch (field->type) {
+    case SEAJSON_FIELD_STRING:
+      if (currentChar == '\"' && field->size > 0) {
+        size_t end = find_json_string_end(json, length, pos + 1);
+        if (end >= length || unescape_json_string(json + pos + 1, end - pos - 1, (char *)dest, field->size) < 0) {
+          return SEAJSON_SCAN_FAILED;
+        }
+        return end + 1;
+      }
+      break;
+    case SEAJSON_FIELD_INT:
+    case SEAJSON_FIELD_DOUBLE:
+      if (currentChar == '-' || (currentChar >= '0' && currentChar <= '9')) {
+        return decode_schema_number(json, length, pos, field, dest);
+      }
+      break;
+    case SEAJSON_FIELD_BOOL:
+      if (currentChar == 't' || currentChar == 'f') {
+        store_field_integer(dest, field->size, currentChar == 't');
+      }
+      break;
+    case SEAJSON_FIELD_INT_ARRAY:
+    case SEAJSON_FIELD_DOUBLE_ARRAY:
+    case SEAJSON_FIELD_OBJECT_ARRAY:
+      if (currentChar == '[') {
+        return decode_schema_array(json, length, pos, field, base);
+      }
+      break;
+    case SEAJSON_FIELD_OBJECT:
+      if (currentChar == '{') {
+        return decode_schema_object(json, length, pos, field->fields, field->fieldCount, dest);
+      }
+      break;
+  }
+  return skip_json_value(json, length, pos);
+}
+
+/* pos is on the {, returns the pos after the matching } */
+static size_t decode_schema_object(const char *json, size_t length, size_t pos, const seajson_field *fields, size_t fieldCount, unsigned char *base) {
+  pos = skip_json_whitespace(json, length, pos + 1);
+  if (pos < length && json[pos] == '}') {
+    return pos + 1;
+  }
+  for (;;) {
+    pos = skip_json_whitespace(json, length, pos);
+    if (pos >= length || json[pos] != '\"') {
+      return SEAJSON_SCAN_FAILED;
+    }
+    size_t keyStart = pos + 1;
+    size_t keyEnd = find_json_string_end(json, length, keyStart);
+    pos = skip_json_whitespace(json, length, keyEnd + 1);
+    if (pos >= length || json[pos] != ':') {
+      return SEAJSON_SCAN_FAILED;
+    }
+    pos = skip_json_whitespace(json, length, pos + 1);
+    if (pos >= length) {
+      return SEAJSON_SCAN_FAILED;
+    }
+    /* Dispatch on the key, keys that are not in the schema are skipped without looking inside of them */
+    size_t keyLength = keyEnd - keyStart;
+    const seajson_field *field = NULL;
+    for (size_t i = 0; i < fieldCount; i++) {
+      if (fields[i].keyLength == keyLength && memcmp(fields[i].key, json + keyStart, keyLength) == 0) {
+        field = &fields[i];
+        break;
+      }
+    }
+    if (field != NULL) {
+      pos = decode_schema_field(json, length, pos, field, base);
+    } else {
+      pos = skip_json_value(json, length, pos);
+    }
+    if (pos == SEAJSON_SCAN_FAILED) {
+      return SEAJSON_SCAN_FAILED;
+    }
+    pos = skip_json_whitespace(json, length, pos);
+    if (pos >= length) {
+      return SEAJSON_SCAN_FAILED;
+    }
+    if (json[pos] == '}') {
+      return pos + 1;
+    }
+    if (json[pos] != ',') {
+      return SEAJSON_SCAN_FAILED;
+    }
+    pos++;
+  }
+}
+
+/* Returns 0 on success or -1 if the json is malformed (out may be partially filled in) */
+int decode_seajson(seajson json, const seajson_field *fields, size_t fieldCount, void *out) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_DECODE_SEAJSON);
+  use_document_allocator(json);
+  size_t length = strlen(json);
+  size_t pos = skip_json_whitespace(json, length, 0);
+  if (pos >= length || json[pos] != '{') {
+    fprintf(stderr, "SeaJSON Error: json passed into decode_seajson is not an object.\n");
+    return -1;
+  }
+  if (decode_schema_object(json, length, pos, fields, fieldCount, out) == SEAJSON_SCAN_FAILED) {
+    fprintf(stderr, "SeaJSON Error: Failed to parse json (decode_seajson).\n");
+    return -1;
+  }
+  return 0;
+}
+
+/* Stats */
+
+int seajson_stats_enabled(void) {
+#ifdef SEAJSON_STATS
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+seajson_stats seajson_get_stats(void) {
+#ifdef SEAJSON_STATS
+  return threadStats;
+#else
+  seajson_stats stats;
+  memset(&stats, 0, sizeof(stats));
+  return stats;
+#endif
+}
+
+void seajson_reset_stats(void) {
+#ifdef SEAJSON_STATS
+  memset(&threadStats, 0, sizeof(threadStats));
+#endif
+}
+
+void seajson_dump_stats(FILE *fp) {
+  static const char *functionNames[SEAJSON_STAT_FUNCTION_COUNT] = {
+    "init_json_from_file",
+    "get_string",
+    "get_int",
+    "get_dictionary",
+    "get_array",
+    "get_item_from_jarray",
+    "remove_whitespace_from_json",
+    "get_string_from_jarray",
+    "get_int_from_jarray",
+    "remove_item_of_jarray",
+    "add_item_to_jarray",
+    "add_string_seajson",
+    "add_item_seajson",
+    "get_pos_string_seajson",
+    "get_pos_item_seajson",
+    "remove_string_seajson",
+    "remove_item_seajson",
+    "set_item_seajson",
+    "seajson_to_binary",
+    "binary_to_seajson",
+    "init_binary_from_file",
+    "decode_seajson",
+    "apply_seajson_patch",
+    "set_path_seajson_mutable",
+    "get_int32_array",
+    "get_int64_array",
+    "get_double_array",
+    "project_seajson_lines",
+    "seajson_index_feed",
+    "get_value_indexed",
+    "seajson_iterator_next",
+    "dedup_seajson",
+    "get_slice",
+    "seajson_index_splice",
+    "run_seajson_query",
+    "parse_seajson_sax",
+    "seajson_formatter_feed",
+  };
+  seajson_stats stats = seajson_get_stats();
+  if (!seajson_stats_enabled()) {
+    fprintf(fp, "SeaJSON stats: not collected, build SeaJSON with SEAJSON_STATS defined.\n");
+    return;
+  }
+  fprintf(fp, "SeaJSON stats:\n");
+  fprintf(fp, "  full document scans: %llu\n", stats.fullScans);
+  fprintf(fp, "  allocations: %llu (%llu bytes)\n", stats.allocations, stats.bytesAllocated);
+  fprintf(fp, "  cache hits: %llu, misses: %llu\n", stats.cacheHits, stats.cacheMisses);
+  fprintf(fp, "  pool hits: %llu, misses: %llu\n", stats.poolHits, stats.poolMisses);
+  for (int i = 0; i < SEAJSON_STAT_FUNCTION_COUNT; i++) {
+    if (stats.calls[i] == 0) {
+      continue;
+    }
+    fprintf(fp, "  %-28s calls: %llu, bytes scanned: %llu, time: %llu ns\n", functionNames[i], stats.calls[i], stats.bytesScanned[i], stats.nanoseconds[i]);
+  }
+}
+
+/* Allocator hooks */
+
+/* NULL goes back to malloc/realloc/free */
+void seajson_set_allocator(const seajson_allocator *allocator) {
+  if (allocator == NULL) {
+    globalAllocator.malloc = libc_malloc;
+    globalAllocator.realloc = libc_realloc;
+    globalAllocator.free = libc_free;
+    globalAllocator.context = NULL;
+    return;
+  }
+  globalAllocator = *allocator;
+}
+
+seajson_allocator seajson_get_allocator(void) {
+  return globalAllocator;
+}
+
+/* json must have been allocated by allocator, since free_json will give it back to it */
+seajson seajson_set_document_allocator(seajson json, const seajson_allocator *allocator) {
+  document_header header;
+  if (read_document_header(json, &header)) {
+    /* Take the old header off, which puts the json back at the start of its allocation */
+    char *base = json - header.offset;
+    memmove(base, json, strlen(json) + 1);
+    json = base;
+  }
+  if (allocator == NULL || json == NULL) {
+    return json;
+  }
+  return attach_document_header(json, allocator);
+}
+
+void seajson_free(void *ptr) {
+  globalAllocator.free(globalAllocator.context, ptr);
+}
+
+void seajson_free_from(seajson json, void *ptr) {
+  use_document_allocator(json);
+  sea_free(ptr);
+}
+
+/*
+ * Size class pools. Blocks of 16 to 1024 bytes are carved out of 64KB
+ * slabs and recycled through free lists, so the common tiny result never
+ * touches malloc or its locks. Each slab holds one size class and belongs
+ * to the thread that made it; only that thread allocates from it or frees
+ * into its free list. A block freed on another thread goes on the slab's
+ * remote list instead, which the owner takes back all at once when it
+ * runs out of blocks. The 8 byte header in front of a block points at its
+ * slab (so the size class comes from there), bigger allocations go to
+ * malloc with a NULL slab and their size in front of that.
+ *
+ * A slab that has every block back is given back to malloc unless it is
+ * the one its thread is allocating from. When a thread exits its empty
+ * slabs are freed and the rest become orphans, which a thread that needs
+ * a slab of the same class adopts (or seajson_pool_trim frees once their
+ * blocks have all come back).
+ */
+
+#define SEAJSON_POOL_CLASS_COUNT 7
+#define SEAJSON_POOL_MIN_SIZE 16
+#define SEAJSON_POOL_SLAB_SIZE 65536
+#define SEAJSON_POOL_HEADER_SIZE 8  /* Room for the slab pointer, 8 on 32 bit too so blocks stay 8 byte aligned */
+#define SEAJSON_POOL_LARGE_HEADER_SIZE 16
+
+typedef struct pool_block {
+  struct pool_block *next;
+} pool_block;
+
+typedef struct pool_slab {
+  struct pool_slab *next;        /* In its owner's list for the class, or the orphan list */
+  struct pool_slab *previous;
+  struct pool_thread *owner;     /* Atomic, NULL while it is an orphan */
+  pool_block *freeBlocks;        /* Only touched by the owner */
+  pool_block *remoteBlocks;      /* Atomic, pushed to by every other thread */
+  size_t sizeClass;
+  size_t used;                   /* Blocks handed out and not back on freeBlocks yet */
+  size_t bumpOffset;             /* Where the never used blocks start */
+} pool_slab;
+
+typedef struct pool_thread {
+  pool_slab *slabs[SEAJSON_POOL_CLASS_COUNT];  /* The first one is the one allocated from */
+} pool_thread;
+
+/* Blocks start after the slab header, rounded up so the header stays aligned for any block size */
+#define SEAJSON_POOL_SLAB_HEADER_SIZE ((sizeof(pool_slab) + 15) & ~(size_t)15)
+
+static SEAJSON_THREAD_LOCAL pool_thread *poolThread;
+static seajson_mutex poolOrphanLock = SEAJSON_MUTEX_INIT;
+static pool_slab *poolOrphans;
+
+static size_t pool_size_class(size_t size) {
+  size_t classSize = SEAJSON_POOL_MIN_SIZE;
+  for (size_t sizeClass = 0; sizeClass < SEAJSON_POOL_CLASS_COUNT; sizeClass++) {
+    if (size <= classSize) {
+      return sizeClass;
+    }
+    classSize <<= 1;
+  }
+  return SEAJSON_POOL_CLASS_COUNT;
+}
+
+static size_t pool_block_size(size_t sizeClass) {
+  return SEAJSON_POOL_HEADER_SIZE + (SEAJSON_POOL_MIN_SIZE << sizeClass);
+}
+
+static void pool_link_slab(pool_slab **list, pool_slab *slab) {
+  slab->previous = NULL;
+  slab->next = *list;
+  if (*list) {
+    (*list)->previous = slab;
+  }
+  *list = slab;
+}
+
+static void pool_unlink_slab(pool_slab **list, pool_slab *slab) {
+  if (slab->previous) {
+    slab->previous->next = slab->next;
+  } else {
+    *list = slab->next;
+  }
+  if (slab->next) {
+    slab->next->previous = slab->previous;
+  }
+}
+
+/* Moves the blocks other threads freed onto freeBlocks, only the owner (or the orphan lock holder) can do this */
+static void pool_take_remote_blocks(pool_slab *slab) {
+  pool_block *block = seajson_pointer_exchange(&slab->remoteBlocks, NULL);
+  while (block) {
+    pool_block *next = block->next;
+    block->next = slab->freeBlocks;
+    slab->freeBlocks = block;
+    slab->used--;
+    block = next;
+  }
+}
+
+static int pool_slab_has_room(const pool_slab *slab) {
+  return slab->freeBlocks != NULL || slab->bumpOffset + pool_block_size(slab->sizeClass) <= SEAJSON_POOL_SLAB_SIZE;
+}
+
+/* Frees the orphans that have every block back, needs poolOrphanLock held */
+static void pool_free_empty_orphans(void) {
+  pool_slab *slab = poolOrphans;
+  while (slab) {
+    pool_slab *next = slab->next;
+    pool_take_remote_blocks(slab);
+    if (slab->used == 0) {
+      pool_unlink_slab(&poolOrphans, slab);
+      free(slab);
+    }
+    slab = next;
+  }
+}
+
+static void pool_thread_exit(void *context) {
+  pool_thread *thread = context;
+  seajson_mutex_lock(&poolOrphanLock);
+  for (size_t sizeClass = 0; sizeClass < SEAJSON_POOL_CLASS_COUNT; sizeClass++) {
+    pool_slab *slab = thread->slabs[sizeClass];
+    while (slab) {
+      pool_slab *next = slab->next;
+      pool_take_remote_blocks(slab);
+      if (slab->used == 0) {
+        free(slab);
+      } else {
+        seajson_pointer_store(&slab->owner, NULL);
+        pool_link_slab(&poolOrphans, slab);
+      }
+      slab = next;
+    }
+  }
+  pool_free_empty_orphans();
+  seajson_mutex_unlock(&poolOrphanLock);
+  if (poolThread == thread) {
+    poolThread = NULL;
+  }
+  free(thread);
+}
+
+/* Thread exit hook, so a thread's slabs do not leak with it */
+
+#ifndef _WIN32
+static pthread_once_t poolExitOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t poolExitKey;
+static int poolExitKeyMade;
+
+static void pool_make_exit_key(void) {
+  poolExitKeyMade = (pthread_key_create(&poolExitKey, pool_thread_exit) == 0);
+}
+
+static void pool_register_thread(pool_thread *thread) {
+  pthread_once(&poolExitOnce, pool_make_exit_key);
+  if (poolExitKeyMade) {
+    pthread_setspecific(poolExitKey, thread);
+  }
+}
+#else
+static INIT_ONCE poolExitOnce = INIT_ONCE_STATIC_INIT;
+static DWORD poolExitKey = FLS_OUT_OF_INDEXES;
+
+static void WINAPI pool_fls_exit(void *thread) {
+  if (thread) {
+    pool_thread_exit(thread);
+  }
+}
+
+static BOOL CALLBACK pool_make_exit_key(PINIT_ONCE once, PVOID parameter, PVOID *context) {
+  (void)once;
+  (void)parameter;
+  (void)context;
+  poolExitKey = FlsAlloc(pool_fls_exit);
+  return TRUE;
+}
+
+static void pool_register_thread(pool_thread *thread) {
+  InitOnceExecuteOnce(&poolExitOnce, pool_make_exit_key, NULL, NULL);
+  if (poolExitKey != FLS_OUT_OF_INDEXES) {
+    FlsSetValue(poolExitKey, thread);
+  }
+}
+#endif
+
+static pool_thread *pool_current_thread(void) {
+  if (poolThread == NULL) {
+    poolThread = calloc(1, sizeof(pool_thread));
+    if (poolThread) {
+      pool_register_thread(poolThread);
+    }
+  }
+  return poolThread;
+}
+
+/* Makes a slab with room for sizeClass the first of the thread's list, taking back remote blocks, adopting an orphan or making a new one */
+static pool_slab *pool_refill(pool_thread *thread, size_t sizeClass) {
+  pool_slab **list = &thread->slabs[sizeClass];
+  pool_slab *slab = *list;
+  pool_slab *found = NULL;
+  while (slab) {
+    pool_slab *next = slab->next;
+    pool_take_remote_blocks(slab);
+    if (found == NULL && pool_slab_has_room(slab)) {
+      found = slab;
+    } else if (slab->used == 0 && slab != *list) {
+      pool_unlink_slab(list, slab);
+      free(slab);
+    }
+    slab = next;
+  }
+  if (found) {
+    pool_unlink_slab(list, found);
+    pool_link_slab(list, found);
+    return found;
+  }
+  seajson_mutex_lock(&poolOrphanLock);
+  for (slab = poolOrphans; slab; slab = slab->next) {
+    if (slab->sizeClass == sizeClass) {
+      pool_take_remote_blocks(slab);
+      if (pool_slab_has_room(slab)) {
+        pool_unlink_slab(&poolOrphans, slab);
+        break;
+      }
+    }
+  }
+  seajson_mutex_unlock(&poolOrphanLock);
+  if (slab == NULL) {
+    slab = malloc(SEAJSON_POOL_SLAB_SIZE);
+    if (slab == NULL) {
+      return NULL;
+    }
+    slab->freeBlocks = NULL;
+    slab->remoteBlocks = NULL;
+    slab->sizeClass = sizeClass;
+    slab->used = 0;
+    slab->bumpOffset = SEAJSON_POOL_SLAB_HEADER_SIZE;
+  }
+  seajson_pointer_store(&slab->owner, thread);
+  pool_link_slab(list, slab);
+  return slab;
+}
+
+static void *pool_malloc(void *context, size_t size) {
+  (void)context;
+  size_t sizeClass = pool_size_class(size);
+  if (sizeClass == SEAJSON_POOL_CLASS_COUNT) {
+    unsigned char *block = malloc(SEAJSON_POOL_LARGE_HEADER_SIZE + size);
+    if (block == NULL) {
+      return NULL;
+    }
+    ((size_t *)block)[0] = size;
+    *(pool_slab **)(block + SEAJSON_POOL_LARGE_HEADER_SIZE - SEAJSON_POOL_HEADER_SIZE) = NULL;
+    return block + SEAJSON_POOL_LARGE_HEADER_SIZE;
+  }
+  pool_thread *thread = pool_current_thread();
+  if (thread == NULL) {
+    return NULL;
+  }
+  pool_slab *slab = thread->slabs[sizeClass];
+  if (slab == NULL || !pool_slab_has_room(slab)) {
+    slab = pool_refill(thread, sizeClass);
+    if (slab == NULL) {
+      return NULL;
+    }
+  }
+  unsigned char *block;
+  if (slab->freeBlocks) {
+    SEAJSON_STAT_POOL_HIT();
+    block = (unsigned char *)slab->freeBlocks;
+    slab->freeBlocks = slab->freeBlocks->next;
+  } else {
+    SEAJSON_STAT_POOL_MISS();
+    block = (unsigned char *)slab + slab->bumpOffset;
+    slab->bumpOffset += pool_block_size(sizeClass);
+  }
+  slab->used++;
+  *(pool_slab **)block = slab;
+  return block + SEAJSON_POOL_HEADER_SIZE;
+}
+
+static pool_slab *pool_block_slab(void *ptr) {
+  return *(pool_slab **)((unsigned char *)ptr - SEAJSON_POOL_HEADER_SIZE);
+}
+
+static void pool_free(void *context, void *ptr) {
+  (void)context;
+  if (ptr == NULL) {
+    return;
+  }
+  pool_slab *slab = pool_block_slab(ptr);
+  if (slab == NULL) {
+    free((unsigned char *)ptr - SEAJSON_POOL_LARGE_HEADER_SIZE);
+    return;
+  }
+  pool_block *freed = (pool_block *)((unsigned char *)ptr - SEAJSON_POOL_HEADER_SIZE);
+  pool_thread *thread = poolThread;
+  if (thread == NULL || seajson_pointer_load(&slab->owner) != thread) {
+    /* Only the owner touches freeBlocks, everyone else hands it back through the remote list */
+    pool_block *head;
+    do {
+      head = seajson_pointer_load(&slab->remoteBlocks);
+      freed->next = head;
+    } while (!seajson_pointer_compare_exchange(&slab->remoteBlocks, head, freed));
+    return;
+  }
+  freed->next = slab->freeBlocks;
+  slab->freeBlocks = freed;
+  slab->used--;
+  if (slab->used == 0 && slab != thread->slabs[slab->sizeClass]) {
+    pool_unlink_slab(&thread->slabs[slab->sizeClass], slab);
+    free(slab);
+  }
+}
+
+static void *pool_realloc(void *context, void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return pool_malloc(context, size);
+  }
+  pool_slab *slab = pool_block_slab(ptr);
+  size_t oldSize;
+  if (slab == NULL) {
+    unsigned char *block = (unsigned char *)ptr - SEAJSON_POOL_LARGE_HEADER_SIZE;
+    oldSize = ((size_t *)block)[0];
+    if (pool_size_class(size) == SEAJSON_POOL_CLASS_COUNT) {
+      unsigned char *newBlock = realloc(block, SEAJSON_POOL_LARGE_HEADER_SIZE + size);
+      if (newBlock == NULL) {
+        return NULL;
+      }
+      ((size_t *)newBlock)[0] = size;
+      return newBlock + SEAJSON_POOL_LARGE_HEADER_SIZE;
+    }
+  } else {
+    oldSize = SEAJSON_POOL_MIN_SIZE << slab->sizeClass;
+    if (size <= oldSize) {
+      return ptr;
+    }
+  }
+  void *newPtr = pool_malloc(context, size);
+  if (newPtr == NULL) {
+    return NULL;
+  }
+  memcpy(newPtr, ptr, oldSize < size ? oldSize : size);
+  pool_free(context, ptr);
+  return newPtr;
+}
+
+void seajson_pool_trim(void) {
+  pool_thread *thread = poolThread;
+  if (thread) {
+    for (size_t sizeClass = 0; sizeClass < SEAJSON_POOL_CLASS_COUNT; sizeClass++) {
+      pool_slab *slab = thread->slabs[sizeClass];
+      while (slab) {
+        pool_slab *next = slab->next;
+        pool_take_remote_blocks(slab);
+        if (slab->used == 0) {
+          pool_unlink_slab(&thread->slabs[sizeClass], slab);
+          free(slab);
+        }
+        slab = next;
+      }
+    }
+  }
+  seajson_mutex_lock(&poolOrphanLock);
+  pool_free_empty_orphans();
+  seajson_mutex_unlock(&poolOrphanLock);
+}
+
+static const seajson_allocator poolAllocator = { pool_malloc, pool_realloc, pool_free, NULL };
+
+const seajson_allocator *seajson_pool_allocator(void) {
+  return &poolAllocator;
+}
+
+/* JSON Patch */
+
+#define PATCH_ERROR_JSON 1      /* The document or patch is not valid json */
+#define PATCH_ERROR_PATH 2      /* A path does not point at anything */
+#define PATCH_ERROR_CONFLICT 3  /* Two operations touch the same value */
+#define PATCH_ERROR_MEMORY 4
+
+/* Where a JSON Pointer ends up in the original document */
+typedef struct {
+  size_t containerPos;  /* The { or [ holding the target, SEAJSON_SCAN_FAILED for the root */
+  size_t memberIndex;   /* For missing targets, the index it would be added at */
+  size_t valueStart;
+  size_t valueEnd;
+  int exists;
+  char *token;          /* The last token unescaped, owned by the caller */
+  size_t tokenLength;
+} patch_target;
+
+/* An add/remove of a member, these need the commas of their container fixed up so they are applied per container */
+typedef struct {
+  size_t containerPos;
+  size_t memberIndex;
+  int isRemove;
+  const char *key;      /* Key for new object members, NULL for arrays */
+  size_t keyLength;
+  const char *value;
+  size_t order;
+} patch_edit;
+
+/* Bytes [start, end) of the original document get replaced by the text described here */
+typedef struct {
+  size_t start;
+  size_t end;
+  const char *key;
+  size_t keyLength;
+  const char *value;
+  size_t valueLength;
+  int leadingComma;
+  int trailingComma;
+  size_t order;
+} patch_splice;
+
+typedef struct {
+  patch_splice *items;
+  size_t count;
+  size_t capacity;
+} patch_splice_list;
+
+static int patch_splice_push(patch_splice_list *list, size_t start, size_t end, const char *key, size_t keyLength, const char *value, size_t order) {
+  if (list->count == list->capacity) {
+    size_t newCapacity = list->capacity ? list->capacity * 2 : 16;
+    patch_splice *newItems = sea_realloc(list->items, sizeof(patch_splice) * newCapacity);
+    if (newItems == NULL) {
+      return 0;
+    }
+    list->items = newItems;
+    list->capacity = newCapacity;
+  }
+  patch_splice *splice = &list->items[list->count++];
+  splice->start = start;
+  splice->end = end;
+  splice->key = key;
+  splice->keyLength = keyLength;
+  splice->value = value;
+  splice->valueLength = value ? strlen(value) : 0;
+  splice->leadingComma = 0;
+  splice->trailingComma = 0;
+  splice->order = order;
+  return 1;
+}
+
+/* Array indexes are digits without leading zeros, returns SEAJSON_SCAN_FAILED for anything else */
+static size_t parse_pointer_index(const char *token, size_t tokenLength) {
+  if (tokenLength == 0 || (tokenLength > 1 && token[0] == '0')) {
+    return SEAJSON_SCAN_FAILED;
+  }
+  size_t index = 0;
+  for (size_t i = 0; i < tokenLength; i++) {
+    if (token[i] < '0' || token[i] > '9' || index > (SIZE_MAX - 9) / 10) {
+      return SEAJSON_SCAN_FAILED;
+    }
+    index = index * 10 + (size_t)(token[i] - '0');
+  }
+  return index;
+}
+
+static int resolve_json_pointer(const char *json, size_t length, const char *path, const seajson_index *index, patch_target *target) {
+  target->containerPos = SEAJSON_SCAN_FAILED;
+  target->memberIndex = 0;
+  target->exists = 1;
+  target->token = NULL;
+  target->tokenLength = 0;
+  target->valueStart = skip_json_whitespace(json, length, 0);
+  target->valueEnd = SEAJSON_SCAN_FAILED;
+  if (index && index->containerCount && index->containers[0].start == target->valueStart && index->containers[0].end) {
+    target->valueEnd = (size_t)index->containers[0].end;
+  } else {
+    target->valueEnd = skip_json_value(json, length, target->valueStart);
+  }
+  if (target->valueEnd == SEAJSON_SCAN_FAILED) {
+    return PATCH_ERROR_JSON;
+  }
+  if (path[0] == '\0') {
+    return 0;
+  }
+  if (path[0] != '/') {
+    return PATCH_ERROR_PATH;
+  }
+  /* Tokens only ever get shorter when unescaped */
+  char *token = sea_malloc(strlen(path) + 1);
+  if (token == NULL) {
+    return PATCH_ERROR_MEMORY;
+  }
+  target->token = token;
+  const char *cursor = path;
+  while (*cursor == '/') {
+    if (!target->exists) {
+      /* Only the last token is allowed to be missing */
+      return PATCH_ERROR_PATH;
+    }
+    cursor++;
+    size_t tokenLength = 0;
+    while (*cursor != '\0' && *cursor != '/') {
+      if (cursor[0] == '~' && cursor[1] == '1') {
+        token[tokenLength++] = '/';
+        cursor += 2;
+      } else if (cursor[0] == '~' && cursor[1] == '0') {
+        token[tokenLength++] = '~';
+        cursor += 2;
+      } else {
+        token[tokenLength++] = *cursor++;
+      }
+    }
+    token[tokenLength] = '\0';
+    target->tokenLength = tokenLength;
+    char open = json[target->valueStart];
+    if (open != '{' && open != '[') {
+      return PATCH_ERROR_PATH;
+    }
+    size_t wantedIndex = SEAJSON_SCAN_FAILED;
+    if (open == '[') {
+      if (tokenLength == 1 && token[0] == '-') {
+        wantedIndex = SIZE_MAX - 1;
+      } else {
+        wantedIndex = parse_pointer_index(token, tokenLength);
+        if (wantedIndex == SEAJSON_SCAN_FAILED) {
+          return PATCH_ERROR_PATH;
+        }
+      }
+    }
+    member_scanner scanner;
+    member_scanner_init(&scanner, json, length, target->valueStart);
+    scanner.index = index;
+    size_t memberIndex = 0;
+    int found = 0;
+    while (member_scanner_next(&scanner)) {
+      if (scanner.isObject ? json_key_equals(json, scanner.keyStart, scanner.keyEnd, token, tokenLength) : (memberIndex == wantedIndex)) {
+        found = 1;
+        break;
+      }
+      memberIndex++;
+    }
+    if (scanner.failed) {
+      return PATCH_ERROR_JSON;
+    }
+    target->containerPos = target->valueStart;
+    target->memberIndex = memberIndex;
+    if (found) {
+      target->valueStart = scanner.valueStart;
+      target->valueEnd = scanner.valueEnd;
+    } else {
+      /* "-" or the item count of an array means the end, anything past that is not there */
+      if (open == '[' && wantedIndex != SIZE_MAX - 1 && wantedIndex != memberIndex) {
+        return PATCH_ERROR_PATH;
+      }
+      target->exists = 0;
+    }
+  }
+  return 0;
+}
+
+typedef struct {
+  size_t memberStart;
+  size_t valueEnd;
+  size_t commaPos;
+  int removed;
+  size_t sequencePos;
+} patch_member;
+
+/* One member of a container after the edits, either an original member or an inserted one */
+typedef struct {
+  const patch_edit *insert;  /* NULL for original members */
+  size_t memberIndex;
+} patch_sequence_item;
+
+static int compare_patch_inserts(const void *a, const void *b) {
+  const patch_edit *first = *(const patch_edit *const *)a;
+  const patch_edit *second = *(const patch_edit *const *)b;
+  if (first->memberIndex != second->memberIndex) {
+    return first->memberIndex < second->memberIndex ? -1 : 1;
+  }
+  return first->order < second->order ? -1 : (first->order > second->order);
+}
+
+/*
+ * Turns the adds/removes of one container into splices. The container's
+ * members after the edits are worked out first, then every original comma
+ * is kept only if something still follows its member, and every inserted
+ * member brings whatever commas it needs with it.
+ */
+static int patch_container_edits(const char *json, size_t length, const seajson_index *index, const patch_edit *edits, size_t editCount, patch_splice_list *splices) {
+  member_scanner scanner;
+  member_scanner_init(&scanner, json, length, edits[0].containerPos);
+  scanner.index = index;
+  patch_member *members = NULL;
+  size_t memberCount = 0;
+  size_t memberCapacity = 0;
+  const patch_edit **inserts = NULL;
+  size_t insertCount = 0;
+  patch_sequence_item *sequence = NULL;
+  int error = 0;
+  while (member_scanner_next(&scanner)) {
+    if (memberCount == memberCapacity) {
+      size_t newCapacity = memberCapacity ? memberCapacity * 2 : 16;
+      patch_member *newMembers = sea_realloc(members, sizeof(patch_member) * newCapacity);
+      if (newMembers == NULL) {
+        error = PATCH_ERROR_MEMORY;
+        goto done;
+      }
+      members = newMembers;
+      memberCapacity = newCapacity;
+    }
+    members[memberCount].memberStart = scanner.memberStart;
+    members[memberCount].valueEnd = scanner.valueEnd;
+    members[memberCount].commaPos = scanner.commaPos;
+    members[memberCount].removed = 0;
+    memberCount++;
+  }
+  if (scanner.failed) {
+    error = PATCH_ERROR_JSON;
+    goto done;
+  }
+  inserts = sea_malloc(sizeof(patch_edit *) * editCount);
+  if (inserts == NULL) {
+    error = PATCH_ERROR_MEMORY;
+    goto done;
+  }
+  for (size_t i = 0; i < editCount; i++) {
+    const patch_edit *edit = &edits[i];
+    if (edit->isRemove) {
+      if (members[edit->memberIndex].removed) {
+        error = PATCH_ERROR_CONFLICT;
+        goto done;
+      }
+      members[edit->memberIndex].removed = 1;
+      continue;
+    }
+    if (edit->key) {
+      /* Two adds of the same new key would leave a duplicate key behind */
+      for (size_t j = 0; j < insertCount; j++) {
+        if (inserts[j]->keyLength == edit->keyLength && memcmp(inserts[j]->key, edit->key, edit->keyLength) == 0) {
+          error = PATCH_ERROR_CONFLICT;
+          goto done;
+        }
+      }
+    }
+    inserts[insertCount++] = edit;
+  }
+  qsort(inserts, insertCount, sizeof(patch_edit *), compare_patch_inserts);
+  /* Lay out the members as they will be after the edits, inserts go in front of the member they were added at */
+  sequence = sea_malloc(sizeof(patch_sequence_item) * (memberCount + insertCount + 1));
+  if (sequence == NULL) {
+    error = PATCH_ERROR_MEMORY;
+    goto done;
+  }
+  size_t sequenceLength = 0;
+  size_t nextInsert = 0;
+  for (size_t i = 0; i <= memberCount; i++) {
+    while (nextInsert < insertCount && inserts[nextInsert]->memberIndex == i) {
+      sequence[sequenceLength].insert = inserts[nextInsert++];
+      sequence[sequenceLength++].memberIndex = i;
+    }
+    if (i < memberCount && !members[i].removed) {
+      sequence[sequenceLength].insert = NULL;
+      sequence[sequenceLength++].memberIndex = i;
+    }
+  }
+  for (size_t i = 0; i < sequenceLength; i++) {
+    const patch_edit *edit = sequence[i].insert;
+    if (edit == NULL) {
+      members[sequence[i].memberIndex].sequencePos = i;
+      continue;
+    }
+    size_t insertPos = (sequence[i].memberIndex < memberCount) ? members[sequence[i].memberIndex].memberStart : scanner.closePos;
+    if (!patch_splice_push(splices, insertPos, insertPos, edit->key, edit->keyLength, edit->value, edit->order)) {
+      error = PATCH_ERROR_MEMORY;
+      goto done;
+    }
+    patch_splice *splice = &splices->items[splices->count - 1];
+    /* Every original but the last keeps its own comma, so only an insert or the last original needs one added after it */
+    splice->leadingComma = (i > 0 && (sequence[i - 1].insert != NULL || sequence[i - 1].memberIndex + 1 == memberCount));
+    splice->trailingComma = (i + 1 < sequenceLength && sequence[i + 1].insert == NULL);
+  }
+  for (size_t i = 0; i < memberCount; i++) {
+    patch_member *member = &members[i];
+    if (member->removed && !patch_splice_push(splices, member->memberStart, member->valueEnd, NULL, 0, NULL, SIZE_MAX)) {
+      error = PATCH_ERROR_MEMORY;
+      goto done;
+    }
+    /* A comma is only kept if something still comes after its member */
+    int keepComma = (!member->removed && member->sequencePos + 1 < sequenceLength);
+    if (member->commaPos != SEAJSON_SCAN_FAILED && !keepComma && !patch_splice_push(splices, member->commaPos, member->commaPos + 1, NULL, 0, NULL, SIZE_MAX)) {
+      error = PATCH_ERROR_MEMORY;
+      goto done;
+    }
+  }
+done:
+  sea_free(members);
+  sea_free(inserts);
+  sea_free(sequence);
+  return error;
+}
+
+/*
+ * Sequential patches (parse_seajson_patch) are still applied a run of
+ * operations per copy. An operation whose path does not go through or
+ * hold anything an earlier one in the run changed resolves to the same
+ * place in the original document as in the edited one, so only the first
+ * operation that does depend on the run ends it. Every prefix of the
+ * run's paths is kept in a small hash table to tell.
+ */
+#define PATCH_PATH_TARGET 1    /* The path of an op in the run, array appends aside */
+#define PATCH_PATH_ANCESTOR 2  /* Something an op in the run edited inside of */
+#define PATCH_PATH_ARRAY 4     /* An array the run added to or removed from, so its indexes moved */
+
+typedef struct {
+  const char *path;  /* NULL for empty slots, otherwise the op path this is a prefix of */
+  size_t length;
+  uint64_t hash;
+  int flags;
+} patch_path_slot;
+
+typedef struct {
+  patch_path_slot *slots;
+  size_t count;
+  size_t capacity;
+  int opaque;  /* A path had a ~ that is not ~0 or ~1, which resolve_json_pointer takes as is, so two spellings could be the same key */
+} patch_path_table;
+
+static patch_path_slot *find_patch_path(const patch_path_table *table, const char *path, size_t length, uint64_t hash) {
+  size_t mask = table->capacity - 1;
+  size_t i = (size_t)hash & mask;
+  while (table->slots[i].path && !(table->slots[i].hash == hash && table->slots[i].length == length && memcmp(table->slots[i].path, path, length) == 0)) {
+    i = (i + 1) & mask;
+  }
+  return &table->slots[i];
+}
+
+static int patch_path_flags(const patch_path_table *table, const char *path, size_t length, uint64_t hash) {
+  return table->count ? find_patch_path(table, path, length, hash)->flags : 0;
+}
+
+static int mark_patch_path(patch_path_table *table, const char *path, size_t length, uint64_t hash, int flags) {
+  if ((table->count + 1) * 2 > table->capacity) {
+    size_t newCapacity = table->capacity ? table->capacity * 2 : 64;
+    patch_path_slot *newSlots = sea_malloc(sizeof(patch_path_slot) * newCapacity);
+    if (newSlots == NULL) {
+      return 0;
+    }
+    memset(newSlots, 0, sizeof(patch_path_slot) * newCapacity);
+    patch_path_table grown = { newSlots, 0, newCapacity, table->opaque };
+    for (size_t i = 0; i < table->capacity; i++) {
+      if (table->slots[i].path) {
+        *find_patch_path(&grown, table->slots[i].path, table->slots[i].length, table->slots[i].hash) = table->slots[i];
+        grown.count++;
+      }
+    }
+    sea_free(table->slots);
+    *table = grown;
+  }
+  patch_path_slot *slot = find_patch_path(table, path, length, hash);
+  if (slot->path == NULL) {
+    slot->path = path;
+    slot->length = length;
+    slot->hash = hash;
+    table->count++;
+  }
+  slot->flags |= flags;
+  return 1;
+}
+
+#define PATCH_PATH_HASH_START 0xcbf29ce484222325ULL
+
+/* Returns where the token after path[0, prefixLength) ends, with hash moved over it (FNV-1a) */
+static size_t next_pointer_prefix(const char *path, size_t length, size_t prefixLength, uint64_t *hash) {
+  size_t next = prefixLength + 1;
+  while (next < length && path[next] != '/') {
+    next++;
+  }
+  for (size_t i = prefixLength; i < next; i++) {
+    *hash = (*hash ^ (unsigned char)path[i]) * 0x100000001b3ULL;
+  }
+  return next;
+}
+
+static int is_stray_pointer_tilde(const char *path, size_t pos) {
+  return path[pos] == '~' && path[pos + 1] != '0' && path[pos + 1] != '1';
+}
+
+/* Returns 1 if op has to be resolved against the result of the run so far */
+static int patch_op_depends_on_run(const patch_path_table *table, const seajson_patch_op *op) {
+  if (table->count == 0) {
+    return 0;
+  }
+  if (table->opaque) {
+    return 1;
+  }
+  const char *path = op->path;
+  size_t length = strlen(path);
+  uint64_t hash = PATCH_PATH_HASH_START;
+  size_t prefixLength = 0;
+  for (;;) {
+    int flags = patch_path_flags(table, path, prefixLength, hash);
+    if (flags & PATCH_PATH_TARGET) {
+      return 1;
+    }
+    if (prefixLength == length) {
+      /* Something in the run is inside of what this op edits */
+      if (flags & PATCH_PATH_ANCESTOR) {
+        return 1;
+      }
+      break;
+    }
+    /* Appending to an array with "-" still lands after whatever the run did to it, any index in it has moved */
+    int isAppend = (op->type == SEAJSON_PATCH_ADD && prefixLength + 2 == length && path[prefixLength + 1] == '-');
+    if ((flags & PATCH_PATH_ARRAY) && !isAppend) {
+      return 1;
+    }
+    prefixLength = next_pointer_prefix(path, length, prefixLength, &hash);
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (is_stray_pointer_tilde(path, i)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Adds op to the run, isArrayEdit if it added/removed an item of an array and isAppend if that was with "-" */
+static int add_patch_op_to_run(patch_path_table *table, const seajson_patch_op *op, int isArrayEdit, int isAppend) {
+  const char *path = op->path;
+  size_t length = strlen(path);
+  uint64_t hash = PATCH_PATH_HASH_START;
+  size_t prefixLength = 0;
+  while (prefixLength < length) {
+    uint64_t prefixHash = hash;
+    size_t next = next_pointer_prefix(path, length, prefixLength, &hash);
+    /* Every prefix is something the op edits inside of, only its parent can be the array */
+    int flags = PATCH_PATH_ANCESTOR | ((next == length && isArrayEdit) ? PATCH_PATH_ARRAY : 0);
+    if (!mark_patch_path(table, path, prefixLength, prefixHash, flags)) {
+      return 0;
+    }
+    prefixLength = next;
+  }
+  if (!isAppend && !mark_patch_path(table, path, length, hash, PATCH_PATH_TARGET)) {
+    return 0;
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (is_stray_pointer_tilde(path, i)) {
+      table->opaque = 1;
+    }
+  }
+  return 1;
+}
+
+static int compare_patch_edits(const void *a, const void *b) {
+  const patch_edit *first = a;
+  const patch_edit *second = b;
+  if (first->containerPos != second->containerPos) {
+    return first->containerPos < second->containerPos ? -1 : 1;
+  }
+  return first->order < second->order ? -1 : (first->order > second->order);
+}
+
+static int compare_patch_splices(const void *a, const void *b) {
+  const patch_splice *first = a;
+  const patch_splice *second = b;
+  if (first->start != second->start) {
+    return first->start < second->start ? -1 : 1;
+  }
+  if (first->end != second->end) {
+    return first->end < second->end ? -1 : 1;
+  }
+  return first->order < second->order ? -1 : (first->order > second->order);
+}
+
+/* Returns the patched copy of json, or NULL with error set */
+/* index (can be NULL) is only used to jump over nested values, changed (can be NULL) gets the bytes that changed */
+/* With appliedCount the ops are sequential, it stops before the first op that depends on the ones before it and sets how many it applied */
+static seajson apply_patch_ops(seajson json, const seajson_index *index, const seajson_patch_op *ops, size_t opCount, edit_range *changed, int *error, size_t *appliedCount) {
+  size_t length;
+  if (index) {
+    length = (size_t)index->length;
+  } else {
+    length = strlen(json);
+    SEAJSON_STAT_FULL_SCAN(SEAJSON_STAT_APPLY_SEAJSON_PATCH, length);
+  }
+  patch_splice_list splices = { NULL, 0, 0 };
+  patch_edit *edits = sea_malloc(sizeof(patch_edit) * (opCount ? opCount : 1));
+  char **tokens = sea_malloc(sizeof(char *) * (opCount ? opCount : 1));
+  size_t editCount = 0;
+  size_t tokenCount = 0;
+  patch_path_table run = { NULL, 0, 0, 0 };
+  seajson result = NULL;
+  *error = 0;
+  if (edits == NULL || tokens == NULL) {
+    *error = PATCH_ERROR_MEMORY;
+    goto done;
+  }
+  for (size_t i = 0; i < opCount; i++) {
+    const seajson_patch_op *op = &ops[i];
+    if (appliedCount && patch_op_depends_on_run(&run, op)) {
+      opCount = i;
+      break;
+    }
+    patch_target target;
+    *error = resolve_json_pointer(json, length, op->path, index, &target);
+    if (target.token) {
+      tokens[tokenCount++] = target.token;
+    }
+    if (*error) {
+      goto done;
+    }
+    int isObjectMember = (target.containerPos != SEAJSON_SCAN_FAILED && json[target.containerPos] == '{');
+    if (op->type == SEAJSON_PATCH_REPLACE || (op->type == SEAJSON_PATCH_ADD && target.exists && (isObjectMember || target.containerPos == SEAJSON_SCAN_FAILED))) {
+      /* Replacing a value (add on a key that is already there replaces it too) is just a splice over the old value */
+      if (!target.exists) {
+        *error = PATCH_ERROR_PATH;
+        goto done;
+      }
+      if (!patch_splice_push(&splices, target.valueStart, target.valueEnd, NULL, 0, op->value, i) || (appliedCount && !add_patch_op_to_run(&run, op, 0, 0))) {
+        *error = PATCH_ERROR_MEMORY;
+        goto done;
+      }
+      continue;
+    }
+    if (target.containerPos == SEAJSON_SCAN_FAILED || (op->type == SEAJSON_PATCH_REMOVE && !target.exists)) {
+      /* The root can not be removed, and neither can something that is not there */
+      *error = PATCH_ERROR_PATH;
+      goto done;
+    }
+    patch_edit *edit = &edits[editCount++];
+    edit->containerPos = target.containerPos;
+    edit->memberIndex = target.memberIndex;
+    edit->isRemove = (op->type == SEAJSON_PATCH_REMOVE);
+    edit->key = isObjectMember ? target.token : NULL;
+    edit->keyLength = target.tokenLength;
+    edit->value = op->value;
+    edit->order = i;
+    int isArrayEdit = (json[target.containerPos] == '[');
+    int isAppend = (isArrayEdit && !edit->isRemove && target.tokenLength == 1 && target.token[0] == '-');
+    if (appliedCount && !add_patch_op_to_run(&run, op, isArrayEdit, isAppend)) {
+      *error = PATCH_ERROR_MEMORY;
+      goto done;
+    }
+  }
+  if (appliedCount) {
+    *appliedCount = opCount;
+  }
+  qsort(edits, editCount, sizeof(patch_edit), compare_patch_edits);
+  for (size_t groupStart = 0; groupStart < editCount;) {
+    size_t groupEnd = groupStart + 1;
+    while (groupEnd < editCount && edits[groupEnd].containerPos == edits[groupStart].containerPos) {
+      groupEnd++;
+    }
+    *error = patch_container_edits(json, length, index, edits + groupStart, groupEnd - groupStart, &splices);
+    if (*error) {
+      goto done;
+    }
+    groupStart = groupEnd;
+  }
+  qsort(splices.items, splices.count, sizeof(patch_splice), compare_patch_splices);
+  /* Work out the exact size first so the result is made in one allocation and one pass */
+  size_t resultLength = length;
+  size_t previousEnd = 0;
+  for (size_t i = 0; i < splices.count; i++) {
+    patch_splice *splice = &splices.items[i];
+    if (splice->start < previousEnd) {
+      *error = PATCH_ERROR_CONFLICT;
+      goto done;
+    }
+    previousEnd = splice->end;
+    resultLength -= splice->end - splice->start;
+    resultLength += splice->valueLength + splice->leadingComma + splice->trailingComma;
+    if (splice->key) {
+      resultLength += escaped_json_string_length(splice->key, splice->keyLength) + 1;
+    }
+  }
+  byte_buffer out = { sea_malloc(resultLength + 1), 0, resultLength + 1, 0 };
+  if (out.data == NULL) {
+    *error = PATCH_ERROR_MEMORY;
+    goto done;
+  }
+  size_t pos = 0;
+  for (size_t i = 0; i < splices.count; i++) {
+    patch_splice *splice = &splices.items[i];
+    byte_buffer_append(&out, json + pos, splice->start - pos);
+    if (splice->leadingComma) {
+      byte_buffer_push(&out, ',');
+    }
+    if (splice->key) {
+      write_escaped_json_string(&out, splice->key, splice->keyLength);
+      byte_buffer_push(&out, ':');
+    }
+    if (splice->value) {
+      byte_buffer_append(&out, splice->value, splice->valueLength);
+    }
+    if (splice->trailingComma) {
+      byte_buffer_push(&out, ',');
+    }
+    pos = splice->end;
+  }
+  byte_buffer_append(&out, json + pos, length - pos);
+  byte_buffer_push(&out, '\0');
+  result = (seajson)out.data;
+  if (changed && splices.count) {
+    changed->start = splices.items[0].start;
+    changed->oldEnd = splices.items[splices.count - 1].end;
+    changed->newEnd = changed->oldEnd + resultLength - length;
+  } else if (changed) {
+    changed->start = changed->oldEnd = changed->newEnd = 0;
+  }
+done:
+  for (size_t i = 0; i < tokenCount; i++) {
+    sea_free(tokens[i]);
+  }
+  sea_free(tokens);
+  sea_free(edits);
+  sea_free(splices.items);
+  sea_free(run.slots);
+  return result;
+}
+
+seajson_patch new_seajson_patch(void) {
+  seajson_patch patch;
+  patch.ops = NULL;
+  patch.count = 0;
+  patch.capacity = 0;
+  patch.sequential = 0;
+  patch.isValid = 1;
+  return patch;
+}
+
+static char *copy_patch_string(const char *string, size_t length) {
+  char *copy = sea_malloc(length + 1);
+  if (copy) {
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+  }
+  return copy;
+}
+
+/* Returns 0 on success or -1, the patch is marked invalid if it could not be added */
+static int push_patch_op(seajson_patch *patch, seajson_patch_type type, const char *path, size_t pathLength, const char *value, size_t valueLength) {
+  if (!patch->isValid) {
+    return -1;
+  }
+  if (patch->count == patch->capacity) {
+    size_t newCapacity = patch->capacity ? patch->capacity * 2 : 8;
+    seajson_patch_op *newOps = sea_realloc(patch->ops, sizeof(seajson_patch_op) * newCapacity);
+    if (newOps == NULL) {
+      patch->isValid = 0;
+      return -1;
+    }
+    patch->ops = newOps;
+    patch->capacity = newCapacity;
+  }
+  seajson_patch_op *op = &patch->ops[patch->count];
+  op->type = type;
+  op->path = copy_patch_string(path, pathLength);
+  op->value = value ? copy_patch_string(value, valueLength) : NULL;
+  if (op->path == NULL || (value && op->value == NULL)) {
+    sea_free(op->path);
+    sea_free(op->value);
+    patch->isValid = 0;
+    return -1;
+  }
+  patch->count++;
+  return 0;
+}
+
+int seajson_patch_add(seajson_patch *patch, const char *path, const char *value) {
+  use_document_allocator(NULL);
+  return push_patch_op(patch, SEAJSON_PATCH_ADD, path, strlen(path), value, strlen(value));
+}
+
+int seajson_patch_replace(seajson_patch *patch, const char *path, const char *value) {
+  use_document_allocator(NULL);
+  return push_patch_op(patch, SEAJSON_PATCH_REPLACE, path, strlen(path), value, strlen(value));
+}
+
+int seajson_patch_remove(seajson_patch *patch, const char *path) {
+  use_document_allocator(NULL);
+  return push_patch_op(patch, SEAJSON_PATCH_REMOVE, path, strlen(path), NULL, 0);
+}
+
+/* patchJson is an RFC 6902 array of {"op", "path", "value"} objects, only add/remove/replace are supported */
+seajson_patch parse_seajson_patch(seajson patchJson) {
+  use_document_allocator(NULL);
+  seajson_patch patch = new_seajson_patch();
+  patch.sequential = 1;
+  size_t length = strlen(patchJson);
+  size_t pos = skip_json_whitespace(patchJson, length, 0);
+  if (pos >= length || patchJson[pos] != '[') {
+    fprintf(stderr, "SeaJSON Error: parse_seajson_patch patch is not an array\n");
+    patch.isValid = 0;
+    return patch;
+  }
+  member_scanner items;
+  member_scanner_init(&items, patchJson, length, pos);
+  while (member_scanner_next(&items)) {
+    if (patchJson[items.valueStart] != '{') {
+      fprintf(stderr, "SeaJSON Error: parse_seajson_patch operation is not an object\n");
+      patch.isValid = 0;
+      break;
+    }
+    member_scanner members;
+    member_scanner_init(&members, patchJson, length, items.valueStart);
+    int type = -1;
+    size_t pathStart = 0;
+    size_t pathEnd = 0;
+    int hasPath = 0;
+    size_t valueStart = 0;
+    size_t valueEnd = 0;
+    int hasValue = 0;
+    while (member_scanner_next(&members)) {
+      const char *key = patchJson + members.keyStart;
+      size_t keyLength = members.keyEnd - members.keyStart;
+      const char *value = patchJson + members.valueStart;
+      size_t valueLength = members.valueEnd - members.valueStart;
+      if (keyLength == 2 && memcmp(key, "op", 2) == 0) {
+        if (valueLength == 5 && memcmp(value, "\"add\"", 5) == 0) {
+          type = SEAJSON_PATCH_ADD;
+        } else if (valueLength == 8 && memcmp(value, "\"remove\"", 8) == 0) {
+          type = SEAJSON_PATCH_REMOVE;
+        } else if (valueLength == 9 && memcmp(value, "\"replace\"", 9) == 0) {
+          type = SEAJSON_PATCH_REPLACE;
+        } else {
+          fprintf(stderr, "SeaJSON Error: parse_seajson_patch unsupported op %.*s\n", (int)valueLength, value);
+          patch.isValid = 0;
+        }
+      } else if (keyLength == 4 && memcmp(key, "path", 4) == 0 && valueLength >= 2 && value[0] == '\"') {
+        pathStart = members.valueStart + 1;
+        pathEnd = members.valueEnd - 1;
+        hasPath = 1;
+      } else if (keyLength == 5 && memcmp(key, "value", 5) == 0) {
+        valueStart = members.valueStart;
+        valueEnd = members.valueEnd;
+        hasValue = 1;
+      }
+    }
+    if (!patch.isValid || members.failed) {
+      patch.isValid = 0;
+      break;
+    }
+    if (type == -1 || !hasPath || (type != SEAJSON_PATCH_REMOVE && !hasValue)) {
+      fprintf(stderr, "SeaJSON Error: parse_seajson_patch operation is missing op, path or value\n");
+      patch.isValid = 0;
+      break;
+    }
+    /* Unescaping only ever makes the path shorter */
+    char *path = sea_malloc(pathEnd - pathStart + 1);
+    long long pathLength = path ? unescape_json_string(patchJson + pathStart, pathEnd - pathStart, path, pathEnd - pathStart + 1) : -1;
+    int pushed = (pathLength >= 0 && push_patch_op(&patch, type, path, pathLength, hasValue ? patchJson + valueStart : NULL, valueEnd - valueStart) == 0);
+    sea_free(path);
+    if (!pushed) {
+      patch.isValid = 0;
+      break;
+    }
+  }
+  if (items.failed) {
+    fprintf(stderr, "SeaJSON Error: parse_seajson_patch patch is not valid json\n");
+    patch.isValid = 0;
+  }
+  return patch;
+}
+
+seajson apply_seajson_patch(seajson json, seajson_patch patch) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_APPLY_SEAJSON_PATCH);
+  use_document_allocator(json);
+  if (!patch.isValid) {
+    fprintf(stderr, "SeaJSON Error: apply_seajson_patch patch is not valid\n");
+    return NULL;
+  }
+  int error = 0;
+  seajson result;
+  if (patch.sequential && patch.count > 1) {
+    /* RFC 6902 resolves each operation against the result of the one before it, so a copy is only made when one depends on another */
+    result = json;
+    size_t applied = 0;
+    while (applied < patch.count) {
+      size_t runLength = 0;
+      seajson next = apply_patch_ops(result, NULL, patch.ops + applied, patch.count - applied, NULL, &error, &runLength);
+      if (result != json) {
+        sea_free(result);
+      }
+      result = next;
+      if (result == NULL) {
+        break;
+      }
+      applied += runLength;
+    }
+  } else {
+    result = apply_patch_ops(json, NULL, patch.ops, patch.count, NULL, &error, NULL);
+  }
+  if (result == NULL) {
+    switch (error) {
+      case PATCH_ERROR_JSON: fprintf(stderr, "SeaJSON Error: apply_seajson_patch json is not valid\n"); break;
+      case PATCH_ERROR_PATH: fprintf(stderr, "SeaJSON Error: apply_seajson_patch path not found\n"); break;
+      case PATCH_ERROR_CONFLICT: fprintf(stderr, "SeaJSON Error: apply_seajson_patch operations overlap\n"); break;
+      default: fprintf(stderr, "SeaJSON Error: apply_seajson_patch could not allocate\n"); break;
+    }
+    return NULL;
+  }
+  return adopt_document(result);
+}
+
+void free_seajson_patch(seajson_patch patch) {
+  use_document_allocator(NULL);
+  for (size_t i = 0; i < patch.count; i++) {
+    sea_free(patch.ops[i].path);
+    sea_free(patch.ops[i].value);
+  }
+  sea_free(patch.ops);
+}
+
+/* Mutable documents */
+
+/* Resizes a document, keeping its header in front of it */
+static char *resize_document(char *document, size_t size) {
+  document_header header;
+  if (!read_document_header(document, &header)) {
+    return sea_realloc(document, size);
+  }
+  if (size > SIZE_MAX - SEAJSON_DOCUMENT_OVERHEAD) {
+    return NULL;
+  }
+  documentAllocator = header.allocator;
+  usingDocumentAllocator = 1;
+  char *base = sea_realloc(document - header.offset, size + SEAJSON_DOCUMENT_OVERHEAD);
+  if (base == NULL) {
+    return NULL;
+  }
+  char *resized = document_json_start(base);
+  /* realloc kept the bytes at the old offset, which may not be lined up any more */
+  if (resized != base + header.offset) {
+    memmove(resized, base + header.offset, size);
+  }
+  write_document_header(base, resized, &header.allocator);
+  return resized;
+}
+
+/* Makes room for growth more bytes, keeping doc->slack spare when it has to reallocate */
+static int reserve_seajson_mutable(seajson_mutable *doc, size_t growth) {
+  if (doc->length + growth + 1 <= doc->capacity) {
+    return 1;
+  }
+  size_t newCapacity = doc->length + growth + 1 + doc->slack;
+  char *newJson = resize_document(doc->json, newCapacity);
+  if (newJson == NULL) {
+    return 0;
+  }
+  doc->json = newJson;
+  doc->capacity = newCapacity;
+  return 1;
+}
+
+/* Copies json into a buffer with slack extra bytes at the end */
+seajson_mutable new_seajson_mutable(seajson json, size_t slack) {
+  use_document_allocator(json);
+  seajson_mutable doc;
+  doc.length = strlen(json);
+  doc.slack = slack;
+  doc.capacity = doc.length + 1 + slack;
+  doc.json = new_document_buffer(doc.capacity);
+  doc.isValid = (doc.json != NULL);
+  if (!doc.isValid) {
+    fprintf(stderr, "SeaJSON Error: new_seajson_mutable could not allocate\n");
+    doc.capacity = 0;
+    return doc;
+  }
+  memcpy(doc.json, json, doc.length + 1);
+  return doc;
+}
+
+/* Returns 0 on success or -1 */
+int set_path_seajson_mutable(seajson_mutable *doc, const char *path, const char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_SET_PATH_SEAJSON_MUTABLE);
+  if (!doc->isValid) {
+    fprintf(stderr, "SeaJSON Error: set_path_seajson_mutable document is not valid\n");
+    return -1;
+  }
+  use_document_allocator(doc->json);
+  patch_target target;
+  int error = resolve_json_pointer(doc->json, doc->length, path, NULL, &target);
+  sea_free(target.token);
+  if (error) {
+    fprintf(stderr, "SeaJSON Error: set_path_seajson_mutable path not found\n");
+    return -1;
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_SET_PATH_SEAJSON_MUTABLE, target.valueEnd);
+  if (!target.exists) {
+    /* Not there yet, so it has to be rebuilt with the value added */
+    seajson_patch_op op;
+    op.type = SEAJSON_PATCH_ADD;
+    op.path = (char *)path;
+    op.value = (char *)value;
+    seajson added = apply_patch_ops(doc->json, NULL, &op, 1, NULL, &error, NULL);
+    if (added == NULL) {
+      fprintf(stderr, "SeaJSON Error: set_path_seajson_mutable could not add %s\n", path);
+      return -1;
+    }
+    size_t addedLength = strlen(added);
+    if (addedLength > doc->length && !reserve_seajson_mutable(doc, addedLength - doc->length)) {
+      sea_free(added);
+      fprintf(stderr, "SeaJSON Error: set_path_seajson_mutable could not allocate\n");
+      return -1;
+    }
+    memcpy(doc->json, added, addedLength + 1);
+    doc->length = addedLength;
+    sea_free(added);
+    return 0;
+  }
+  size_t valueLength = strlen(value);
+  size_t regionEnd = target.valueEnd;
+  if (target.valueStart + valueLength > regionEnd) {
+    /* Whitespace after the value is usually padding from an earlier shorter value, so use that up first */
+    regionEnd = skip_json_whitespace(doc->json, doc->length, target.valueEnd);
+    if (target.valueStart + valueLength > regionEnd) {
+      size_t growth = target.valueStart + valueLength - regionEnd;
+      if (!reserve_seajson_mutable(doc, growth)) {
+        fprintf(stderr, "SeaJSON Error: set_path_seajson_mutable could not allocate\n");
+        return -1;
+      }
+      memmove(doc->json + regionEnd + growth, doc->json + regionEnd, doc->length - regionEnd + 1);
+      doc->length += growth;
+      regionEnd += growth;
+    }
+  }
+  memcpy(doc->json + target.valueStart, value, valueLength);
+  memset(doc->json + target.valueStart + valueLength, ' ', regionEnd - target.valueStart - valueLength);
+  return 0;
+}
+
+int set_item_seajson_mutable(seajson_mutable *doc, const char *key, const char *value) {
+  use_document_allocator(doc->json);
+  char *path = pointer_for_key(key);
+  if (path == NULL) {
+    fprintf(stderr, "SeaJSON Error: set_item_seajson_mutable could not allocate\n");
+    return -1;
+  }
+  int result = set_path_seajson_mutable(doc, path, value);
+  use_document_allocator(doc->json);
+  sea_free(path);
+  return result;
+}
+
+void free_seajson_mutable(seajson_mutable doc) {
+  if (doc.json) {
+    free_json(doc.json);
+  }
+}
+
+/* jarray builder */
+
+static int reserve_jarray_builder(jarray_builder *builder, size_t extraBytes, size_t extraItems) {
+  if (!builder->isValid) {
+    return 0;
+  }
+  /* A new (or just finalized) builder has no buffer yet, the [ goes in with its first reserve */
+  int needsOpening = (builder->length == 0);
+  extraBytes += needsOpening;
+  if (builder->length + extraBytes > builder->capacity) {
+    size_t newCapacity = builder->capacity ? builder->capacity * 2 : 256;
+    while (newCapacity < builder->length + extraBytes) {
+      newCapacity *= 2;
+    }
+    char *newBuffer = sea_realloc(builder->buffer, newCapacity);
+    if (newBuffer == NULL) {
+      builder->isValid = 0;
+      return 0;
+    }
+    builder->buffer = newBuffer;
+    builder->capacity = newCapacity;
+  }
+  if (builder->itemCount + extraItems > builder->itemCapacity) {
+    size_t newItemCapacity = builder->itemCapacity ? builder->itemCapacity * 2 : 64;
+    while (newItemCapacity < builder->itemCount + extraItems) {
+      newItemCapacity *= 2;
+    }
+    size_t *newOffsets = sea_realloc(builder->itemOffsets, sizeof(size_t) * newItemCapacity);
+    if (newOffsets == NULL) {
+      builder->isValid = 0;
+      return 0;
+    }
+    builder->itemOffsets = newOffsets;
+    builder->itemCapacity = newItemCapacity;
+  }
+  if (needsOpening) {
+    builder->buffer[builder->length++] = '[';
+  }
+  return 1;
+}
+
+/* The buffer holds "[item,item,item" and only gets its ] once finalized */
+static void push_jarray_builder_item(jarray_builder *builder, const char *item, size_t itemLength) {
+  if (builder->itemCount) {
+    builder->buffer[builder->length++] = ',';
+  }
+  builder->itemOffsets[builder->itemCount++] = builder->length;
+  memcpy(builder->buffer + builder->length, item, itemLength);
+  builder->length += itemLength;
+}
+
+jarray_builder new_jarray_builder(size_t itemCapacity) {
+  use_document_allocator(NULL);
+  jarray_builder builder;
+  builder.buffer = NULL;
+  builder.length = 0;
+  builder.capacity = 0;
+  builder.itemOffsets = NULL;
+  builder.itemCount = 0;
+  builder.itemCapacity = 0;
+  builder.isValid = 1;
+  if (!reserve_jarray_builder(&builder, 256, itemCapacity)) {
+    fprintf(stderr, "SeaJSON Error: new_jarray_builder could not allocate\n");
+  }
+  return builder;
+}
+
+jarray_builder jarray_builder_from_jarray(jarray array) {
+  jarray_builder builder = new_jarray_builder(array.itemCount > 0 ? (size_t)array.itemCount : 0);
+  if (!builder.isValid) {
+    return builder;
+  }
+  if (array.isValid == 0 || array.arrayString == NULL) {
+    fprintf(stderr, "SeaJSON Error: Non-valid jarray passed into jarray_builder_from_jarray.\n");
+    builder.isValid = 0;
+    return builder;
+  }
+  size_t length = strlen(array.arrayString);
+  size_t pos = skip_json_whitespace(array.arrayString, length, 0);
+  if (pos >= length || array.arrayString[pos] != '[') {
+    fprintf(stderr, "SeaJSON Error: jarray_builder_from_jarray jarray is not an array\n");
+    builder.isValid = 0;
+    return builder;
+  }
+  member_scanner scanner;
+  member_scanner_init(&scanner, array.arrayString, length, pos);
+  while (member_scanner_next(&scanner)) {
+    size_t itemLength = scanner.valueEnd - scanner.valueStart;
+    if (!reserve_jarray_builder(&builder, itemLength + 1, 1)) {
+      break;
+    }
+    push_jarray_builder_item(&builder, array.arrayString + scanner.valueStart, itemLength);
+  }
+  if (scanner.failed) {
+    fprintf(stderr, "SeaJSON Error: jarray_builder_from_jarray jarray is not valid json\n");
+    builder.isValid = 0;
+  }
+  return builder;
+}
+
+/* Returns 0 on success or -1, the builder is marked invalid if it could not grow */
+int append_item_to_jarray_builder(jarray_builder *builder, const char *item) {
+  use_document_allocator(NULL);
+  size_t itemLength = strlen(item);
+  if (!reserve_jarray_builder(builder, itemLength + 1, 1)) {
+    fprintf(stderr, "SeaJSON Error: append_item_to_jarray_builder could not allocate\n");
+    return -1;
+  }
+  push_jarray_builder_item(builder, item, itemLength);
+  return 0;
+}
+
+int append_items_to_jarray_builder(jarray_builder *builder, const char *const *items, size_t count) {
+  use_document_allocator(NULL);
+  /* Size everything up first so a bulk append grows the buffer at most once */
+  size_t totalLength = 0;
+  for (size_t i = 0; i < count; i++) {
+    totalLength += strlen(items[i]) + 1;
+  }
+  if (!reserve_jarray_builder(builder, totalLength, count)) {
+    fprintf(stderr, "SeaJSON Error: append_items_to_jarray_builder could not allocate\n");
+    return -1;
+  }
+  for (size_t i = 0; i < count; i++) {
+    push_jarray_builder_item(builder, items[i], strlen(items[i]));
+  }
+  return 0;
+}
+
+/* Removes items index to index + count - 1, returns 0 on success or -1 if the range is out of bounds */
+int remove_items_of_jarray_builder(jarray_builder *builder, size_t index, size_t count) {
+  if (!builder->isValid || index > builder->itemCount || count > builder->itemCount - index) {
+    fprintf(stderr, "SeaJSON Error: Requested OOB range from jarray builder (remove_items_of_jarray_builder).\n");
+    return -1;
+  }
+  if (count == 0) {
+    return 0;
+  }
+  size_t cutStart;
+  size_t cutEnd;
+  if (index + count < builder->itemCount) {
+    /* Items in the middle take their trailing commas with them */
+    cutStart = builder->itemOffsets[index];
+    cutEnd = builder->itemOffsets[index + count];
+  } else {
+    /* Items at the end take the comma before them instead */
+    cutStart = index ? builder->itemOffsets[index] - 1 : builder->itemOffsets[index];
+    cutEnd = builder->length;
+  }
+  size_t cutLength = cutEnd - cutStart;
+  memmove(builder->buffer + cutStart, builder->buffer + cutEnd, builder->length - cutEnd);
+  builder->length -= cutLength;
+  for (size_t i = index + count; i < builder->itemCount; i++) {
+    builder->itemOffsets[i - count] = builder->itemOffsets[i] - cutLength;
+  }
+  builder->itemCount -= count;
+  return 0;
+}
+
+/* The jarray gets a right sized copy of the buffer, the builder is left empty */
+jarray finalize_jarray_builder(jarray_builder *builder) {
+  use_document_allocator(NULL);
+  jarray array;
+  array.itemCount = 0;
+  array.arrayString = NULL;
+  array.isValid = 0;
+  if (!builder->isValid) {
+    fprintf(stderr, "SeaJSON Error: Non-valid jarray builder passed into finalize_jarray_builder.\n");
+    return array;
+  }
+  if (!reserve_jarray_builder(builder, 0, 0)) {
+    fprintf(stderr, "SeaJSON Error: finalize_jarray_builder could not allocate\n");
+    return array;
+  }
+  char *arrayString = sea_realloc(builder->buffer, builder->length + 2);
+  if (arrayString == NULL) {
+    fprintf(stderr, "SeaJSON Error: finalize_jarray_builder could not allocate\n");
+    return array;
+  }
+  arrayString[builder->length] = ']';
+  arrayString[builder->length + 1] = '\0';
+  array.itemCount = (long long)builder->itemCount;
+  array.arrayString = arrayString;
+  array.isValid = 1;
+  sea_free(builder->itemOffsets);
+  builder->buffer = NULL;
+  builder->itemOffsets = NULL;
+  builder->length = 0;
+  builder->capacity = 0;
+  builder->itemCount = 0;
+  builder->itemCapacity = 0;
+  return array;
+}
+
+void free_jarray_builder(jarray_builder builder) {
+  use_document_allocator(NULL);
+  sea_free(builder.buffer);
+  sea_free(builder.itemOffsets);
+}
+
+/* Typed numeric arrays */
+
+typedef enum {
+  NUMERIC_ARRAY_INT32,
+  NUMERIC_ARRAY_INT64,
+  NUMERIC_ARRAY_DOUBLE
+} numeric_array_kind;
+
+/* Where parsed numbers go, a growable one reallocates instead of stopping at capacity */
+typedef struct {
+  unsigned char *items;
+  size_t capacity;
+  size_t itemSize;
+  int growable;
+} numeric_array_out;
+
+static long long read_numeric_array(seajson json, const char *key, numeric_array_kind kind, numeric_array_out *out, const char *functionName, seajson_stat_function statFunction) {
+  (void)statFunction;
+  member_scanner scanner;
+  size_t pos = find_top_level_member_terminated(json, key, &scanner) ? scanner.valueStart : SEAJSON_SCAN_FAILED;
+  if (pos == SEAJSON_SCAN_FAILED || json[pos] != '[') {
+    fprintf(stderr, "SeaJSON Error: %s could not find array %s\n", functionName, key);
+    return -1;
+  }
+  /* The items are all inside the array, so nothing past it is needed */
+  size_t length = scanner.valueEnd;
+  size_t count = 0;
+  pos = skip_json_whitespace(json, length, pos + 1);
+  if (pos < length && json[pos] == ']') {
+    return 0;
+  }
+  for (;;) {
+    json_number number;
+    size_t end = scan_json_number(json, length, pos, &number);
+    if (end == SEAJSON_SCAN_FAILED) {
+      fprintf(stderr, "SeaJSON Error: %s array %s has an item that is not a number\n", functionName, key);
+      return -1;
+    }
+    if (kind != NUMERIC_ARRAY_DOUBLE && number.isDouble) {
+      /* 1.0 and 1e3 are still whole numbers, 1.5 or anything past int64_t is not */
+      if (number.number != (double)(long long)number.integer || number.number >= 9223372036854775808.0) {
+        fprintf(stderr, "SeaJSON Error: %s array %s has an item that is not a whole number that fits\n", functionName, key);
+        return -1;
+      }
+    }
+    if (kind == NUMERIC_ARRAY_INT32 && (number.integer < INT32_MIN || number.integer > INT32_MAX)) {
+      fprintf(stderr, "SeaJSON Error: %s array %s has an item too big for int32_t\n", functionName, key);
+      return -1;
+    }
+    if (count == out->capacity && out->growable) {
+      size_t newCapacity = out->capacity ? out->capacity * 2 : 64;
+      unsigned char *newItems = sea_realloc(out->items, newCapacity * out->itemSize);
+      if (newItems == NULL) {
+        fprintf(stderr, "SeaJSON Error: %s could not allocate\n", functionName);
+        return -1;
+      }
+      out->items = newItems;
+      out->capacity = newCapacity;
+    }
+    if (count < out->capacity) {
+      if (kind == NUMERIC_ARRAY_INT32) {
+        ((int32_t *)out->items)[count] = (int32_t)number.integer;
+      } else if (kind == NUMERIC_ARRAY_INT64) {
+        ((int64_t *)out->items)[count] = (int64_t)number.integer;
+      } else {
+        ((double *)out->items)[count] = number.number;
+      }
+    }
+    count++;
+    pos = skip_json_whitespace(json, length, end);
+    if (pos < length && json[pos] == ',') {
+      pos = skip_json_whitespace(json, length, pos + 1);
+    } else if (pos < length && json[pos] == ']') {
+      break;
+    } else {
+      fprintf(stderr, "SeaJSON Error: %s array %s is not valid json\n", functionName, key);
+      return -1;
+    }
+  }
+  SEAJSON_STAT_SCANNED(statFunction, pos);
+  return (long long)count;
+}
+
+static void *read_numeric_array_alloc(seajson json, const char *key, numeric_array_kind kind, size_t itemSize, size_t *count, const char *functionName, seajson_stat_function statFunction) {
+  numeric_array_out out = { NULL, 0, itemSize, 1 };
+  long long itemCount = read_numeric_array(json, key, kind, &out, functionName, statFunction);
+  *count = 0;
+  if (itemCount < 0) {
+    sea_free(out.items);
+    return NULL;
+  }
+  /* Right size it, always at least one item so an empty array is still a valid pointer */
+  size_t finalSize = (itemCount ? (size_t)itemCount : 1) * itemSize;
+  unsigned char *items = sea_realloc(out.items, finalSize);
+  if (items == NULL) {
+    sea_free(out.items);
+    fprintf(stderr, "SeaJSON Error: %s could not allocate\n", functionName);
+    return NULL;
+  }
+  *count = (size_t)itemCount;
+  return items;
+}
+
+long long get_int32_array(seajson json, const char *key, int32_t *out, size_t capacity) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_INT32_ARRAY);
+  use_document_allocator(json);
+  numeric_array_out arrayOut = { (unsigned char *)out, capacity, sizeof(int32_t), 0 };
+  return read_numeric_array(json, key, NUMERIC_ARRAY_INT32, &arrayOut, "get_int32_array", SEAJSON_STAT_GET_INT32_ARRAY);
+}
+
+long long get_int64_array(seajson json, const char *key, int64_t *out, size_t capacity) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_INT64_ARRAY);
+  use_document_allocator(json);
+  numeric_array_out arrayOut = { (unsigned char *)out, capacity, sizeof(int64_t), 0 };
+  return read_numeric_array(json, key, NUMERIC_ARRAY_INT64, &arrayOut, "get_int64_array", SEAJSON_STAT_GET_INT64_ARRAY);
+}
+
+long long get_double_array(seajson json, const char *key, double *out, size_t capacity) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_DOUBLE_ARRAY);
+  use_document_allocator(json);
+  numeric_array_out arrayOut = { (unsigned char *)out, capacity, sizeof(double), 0 };
+  return read_numeric_array(json, key, NUMERIC_ARRAY_DOUBLE, &arrayOut, "get_double_array", SEAJSON_STAT_GET_DOUBLE_ARRAY);
+}
+
+int32_t *get_int32_array_alloc(seajson json, const char *key, size_t *count) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_INT32_ARRAY);
+  use_document_allocator(json);
+  return read_numeric_array_alloc(json, key, NUMERIC_ARRAY_INT32, sizeof(int32_t), count, "get_int32_array_alloc", SEAJSON_STAT_GET_INT32_ARRAY);
+}
+
+int64_t *get_int64_array_alloc(seajson json, const char *key, size_t *count) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_INT64_ARRAY);
+  use_document_allocator(json);
+  return read_numeric_array_alloc(json, key, NUMERIC_ARRAY_INT64, sizeof(int64_t), count, "get_int64_array_alloc", SEAJSON_STAT_GET_INT64_ARRAY);
+}
+
+double *get_double_array_alloc(seajson json, const char *key, size_t *count) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_DOUBLE_ARRAY);
+  use_document_allocator(json);
+  return read_numeric_array_alloc(json, key, NUMERIC_ARRAY_DOUBLE, sizeof(double), count, "get_double_array_alloc", SEAJSON_STAT_GET_DOUBLE_ARRAY);
+}
+
+/* Compressed input */
+
+/* Compressed bytes are read in blocks this big, so only one block of them is in memory at a time */
+#define SEAJSON_COMPRESSED_BLOCK_SIZE ((size_t)256 * 1024)
+
+enum {
+  SEAJSON_INPUT_PLAIN,
+  SEAJSON_INPUT_GZIP,
+  SEAJSON_INPUT_ZSTD
+};
+
+/* Reads json text from a file, decompressing it on the way if it starts with a gzip or zstd magic number */
+typedef struct {
+  FILE *fp;
+  int format;
+  unsigned char *block;
+  size_t blockLength;
+  size_t blockPos;
+  int inputDone;
+  /* Set while a gzip member or zstd frame has been started but not finished */
+  int midStream;
+  int failed;
+#ifdef SEAJSON_USE_ZLIB
+  z_stream gzip;
+#endif
+#ifdef SEAJSON_USE_ZSTD
+  ZSTD_DStream *zstd;
+#endif
+} compressed_reader;
+
+/* Returns 1 if there are compressed bytes left in the block, reading the next block if it ran out */
+static int fill_compressed_block(compressed_reader *reader) {
+  if (reader->blockPos < reader->blockLength) {
+    return 1;
+  }
+  if (reader->inputDone) {
+    return 0;
+  }
+  reader->blockLength = fread(reader->block, 1, SEAJSON_COMPRESSED_BLOCK_SIZE, reader->fp);
+  reader->blockPos = 0;
+  if (reader->blockLength == 0) {
+    if (ferror(reader->fp)) {
+      fprintf(stderr, "SeaJSON Error: could not read compressed input\n");
+      reader->failed = 1;
+    }
+    reader->inputDone = 1;
+    return 0;
+  }
+  return 1;
+}
+
+/* Returns 0 on success or -1 if the input is compressed with something this build can not decompress */
+static int open_compressed_reader(compressed_reader *reader, FILE *fp) {
+  memset(reader, 0, sizeof(compressed_reader));
+  reader->fp = fp;
+  reader->block = sea_malloc(SEAJSON_COMPRESSED_BLOCK_SIZE);
+  if (reader->block == NULL) {
+    fprintf(stderr, "SeaJSON Error: Memory allocation failed.\n");
+    return -1;
+  }
+  fill_compressed_block(reader);
+  const unsigned char *magic = reader->block;
+  if (reader->blockLength >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+#ifdef SEAJSON_USE_ZLIB
+    reader->format = SEAJSON_INPUT_GZIP;
+    /* 16 + MAX_WBITS only accepts gzip, not raw zlib streams */
+    if (inflateInit2(&reader->gzip, 16 + MAX_WBITS) != Z_OK) {
+      fprintf(stderr, "SeaJSON Error: could not start gzip decompression\n");
+      sea_free(reader->block);
+      return -1;
+    }
+#else
+    fprintf(stderr, "SeaJSON Error: input is gzip compressed but SeaJSON was built without SEAJSON_USE_ZLIB\n");
+    sea_free(reader->block);
+    return -1;
+#endif
+  } else if (reader->blockLength >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+#ifdef SEAJSON_USE_ZSTD
+    reader->format = SEAJSON_INPUT_ZSTD;
+    reader->zstd = ZSTD_createDStream();
+    if (reader->zstd == NULL || ZSTD_isError(ZSTD_initDStream(reader->zstd))) {
+      fprintf(stderr, "SeaJSON Error: could not start zstd decompression\n");
+      ZSTD_freeDStream(reader->zstd);
+      sea_free(reader->block);
+      return -1;
+    }
+#else
+    fprintf(stderr, "SeaJSON Error: input is zstd compressed but SeaJSON was built without SEAJSON_USE_ZSTD\n");
+    sea_free(reader->block);
+    return -1;
+#endif
+  }
+  return 0;
+}
+
+/* Fills out with up to capacity bytes of json text, returns how many or 0 once everything was read or reader->failed is set */
+static size_t compressed_reader_read(compressed_reader *reader, char *out, size_t capacity) {
+  size_t produced = 0;
+  while (produced < capacity && !reader->failed) {
+    if (reader->format == SEAJSON_INPUT_PLAIN) {
+      /* Plain input only goes through the block for the bytes that were read to check the magic number */
+      size_t count;
+      if (reader->blockPos < reader->blockLength) {
+        count = reader->blockLength - reader->blockPos;
+        if (count > capacity - produced) {
+          count = capacity - produced;
+        }
+        memcpy(out + produced, reader->block + reader->blockPos, count);
+        reader->blockPos += count;
+      } else {
+        count = fread(out + produced, 1, capacity - produced, reader->fp);
+        if (count == 0) {
+          if (ferror(reader->fp)) {
+            fprintf(stderr, "SeaJSON Error: could not read input\n");
+            reader->failed = 1;
+          }
+          break;
+        }
+      }
+      produced += count;
+      continue;
+    }
+    /* Decompressors can hold on to output after their input ran out, so they still get called with no input at the end */
+    int haveInput = fill_compressed_block(reader);
+    if (reader->failed) {
+      break;
+    }
+    size_t before = produced;
+#ifdef SEAJSON_USE_ZLIB
+    if (reader->format == SEAJSON_INPUT_GZIP) {
+      size_t available = reader->blockLength - reader->blockPos;
+      size_t room = capacity - produced;
+      if (room > UINT_MAX) {
+        room = UINT_MAX;
+      }
+      reader->gzip.next_in = reader->block + reader->blockPos;
+      reader->gzip.avail_in = (uInt)available;
+      reader->gzip.next_out = (Bytef *)out + produced;
+      reader->gzip.avail_out = (uInt)room;
+      int status = inflate(&reader->gzip, Z_NO_FLUSH);
+      reader->blockPos += available - reader->gzip.avail_in;
+      produced += room - reader->gzip.avail_out;
+      if (status == Z_STREAM_END) {
+        /* Appending to a .gz file adds another member, those just follow on from each other */
+        inflateReset(&reader->gzip);
+        reader->midStream = 0;
+      } else if (status == Z_OK) {
+        reader->midStream = 1;
+      } else if (status != Z_BUF_ERROR) {
+        fprintf(stderr, "SeaJSON Error: gzip input is corrupt\n");
+        reader->failed = 1;
+        break;
+      }
+    }
+#endif
+#ifdef SEAJSON_USE_ZSTD
+    if (reader->format == SEAJSON_INPUT_ZSTD) {
+      ZSTD_inBuffer input = { reader->block + reader->blockPos, reader->blockLength - reader->blockPos, 0 };
+      ZSTD_outBuffer output = { out + produced, capacity - produced, 0 };
+      size_t result = ZSTD_decompressStream(reader->zstd, &output, &input);
+      if (ZSTD_isError(result)) {
+        fprintf(stderr, "SeaJSON Error: zstd input is corrupt (%s)\n", ZSTD_getErrorName(result));
+        reader->failed = 1;
+        break;
+      }
+      reader->blockPos += input.pos;
+      produced += output.pos;
+      /* 0 means a frame was just finished */
+      reader->midStream = (result != 0);
+    }
+#endif
+    if (!haveInput && produced == before) {
+      if (reader->midStream) {
+        fprintf(stderr, "SeaJSON Error: compressed input ends in the middle of a stream\n");
+        reader->failed = 1;
+      }
+      break;
+    }
+  }
+  return produced;
+}
+
+static void close_compressed_reader(compressed_reader *reader) {
+#ifdef SEAJSON_USE_ZLIB
+  if (reader->format == SEAJSON_INPUT_GZIP) {
+    inflateEnd(&reader->gzip);
+  }
+#endif
+#ifdef SEAJSON_USE_ZSTD
+  if (reader->format == SEAJSON_INPUT_ZSTD) {
+    ZSTD_freeDStream(reader->zstd);
+  }
+#endif
+  sea_free(reader->block);
+}
+
+/* A guess at how big the json will be, only used for the first allocation so it does not have to be exact */
+/* The most one compressed byte can turn into: deflate tops out a little over 1032:1, zstd at one 128KB RLE block per 4 bytes */
+#define SEAJSON_MAX_DEFLATE_RATIO 1032
+#define SEAJSON_MAX_ZSTD_RATIO 32768
+
+static uint64_t decompressed_size_hint(compressed_reader *reader, uint64_t fileSize) {
+#ifdef SEAJSON_USE_ZLIB
+  /* gzip ends with the size mod 2^32 of its last member, which is the whole size for the usual single member file */
+  if (reader->format == SEAJSON_INPUT_GZIP && fileSize >= 18 && fseek(reader->fp, -4, SEEK_END) == 0) {
+    unsigned char trailer[4];
+    int haveTrailer = (fread(trailer, 1, 4, reader->fp) == 4);
+    if (fseek(reader->fp, (long)reader->blockLength, SEEK_SET) != 0) {
+      reader->failed = 1;
+    }
+    uint64_t size = (uint64_t)trailer[0] | ((uint64_t)trailer[1] << 8) | ((uint64_t)trailer[2] << 16) | ((uint64_t)trailer[3] << 24);
+    /* The trailer is only a hint, a crafted one could claim 4GB for a tiny file, so nothing past what deflate can possibly expand to is believed */
+    if (haveTrailer && size >= fileSize && size <= fileSize * SEAJSON_MAX_DEFLATE_RATIO) {
+      return size;
+    }
+  }
+#endif
+#ifdef SEAJSON_USE_ZSTD
+  if (reader->format == SEAJSON_INPUT_ZSTD) {
+    unsigned long long size = ZSTD_getFrameContentSize(reader->block, reader->blockLength);
+    if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR && size <= fileSize * SEAJSON_MAX_ZSTD_RATIO) {
+      return size;
+    }
+  }
+#endif
+  return (reader->format == SEAJSON_INPUT_PLAIN) ? fileSize : fileSize * 4;
+}
+
+seajson init_json_from_compressed_file(const char *filename, seajson_index *index) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_INIT_JSON_FROM_FILE);
+  use_document_allocator(NULL);
+  if (index) {
+    *index = new_seajson_index();
+  }
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "SeaJSON Error: Cannot find file.\n");
+    if (index) {
+      index->isValid = 0;
+    }
+    return NULL;
+  }
+  compressed_reader reader;
+  if (open_compressed_reader(&reader, fp) != 0) {
+    fclose(fp);
+    if (index) {
+      index->isValid = 0;
+    }
+    return NULL;
+  }
+  uint64_t fileSize = 0;
+  get_file_size(fp, &fileSize);
+  uint64_t hint = decompressed_size_hint(&reader, fileSize);
+  size_t capacity = (hint && hint < SIZE_MAX / 2) ? (size_t)hint + 1 : SEAJSON_COMPRESSED_BLOCK_SIZE;
+  char *json = sea_malloc(capacity);
+  if (json == NULL && capacity > SEAJSON_COMPRESSED_BLOCK_SIZE) {
+    /* A broken size hint should not stop the load */
+    capacity = SEAJSON_COMPRESSED_BLOCK_SIZE;
+    json = sea_malloc(capacity);
+  }
+  size_t length = 0;
+  int failed = (json == NULL);
+  /* Everything is decompressed straight into the document, so there is never a second copy of it */
+  while (!failed) {
+    size_t room = capacity - 1 - length;
+    if (room == 0) {
+      /* Only grow once there really is more, a right size hint should not end up doubling the document */
+      char probe;
+      if (compressed_reader_read(&reader, &probe, 1) == 0) {
+        break;
+      }
+      char *newJson = (capacity < SIZE_MAX / 2) ? sea_realloc(json, capacity * 2) : NULL;
+      if (newJson == NULL) {
+        failed = 1;
+        break;
+      }
+      json = newJson;
+      capacity *= 2;
+      json[length] = probe;
+      if (index) {
+        seajson_index_feed(index, json + length, 1);
+      }
+      length++;
+      continue;
+    }
+    if (room > SEAJSON_READ_CHUNK_SIZE) {
+      room = SEAJSON_READ_CHUNK_SIZE;
+    }
+    size_t produced = compressed_reader_read(&reader, json + length, room);
+    if (produced == 0) {
+      break;
+    }
+    if (index) {
+      seajson_index_feed(index, json + length, produced);
+    }
+    length += produced;
+  }
+  failed |= reader.failed;
+  close_compressed_reader(&reader);
+  fclose(fp);
+  if (failed) {
+    fprintf(stderr, "SeaJSON Error: init_json_from_compressed_file could not load %s\n", filename);
+    sea_free(json);
+    if (index) {
+      seajson_index_finish(index);
+      index->isValid = 0;
+    }
+    return NULL;
+  }
+  if (capacity > length + 1) {
+    char *shrunk = sea_realloc(json, length + 1);
+    if (shrunk) {
+      json = shrunk;
+    }
+  }
+  json[length] = '\0';
+  if (index) {
+    seajson_index_finish(index);
+  }
+  return json;
+}
+
+/* JSON Lines projection */
+
+/* A JSON Pointer split into unescaped tokens, and where it was found in the current record */
+typedef struct {
+  char *storage;
+  char **tokens;
+  size_t *tokenLengths;
+  size_t tokenCount;
+  size_t valueStart;
+  size_t valueEnd;
+  int found;
+} projection_path;
+
+static int compile_projection_path(const char *path, projection_path *compiled) {
+  size_t pathLength = strlen(path);
+  compiled->tokenCount = 0;
+  for (size_t i = 0; i < pathLength; i++) {
+    if (path[i] == '/') {
+      compiled->tokenCount++;
+    }
+  }
+  compiled->storage = sea_malloc(pathLength + 1);
+  compiled->tokens = sea_malloc(sizeof(char *) * (compiled->tokenCount + 1));
+  compiled->tokenLengths = sea_malloc(sizeof(size_t) * (compiled->tokenCount + 1));
+  if (compiled->storage == NULL || compiled->tokens == NULL || compiled->tokenLengths == NULL) {
+    return 0;
+  }
+  if (pathLength && path[0] != '/') {
+    return 0;
+  }
+  size_t tokenIndex = 0;
+  size_t storageLength = 0;
+  for (size_t i = 0; i < pathLength;) {
+    /* path[i] is the / in front of a token */
+    i++;
+    compiled->tokens[tokenIndex] = compiled->storage + storageLength;
+    size_t tokenStart = storageLength;
+    while (i < pathLength && path[i] != '/') {
+      if (path[i] == '~' && path[i + 1] == '1') {
+        compiled->storage[storageLength++] = '/';
+        i += 2;
+      } else if (path[i] == '~' && path[i + 1] == '0') {
+        compiled->storage[storageLength++] = '~';
+        i += 2;
+      } else {
+        compiled->storage[storageLength++] = path[i++];
+      }
+    }
+    compiled->tokenLengths[tokenIndex++] = storageLength - tokenStart;
+  }
+  return 1;
+}
+
+static void free_projection_path(projection_path *compiled) {
+  sea_free(compiled->storage);
+  sea_free(compiled->tokens);
+  sea_free(compiled->tokenLengths);
+}
+
+/*
+ * Walks the container at pos once, only going into members that are on
+ * the way to one of the active paths. Returns how many paths it found,
+ * or -1 if the record is not valid json.
+ */
+static long long find_projection_paths(const char *json, size_t length, size_t pos, size_t depth, projection_path **active, size_t activeCount) {
+  member_scanner scanner;
+  member_scanner_init(&scanner, json, length, pos);
+  long long foundCount = 0;
+  size_t index = 0;
+  projection_path *stackMatched[16];
+  projection_path **matched = (activeCount <= 16) ? stackMatched : sea_malloc(sizeof(projection_path *) * activeCount);
+  if (matched == NULL) {
+    return -1;
+  }
+  while ((size_t)foundCount < activeCount && member_scanner_next(&scanner)) {
+    size_t matchedCount = 0;
+    for (size_t i = 0; i < activeCount; i++) {
+      projection_path *path = active[i];
+      if (path->found) {
+        continue;
+      }
+      const char *token = path->tokens[depth];
+      size_t tokenLength = path->tokenLengths[depth];
+      int isMatch;
+      if (scanner.isObject) {
+        isMatch = json_key_equals(json, scanner.keyStart, scanner.keyEnd, token, tokenLength);
+      } else {
+        isMatch = (parse_pointer_index(token, tokenLength) == index);
+      }
+      if (!isMatch) {
+        continue;
+      }
+      if (path->tokenCount == depth + 1) {
+        path->found = 1;
+        path->valueStart = scanner.valueStart;
+        path->valueEnd = scanner.valueEnd;
+        foundCount++;
+      } else {
+        matched[matchedCount++] = path;
+      }
+    }
+    char open = json[scanner.valueStart];
+    if (matchedCount && (open == '{' || open == '[')) {
+      long long nestedCount = find_projection_paths(json, length, scanner.valueStart, depth + 1, matched, matchedCount);
+      if (nestedCount < 0) {
+        foundCount = -1;
+        break;
+      }
+      foundCount += nestedCount;
+    }
+    index++;
+  }
+  if (scanner.failed) {
+    foundCount = -1;
+  }
+  if (matched != stackMatched) {
+    sea_free(matched);
+  }
+  return foundCount;
+}
+
+/* Raw json text of a value without any whitespace around it */
+static int projection_value_equals(const char *value, size_t valueLength, const char *expected) {
+  size_t start = 0;
+  size_t end = strlen(expected);
+  while (start < end && isspace((unsigned char)expected[start])) {
+    start++;
+  }
+  while (end > start && isspace((unsigned char)expected[end - 1])) {
+    end--;
+  }
+  return valueLength == end - start && memcmp(value, expected + start, valueLength) == 0;
+}
+
+/* Projects one record into out, returns 1 if it was written, 0 if it was skipped or -1 if it is broken */
+static int project_record(const char *line, size_t lineLength, const seajson_projection *projection, projection_path *paths, projection_path **active, byte_buffer *out) {
+  size_t pathCount = projection->fieldCount + projection->matchCount;
+  size_t pos = skip_json_whitespace(line, lineLength, 0);
+  if (pos >= lineLength) {
+    return 0;
+  }
+  size_t activeCount = 0;
+  for (size_t i = 0; i < pathCount; i++) {
+    paths[i].found = 0;
+    if (paths[i].tokenCount == 0) {
+      /* "" is the whole record */
+      paths[i].found = 1;
+      paths[i].valueStart = pos;
+      paths[i].valueEnd = skip_json_value(line, lineLength, pos);
+      if (paths[i].valueEnd == SEAJSON_SCAN_FAILED) {
+        return -1;
+      }
+    } else {
+      active[activeCount++] = &paths[i];
+    }
+  }
+  if (activeCount && (line[pos] == '{' || line[pos] == '[') && find_projection_paths(line, lineLength, pos, 0, active, activeCount) < 0) {
+    return -1;
+  }
+  for (size_t i = 0; i < projection->matchCount; i++) {
+    projection_path *path = &paths[projection->fieldCount + i];
+    if (!path->found || !projection_value_equals(line + path->valueStart, path->valueEnd - path->valueStart, projection->matches[i].value)) {
+      return 0;
+    }
+  }
+  int wroteField = 0;
+  byte_buffer_push(out, '{');
+  for (size_t i = 0; i < projection->fieldCount; i++) {
+    projection_path *path = &paths[i];
+    if (!path->found) {
+      continue;
+    }
+    if (wroteField) {
+      byte_buffer_push(out, ',');
+    }
+    const char *name = projection->fields[i].name;
+    if (name) {
+      write_escaped_json_string(out, name, strlen(name));
+    } else if (path->tokenCount) {
+      write_escaped_json_string(out, path->tokens[path->tokenCount - 1], path->tokenLengths[path->tokenCount - 1]);
+    } else {
+      write_escaped_json_string(out, "", 0);
+    }
+    byte_buffer_push(out, ':');
+    byte_buffer_append(out, line + path->valueStart, path->valueEnd - path->valueStart);
+    wroteField = 1;
+  }
+  byte_buffer_append(out, "}\n", 2);
+  return 1;
+}
+
+long long project_seajson_lines(FILE *in, FILE *out, const seajson_projection *projection) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_PROJECT_SEAJSON_LINES);
+  use_document_allocator(NULL);
+  size_t pathCount = projection->fieldCount + projection->matchCount;
+  projection_path *paths = sea_malloc(sizeof(projection_path) * (pathCount ? pathCount : 1));
+  projection_path **active = sea_malloc(sizeof(projection_path *) * (pathCount ? pathCount : 1));
+  size_t compiledCount = 0;
+  long long written = -1;
+  byte_buffer input = { NULL, 0, 0, 0 };
+  byte_buffer output = { NULL, 0, 0, 0 };
+  if (paths == NULL || active == NULL) {
+    fprintf(stderr, "SeaJSON Error: project_seajson_lines could not allocate\n");
+    goto done;
+  }
+  for (; compiledCount < pathCount; compiledCount++) {
+    const char *path = (compiledCount < projection->fieldCount) ? projection->fields[compiledCount].path : projection->matches[compiledCount - projection->fieldCount].path;
+    if (!compile_projection_path(path, &paths[compiledCount])) {
+      fprintf(stderr, "SeaJSON Error: project_seajson_lines path %s is not a valid JSON Pointer\n", path);
+      compiledCount++;
+      goto done;
+    }
+  }
+  compressed_reader reader;
+  if (open_compressed_reader(&reader, in) != 0) {
+    goto done;
+  }
+  written = 0;
+  size_t lineStart = 0;
+  int atEnd = 0;
+  while (!atEnd) {
+    /* Read in big blocks, a partial line at the end of a block is moved to the front and finished by the next one */
+    if (lineStart) {
+      memmove(input.data, input.data + lineStart, input.length - lineStart);
+      input.length -= lineStart;
+      lineStart = 0;
+    }
+    if (!byte_buffer_reserve(&input, 65536)) {
+      fprintf(stderr, "SeaJSON Error: project_seajson_lines could not allocate\n");
+      written = -1;
+      break;
+    }
+    size_t readCount = compressed_reader_read(&reader, (char *)input.data + input.length, input.capacity - input.length);
+    input.length += readCount;
+    if (readCount == 0) {
+      if (reader.failed) {
+        fprintf(stderr, "SeaJSON Error: project_seajson_lines could not read input\n");
+        written = -1;
+        break;
+      }
+      atEnd = 1;
+    }
+    for (;;) {
+      const char *lineData = (const char *)input.data + lineStart;
+      size_t available = input.length - lineStart;
+      const char *newline = memchr(lineData, '\n', available);
+      if (newline == NULL && !(atEnd && available)) {
+        break;
+      }
+      size_t lineLength = newline ? (size_t)(newline - lineData) : available;
+      SEAJSON_STAT_SCANNED(SEAJSON_STAT_PROJECT_SEAJSON_LINES, lineLength + 1);
+      int result = project_record(lineData, lineLength, projection, paths, active, &output);
+      if (result < 0) {
+        fprintf(stderr, "SeaJSON Error: project_seajson_lines skipped a record that is not valid json\n");
+      } else {
+        written += result;
+      }
+      lineStart += newline ? lineLength + 1 : lineLength;
+    }
+    if (output.failed) {
+      fprintf(stderr, "SeaJSON Error: project_seajson_lines could not allocate\n");
+      written = -1;
+      break;
+    }
+    if (output.length && fwrite(output.data, 1, output.length, out) != output.length) {
+      fprintf(stderr, "SeaJSON Error: project_seajson_lines could not write output\n");
+      written = -1;
+      break;
+    }
+    output.length = 0;
+  }
+  close_compressed_reader(&reader);
+done:
+  for (size_t i = 0; i < compiledCount; i++) {
+    free_projection_path(&paths[i]);
+  }
+  sea_free(paths);
+  sea_free(active);
+  sea_free(input.data);
+  sea_free(output.data);
+  return written;
+}
+
+/* Indexing */
+
+/*
+ * Content hashes are polynomial over every byte except whitespace between
+ * tokens, so the hash of a range can be worked out from the running hash
+ * of the whole document at its start and end without reading it again.
+ */
+#define SEAJSON_HASH_MULTIPLIER 0x100000001b3ULL
+
+static uint64_t hash_multiplier_power(uint64_t exponent) {
+  uint64_t result = 1;
+  uint64_t base = SEAJSON_HASH_MULTIPLIER;
+  while (exponent) {
+    if (exponent & 1) {
+      result *= base;
+    }
+    base *= base;
+    exponent >>= 1;
+  }
+  return result;
+}
+
+/* Hash and hashed byte count of json[start, end), which has to start outside of a string */
+static uint64_t hash_json_range(const char *json, size_t start, size_t end, uint64_t *count) {
+  uint64_t hash = 0;
+  uint64_t hashed = 0;
+  int inString = 0;
+  int escaped = 0;
+  for (size_t i = start; i < end; i++) {
+    char currentChar = json[i];
+    if (inString) {
+      if (escaped) {
+        escaped = 0;
+      } else if (currentChar == '\\') {
+        escaped = 1;
+      } else if (currentChar == '\"') {
+        inString = 0;
+      }
+    } else if (is_json_whitespace(currentChar)) {
+      continue;
+    } else if (currentChar == '\"') {
+      inString = 1;
+    }
+    hash = hash * SEAJSON_HASH_MULTIPLIER + (unsigned char)currentChar;
+    hashed++;
+  }
+  *count = hashed;
+  return hash;
+}
+
+/* Same hash the index gives the container, for a value that was not indexed */
+static uint64_t hash_json_value(const char *json, size_t length) {
+  uint64_t count;
+  return hash_json_range(json, 0, length, &count);
+}
+
+seajson_index new_seajson_index(void) {
+  seajson_index index;
+  index.containers = NULL;
+  index.containerCount = 0;
+  index.containerCapacity = 0;
+  index.openContainers = NULL;
+  index.depth = 0;
+  index.openCapacity = 0;
+  index.length = 0;
+  index.runningHash = 0;
+  index.hashedBytes = 0;
+  index.inString = 0;
+  index.escaped = 0;
+  index.hashContents = 0;
+  index.isValid = 1;
+  return index;
+}
+
+seajson_index new_seajson_index_hashed(void) {
+  seajson_index index = new_seajson_index();
+  index.hashContents = 1;
+  return index;
+}
+
+static int open_indexed_container(seajson_index *index, uint64_t pos) {
+  if (index->containerCount == index->containerCapacity) {
+    uint64_t newCapacity = index->containerCapacity ? index->containerCapacity * 2 : 256;
+    seajson_index_container *newContainers = sea_realloc(index->containers, sizeof(seajson_index_container) * newCapacity);
+    if (newContainers == NULL) {
+      return 0;
+    }
+    index->containers = newContainers;
+    index->containerCapacity = newCapacity;
+  }
+  if (index->depth == index->openCapacity) {
+    uint64_t newCapacity = index->openCapacity ? index->openCapacity * 2 : 64;
+    uint64_t *newOpen = sea_realloc(index->openContainers, sizeof(uint64_t) * newCapacity);
+    if (newOpen == NULL) {
+      return 0;
+    }
+    index->openContainers = newOpen;
+    index->openCapacity = newCapacity;
+  }
+  seajson_index_container *container = &index->containers[index->containerCount];
+  container->start = pos;
+  container->end = 0;
+  /* While it is open, hash and after hold the running hash and hashed byte count from before its { */
+  container->after = index->hashedBytes;
+  container->hash = index->runningHash;
+  container->hashedBytes = 0;
+  index->openContainers[index->depth++] = index->containerCount++;
+  return 1;
+}
+
+/* pos is the } or ], returns 0 (with the index marked invalid) if there is nothing open for it to close */
+static int close_indexed_container(seajson_index *index, uint64_t pos, char closeChar) {
+  if (index->depth == 0) {
+    fprintf(stderr, "SeaJSON Error: seajson_index_feed found a %c that closes nothing\n", closeChar);
+    index->isValid = 0;
+    return 0;
+  }
+  seajson_index_container *container = &index->containers[index->openContainers[--index->depth]];
+  container->end = pos + 1;
+  if (index->hashContents) {
+    index->runningHash = index->runningHash * SEAJSON_HASH_MULTIPLIER + (unsigned char)closeChar;
+    index->hashedBytes++;
+    container->hashedBytes = index->hashedBytes - container->after;
+    container->hash = index->runningHash - container->hash * hash_multiplier_power(container->hashedBytes);
+  }
+  container->after = index->containerCount;
+  return 1;
+}
+
+/* chunk carries on right where the last one stopped, so a string or escape can be split between them */
+int seajson_index_feed(seajson_index *index, const char *chunk, size_t length) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_SEAJSON_INDEX_FEED);
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_SEAJSON_INDEX_FEED, length);
+  use_document_allocator(NULL);
+  if (!index->isValid) {
+    return -1;
+  }
+  int inString = index->inString;
+  int escaped = index->escaped;
+  int hashContents = index->hashContents;
+  uint64_t base = index->length;
+  size_t i = 0;
+#ifdef SEAJSON_X86_KERNELS
+  const seajson_kernel *kernel = current_kernel();
+  if (!hashContents && kernel->classify) {
+    /* 64 bytes at a time, only visiting the quotes, backslashes and brackets the kernel found in them */
+    for (; i + 64 <= length; i += 64) {
+      seajson_block_masks masks;
+      kernel->classify(chunk + i, &masks);
+      uint64_t bits = masks.quotes | masks.backslashes | masks.brackets;
+      if (escaped) {
+        bits &= ~(uint64_t)1;
+        escaped = 0;
+      }
+      while (bits) {
+        unsigned int bit = (unsigned int)__builtin_ctzll(bits);
+        bits &= bits - 1;
+        char currentChar = chunk[i + bit];
+        if (inString) {
+          if (currentChar == '\\') {
+            /* Whatever is escaped is skipped, even if it is in the next block */
+            if (bit == 63) {
+              escaped = 1;
+            } else {
+              bits &= ~((uint64_t)1 << (bit + 1));
+            }
+          } else if (currentChar == '\"') {
+            inString = 0;
+          }
+        } else if (currentChar == '\"') {
+          inString = 1;
+        } else if (currentChar == '{' || currentChar == '[') {
+          if (!open_indexed_container(index, base + i + bit)) {
+            fprintf(stderr, "SeaJSON Error: seajson_index_feed could not allocate\n");
+            index->isValid = 0;
+            return -1;
+          }
+        } else if (currentChar == '}' || currentChar == ']') {
+          if (!close_indexed_container(index, base + i + bit, currentChar)) {
+            return -1;
+          }
+        }
+      }
+    }
+  }
+#endif
+  for (; i < length; i++) {
+    if (!hashContents && !escaped) {
+      /* Without hashing only quotes, escapes and brackets matter, so jump straight to the next one */
+      i += find_byte_of(chunk + i, length - i, inString ? &stringChars : &structuralChars);
+      if (i >= length) {
+        break;
+      }
+    }
+    char currentChar = chunk[i];
+    if (inString) {
+      if (escaped) {
+        escaped = 0;
+      } else if (currentChar == '\\') {
+        escaped = 1;
+      } else if (currentChar == '\"') {
+        inString = 0;
+      }
+    } else if (currentChar == '\"') {
+      inString = 1;
+    } else if (currentChar == '{' || currentChar == '[') {
+      if (!open_indexed_container(index, base + i)) {
+        fprintf(stderr, "SeaJSON Error: seajson_index_feed could not allocate\n");
+        index->isValid = 0;
+        return -1;
+      }
+    } else if (currentChar == '}' || currentChar == ']') {
+      if (!close_indexed_container(index, base + i, currentChar)) {
+        return -1;
+      }
+      continue;
+    } else if (is_json_whitespace(currentChar)) {
+      continue;
+    }
+    if (hashContents) {
+      index->runningHash = index->runningHash * SEAJSON_HASH_MULTIPLIER + (unsigned char)currentChar;
+      index->hashedBytes++;
+    }
+  }
+  index->inString = inString;
+  index->escaped = escaped;
+  index->length += length;
+  return 0;
+}
+
+int seajson_index_finish(seajson_index *index) {
+  if (!index->isValid || index->inString || index->depth != 0) {
+    index->isValid = 0;
+    return -1;
+  }
+  /* Nothing is opened from here on, so the stack is not needed anymore */
+  use_document_allocator(NULL);
+  sea_free(index->openContainers);
+  index->openContainers = NULL;
+  index->openCapacity = 0;
+  return 0;
+}
+
+/* Indexes a document already in memory, in bounded chunks so it never needs to know the length up front */
+static seajson_index index_json_chunks(seajson json, seajson_index index) {
+  const char *chunk = json;
+  for (;;) {
+    size_t chunkLength = strnlen(chunk, SEAJSON_READ_CHUNK_SIZE);
+    if (seajson_index_feed(&index, chunk, chunkLength) != 0 || chunkLength < SEAJSON_READ_CHUNK_SIZE) {
+      break;
+    }
+    chunk += chunkLength;
+  }
+  seajson_index_finish(&index);
+  return index;
+}
+
+seajson_index index_seajson(seajson json) {
+  return index_json_chunks(json, new_seajson_index());
+}
+
+seajson_index index_seajson_hashed(seajson json) {
+  return index_json_chunks(json, new_seajson_index_hashed());
+}
+
+seajson init_json_from_file_indexed(const char *filename, seajson_index *index) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_INIT_JSON_FROM_FILE);
+  *index = new_seajson_index();
+  use_document_allocator(NULL);
+  seajson json = read_json_file(filename, index);
+  seajson_index_finish(index);
+  return json;
+}
+
+int get_value_indexed(seajson json, const seajson_index *index, const char *path, uint64_t *valueStart, uint64_t *valueEnd) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_VALUE_INDEXED);
+  use_document_allocator(json);
+  if (!index->isValid) {
+    fprintf(stderr, "SeaJSON Error: get_value_indexed index is not valid\n");
+    return -1;
+  }
+  /* The index knows how long the document is, so there is no need to read all of it for that */
+  patch_target target;
+  int error = resolve_json_pointer(json, (size_t)index->length, path, index, &target);
+  sea_free(target.token);
+  if (error || !target.exists) {
+    return -1;
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_VALUE_INDEXED, target.valueEnd - target.valueStart);
+  *valueStart = target.valueStart;
+  *valueEnd = target.valueEnd;
+  return 0;
+}
+
+/* Incremental reindexing */
+
+/* First container starting at or after pos */
+static uint64_t lower_bound_container(const seajson_index *index, uint64_t pos) {
+  uint64_t low = 0;
+  uint64_t high = index->containerCount;
+  while (low < high) {
+    uint64_t middle = low + (high - low) / 2;
+    if (index->containers[middle].start < pos) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/* Hash of json[pos, end) like hash_json_range, but the containers in it (the first one being child) are taken from the index instead of read again */
+static uint64_t hash_index_range(const seajson_index *index, const char *json, uint64_t pos, uint64_t end, uint64_t child, uint64_t *count) {
+  uint64_t hash = 0;
+  uint64_t hashed = 0;
+  while (child < index->containerCount && index->containers[child].start < end) {
+    const seajson_index_container *container = &index->containers[child];
+    uint64_t runCount;
+    uint64_t runHash = hash_json_range(json, pos, container->start, &runCount);
+    hash = hash * hash_multiplier_power(runCount) + runHash;
+    hash = hash * hash_multiplier_power(container->hashedBytes) + container->hash;
+    hashed += runCount + container->hashedBytes;
+    pos = container->end;
+    child = container->after;
+  }
+  uint64_t runCount;
+  uint64_t runHash = hash_json_range(json, pos, end, &runCount);
+  *count = hashed + runCount;
+  return hash * hash_multiplier_power(runCount) + runHash;
+}
+
+/* Hashes of the containers around an edit (given outermost first) are worked out again innermost first, so each one can use the new hash of the one inside of it */
+static void rehash_enclosing_containers(seajson_index *index, const char *json, const uint64_t *enclosing, size_t enclosingCount) {
+  for (size_t i = enclosingCount; i > 0; i--) {
+    seajson_index_container *container = &index->containers[enclosing[i - 1]];
+    container->hash = hash_index_range(index, json, container->start, container->end, enclosing[i - 1] + 1, &container->hashedBytes);
+  }
+  /* The running hash is over the whole document, as if it had all just been fed */
+  index->runningHash = hash_index_range(index, json, 0, index->length, 0, &index->hashedBytes);
+}
+
+/* Returns 0, or -1 if the edit does not line up with the containers (a bracket only on one side of it) and needs a full reindex */
+static int splice_index(seajson_index *index, seajson json, uint64_t start, uint64_t oldEnd, uint64_t newEnd) {
+  uint64_t first = lower_bound_container(index, start);
+  uint64_t last = lower_bound_container(index, oldEnd);
+  for (uint64_t i = first; i < last; i++) {
+    if (index->containers[i].end > oldEnd) {
+      return -1;
+    }
+  }
+  seajson_index inserted = index->hashContents ? new_seajson_index_hashed() : new_seajson_index();
+  if (seajson_index_feed(&inserted, json + start, (size_t)(newEnd - start)) != 0 || seajson_index_finish(&inserted) != 0) {
+    free_seajson_index(inserted);
+    return -1;
+  }
+  /* Walk down from the root to the edit: containers that closed before it are skipped with everything in them, the ones still open at it enclose it */
+  uint64_t *enclosing = NULL;
+  size_t enclosingCount = 0;
+  size_t enclosingCapacity = 0;
+  int result = -1;
+  uint64_t walk = 0;
+  while (walk < first) {
+    seajson_index_container *container = &index->containers[walk];
+    if (container->end <= start) {
+      walk = container->after;
+      continue;
+    }
+    if (container->end <= oldEnd) {
+      goto done;
+    }
+    if (enclosingCount == enclosingCapacity) {
+      size_t newCapacity = enclosingCapacity ? enclosingCapacity * 2 : 16;
+      uint64_t *newEnclosing = sea_realloc(enclosing, sizeof(uint64_t) * newCapacity);
+      if (newEnclosing == NULL) {
+        goto done;
+      }
+      enclosing = newEnclosing;
+      enclosingCapacity = newCapacity;
+    }
+    enclosing[enclosingCount++] = walk;
+    walk++;
+  }
+  uint64_t removedCount = last - first;
+  uint64_t newCount = index->containerCount - removedCount + inserted.containerCount;
+  if (newCount > index->containerCapacity) {
+    seajson_index_container *newContainers = sea_realloc(index->containers, sizeof(seajson_index_container) * newCount);
+    if (newContainers == NULL) {
+      goto done;
+    }
+    index->containers = newContainers;
+    index->containerCapacity = newCount;
+  }
+  int64_t shift = (int64_t)newEnd - (int64_t)oldEnd;
+  int64_t countShift = (int64_t)inserted.containerCount - (int64_t)removedCount;
+  memmove(&index->containers[first + inserted.containerCount], &index->containers[last], sizeof(seajson_index_container) * (size_t)(index->containerCount - last));
+  for (uint64_t i = first + inserted.containerCount; i < newCount; i++) {
+    index->containers[i].start += shift;
+    index->containers[i].end += shift;
+    index->containers[i].after += countShift;
+  }
+  for (uint64_t i = 0; i < inserted.containerCount; i++) {
+    seajson_index_container *container = &index->containers[first + i];
+    *container = inserted.containers[i];
+    container->start += start;
+    container->end += start;
+    container->after += first;
+  }
+  for (size_t i = 0; i < enclosingCount; i++) {
+    index->containers[enclosing[i]].end += shift;
+    index->containers[enclosing[i]].after += countShift;
+  }
+  index->containerCount = newCount;
+  index->length += shift;
+  if (index->hashContents) {
+    rehash_enclosing_containers(index, json, enclosing, enclosingCount);
+  }
+  result = 0;
+done:
+  use_document_allocator(NULL);
+  sea_free(enclosing);
+  free_seajson_index(inserted);
+  return result;
+}
+
+int seajson_index_splice(seajson_index *index, seajson json, uint64_t start, uint64_t oldEnd, uint64_t newEnd) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_SEAJSON_INDEX_SPLICE);
+  use_document_allocator(NULL);
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_SEAJSON_INDEX_SPLICE, newEnd - start);
+  if (index->isValid && index->depth == 0 && start <= oldEnd && oldEnd <= index->length && start <= newEnd && splice_index(index, json, start, oldEnd, newEnd) == 0) {
+    return 0;
+  }
+  seajson_index rebuilt = index->hashContents ? index_seajson_hashed(json) : index_seajson(json);
+  free_seajson_index(*index);
+  *index = rebuilt;
+  return rebuilt.isValid ? 0 : -1;
+}
+
+/* Applies op using index to find its way, then brings index up to date with the result */
+static seajson apply_patch_op_indexed(seajson json, seajson_index *index, seajson_patch_op *op, const char *functionName) {
+  if (op->path == NULL) {
+    fprintf(stderr, "SeaJSON Error: %s could not allocate\n", functionName);
+    return NULL;
+  }
+  int error;
+  edit_range changed;
+  seajson result = apply_patch_ops(json, index->isValid ? index : NULL, op, 1, &changed, &error, NULL);
+  sea_free(op->path);
+  if (result == NULL) {
+    return NULL;
+  }
+  seajson_index_splice(index, result, changed.start, changed.oldEnd, changed.newEnd);
+  return adopt_document(result);
+}
+
+seajson set_item_seajson_indexed(seajson json, seajson_index *index, const char *key, const char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_SET_ITEM_SEAJSON);
+  use_document_allocator(json);
+  seajson_patch_op op;
+  op.type = SEAJSON_PATCH_ADD;
+  op.path = pointer_for_key(key);
+  op.value = (char *)value;
+  return apply_patch_op_indexed(json, index, &op, "set_item_seajson_indexed");
+}
+
+seajson add_item_seajson_indexed(seajson json, seajson_index *index, const char *key, const char *value) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_ADD_ITEM_SEAJSON);
+  /* add_item_seajson puts the member right before the closing } of the root, so that is the only part that changed */
+  size_t jsonLength = index->isValid ? (size_t)index->length : strlen(json);
+  int needsComma;
+  size_t closePos = find_add_item_position(json, jsonLength, &needsComma);
+  seajson result = add_item_seajson(json, (char *)key, (char *)value);
+  if (result == NULL) {
+    return NULL;
+  }
+  size_t addedLength = strlen(key) + strlen(value) + needsComma + 3;
+  seajson_index_splice(index, result, closePos, closePos, closePos + addedLength);
+  return result;
+}
+
+seajson remove_item_seajson_indexed(seajson json, seajson_index *index, const char *key) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_REMOVE_ITEM_SEAJSON);
+  use_document_allocator(json);
+  seajson_patch_op op;
+  op.type = SEAJSON_PATCH_REMOVE;
+  op.path = pointer_for_key(key);
+  op.value = NULL;
+  return apply_patch_op_indexed(json, index, &op, "remove_item_seajson_indexed");
+}
+
+void free_seajson_index(seajson_index index) {
+  use_document_allocator(NULL);
+  sea_free(index.containers);
+  sea_free(index.openContainers);
+}
+
+/* Async loading */
+
+/* Smaller than SEAJSON_READ_CHUNK_SIZE so indexing can start soon after the first read lands */
+#define SEAJSON_ASYNC_CHUNK_SIZE ((size_t)4 * 1024 * 1024)
+#define SEAJSON_ASYNC_QUEUE_DEPTH 8
+
+struct seajson_load {
+  char *filename;
+  seajson_load_callback callback;
+  void *context;
+  seajson json;
+  seajson_index index;
+  uint64_t size;
+#ifndef _WIN32
+  int fd;
+#endif
+  seajson_thread thread;
+  /* Shared between the reader, the indexer and whoever is waiting */
+  seajson_mutex lock;
+  seajson_cond progress;
+  uint64_t bytesRead;
+  int readDone;
+  int failed;
+  int done;
+};
+
+static size_t async_chunk_size(const seajson_load *load, uint64_t chunk) {
+  uint64_t offset = chunk * SEAJSON_ASYNC_CHUNK_SIZE;
+  return (load->size - offset < SEAJSON_ASYNC_CHUNK_SIZE) ? (size_t)(load->size - offset) : SEAJSON_ASYNC_CHUNK_SIZE;
+}
+
+#ifndef _WIN32
+static void *async_reader_main(void *argument) {
+  seajson_load *load = argument;
+  uint64_t offset = 0;
+  int failed = 0;
+  while (offset < load->size) {
+    ssize_t chunkRead = pread(load->fd, load->json + offset, async_chunk_size(load, offset / SEAJSON_ASYNC_CHUNK_SIZE), (off_t)offset);
+    if (chunkRead <= 0) {
+      failed = 1;
+      break;
+    }
+    offset += (uint64_t)chunkRead;
+    seajson_mutex_lock(&load->lock);
+    load->bytesRead = offset;
+    seajson_cond_broadcast(&load->progress);
+    seajson_mutex_unlock(&load->lock);
+  }
+  seajson_mutex_lock(&load->lock);
+  load->failed |= failed;
+  load->readDone = 1;
+  seajson_cond_broadcast(&load->progress);
+  seajson_mutex_unlock(&load->lock);
+  return NULL;
+}
+
+/* A reader thread keeps reading while this thread indexes whatever it has finished so far */
+static int async_read_threaded(seajson_load *load) {
+  seajson_thread reader;
+  int threaded = seajson_thread_start(&reader, async_reader_main, load);
+  if (!threaded) {
+    /* No second thread, so read it all first and index after */
+    async_reader_main(load);
+  }
+  uint64_t indexed = 0;
+  for (;;) {
+    seajson_mutex_lock(&load->lock);
+    while (load->bytesRead == indexed && !load->readDone) {
+      seajson_cond_wait(&load->progress, &load->lock);
+    }
+    uint64_t available = load->bytesRead;
+    int finished = load->readDone;
+    seajson_mutex_unlock(&load->lock);
+    if (available > indexed) {
+      seajson_index_feed(&load->index, load->json + indexed, (size_t)(available - indexed));
+      indexed = available;
+    }
+    if (finished) {
+      break;
+    }
+  }
+  if (threaded) {
+    seajson_thread_join(reader);
+  }
+  return !load->failed;
+}
+#endif
+
+#ifdef SEAJSON_USE_IO_URING
+static int submit_async_read(struct io_uring *ring, seajson_load *load, uint64_t chunk, size_t filled) {
+  struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+  if (sqe == NULL) {
+    return 0;
+  }
+  uint64_t offset = chunk * SEAJSON_ASYNC_CHUNK_SIZE + filled;
+  io_uring_prep_read(sqe, load->fd, load->json + offset, (unsigned)(async_chunk_size(load, chunk) - filled), offset);
+  io_uring_sqe_set_data(sqe, (void *)(uintptr_t)chunk);
+  return 1;
+}
+
+/*
+ * Keeps SEAJSON_ASYNC_QUEUE_DEPTH reads in flight and indexes chunks as
+ * soon as they and every chunk before them have landed, so indexing runs
+ * while the later reads are still being done by the kernel.
+ */
+static int async_read_io_uring(seajson_load *load) {
+  struct io_uring ring;
+  if (io_uring_queue_init(SEAJSON_ASYNC_QUEUE_DEPTH, &ring, 0) < 0) {
+    return async_read_threaded(load);
+  }
+  uint64_t chunkCount = (load->size + SEAJSON_ASYNC_CHUNK_SIZE - 1) / SEAJSON_ASYNC_CHUNK_SIZE;
+  size_t *chunkFilled = sea_malloc(sizeof(size_t) * (chunkCount ? chunkCount : 1));
+  if (chunkFilled == NULL) {
+    io_uring_queue_exit(&ring);
+    return 0;
+  }
+  memset(chunkFilled, 0, sizeof(size_t) * (chunkCount ? chunkCount : 1));
+  uint64_t nextToSubmit = 0;
+  uint64_t nextToIndex = 0;
+  unsigned inFlight = 0;
+  int ok = 1;
+  while (ok && nextToIndex < chunkCount) {
+    while (inFlight < SEAJSON_ASYNC_QUEUE_DEPTH && nextToSubmit < chunkCount && submit_async_read(&ring, load, nextToSubmit, 0)) {
+      nextToSubmit++;
+      inFlight++;
+    }
+    io_uring_submit(&ring);
+    struct io_uring_cqe *cqe;
+    if (io_uring_wait_cqe(&ring, &cqe) < 0) {
+      ok = 0;
+      break;
+    }
+    do {
+      uint64_t chunk = (uint64_t)(uintptr_t)io_uring_cqe_get_data(cqe);
+      int result = cqe->res;
+      io_uring_cqe_seen(&ring, cqe);
+      inFlight--;
+      if (result <= 0) {
+        ok = 0;
+        break;
+      }
+      chunkFilled[chunk] += (size_t)result;
+      if (chunkFilled[chunk] < async_chunk_size(load, chunk)) {
+        /* Short read, ask for the rest of the chunk */
+        if (!submit_async_read(&ring, load, chunk, chunkFilled[chunk])) {
+          ok = 0;
+          break;
+        }
+        inFlight++;
+      }
+    } while (io_uring_peek_cqe(&ring, &cqe) == 0);
+    while (nextToIndex < chunkCount && chunkFilled[nextToIndex] == async_chunk_size(load, nextToIndex)) {
+      seajson_index_feed(&load->index, load->json + nextToIndex * SEAJSON_ASYNC_CHUNK_SIZE, async_chunk_size(load, nextToIndex));
+      nextToIndex++;
+    }
+  }
+  /* Reads still in flight write into json, so wait for them before anything is freed */
+  io_uring_submit(&ring);
+  while (inFlight) {
+    struct io_uring_cqe *cqe;
+    if (io_uring_wait_cqe(&ring, &cqe) < 0) {
+      break;
+    }
+    io_uring_cqe_seen(&ring, cqe);
+    inFlight--;
+  }
+  io_uring_queue_exit(&ring);
+  sea_free(chunkFilled);
+  return ok;
+}
+#endif
+
+static void *async_load_main(void *argument) {
+  seajson_load *load = argument;
+  use_document_allocator(NULL);
+  int ok = 0;
+#ifndef _WIN32
+  load->fd = open(load->filename, O_RDONLY);
+  struct stat fileStat;
+  if (load->fd >= 0 && fstat(load->fd, &fileStat) == 0 && (uint64_t)fileStat.st_size < SIZE_MAX) {
+    load->size = (uint64_t)fileStat.st_size;
+    load->json = sea_malloc((size_t)load->size + 1);
+    if (load->json) {
+#ifdef SEAJSON_USE_IO_URING
+      ok = async_read_io_uring(load);
+#else
+      ok = async_read_threaded(load);
+#endif
+    }
+  }
+  if (load->fd >= 0) {
+    close(load->fd);
+  }
+#else
+  FILE *fp = fopen(load->filename, "rb");
+  if (fp && get_file_size(fp, &load->size) && load->size < SIZE_MAX) {
+    load->json = sea_malloc((size_t)load->size + 1);
+    ok = load->json && read_file_chunks(fp, load->json, load->size, &load->index);
+  }
+  if (fp) {
+    fclose(fp);
+  }
+#endif
+  if (ok) {
+    load->json[load->size] = '\0';
+    seajson_index_finish(&load->index);
+  } else {
+    fprintf(stderr, "SeaJSON Error: init_json_from_file_async could not read %s\n", load->filename);
+    sea_free(load->json);
+    load->json = NULL;
+    load->index.isValid = 0;
+  }
+  if (load->callback) {
+    load->callback(load->json, &load->index, load->context);
+  }
+  seajson_mutex_lock(&load->lock);
+  load->done = 1;
+  seajson_cond_broadcast(&load->progress);
+  seajson_mutex_unlock(&load->lock);
+  return NULL;
+}
+
+seajson_load *init_json_from_file_async(const char *filename, seajson_load_callback callback, void *context) {
+  use_document_allocator(NULL);
+  seajson_load *load = sea_malloc(sizeof(seajson_load));
+  size_t filenameLength = strlen(filename);
+  char *filenameCopy = sea_malloc(filenameLength + 1);
+  if (load == NULL || filenameCopy == NULL) {
+    sea_free(load);
+    sea_free(filenameCopy);
+    fprintf(stderr, "SeaJSON Error: init_json_from_file_async could not allocate\n");
+    return NULL;
+  }
+  memcpy(filenameCopy, filename, filenameLength + 1);
+  memset(load, 0, sizeof(seajson_load));
+  load->filename = filenameCopy;
+  load->callback = callback;
+  load->context = context;
+  load->index = new_seajson_index();
+  seajson_mutex_init(&load->lock);
+  seajson_cond_init(&load->progress);
+  if (!seajson_thread_start(&load->thread, async_load_main, load)) {
+    seajson_mutex_destroy(&load->lock);
+    seajson_cond_destroy(&load->progress);
+    sea_free(load->filename);
+    sea_free(load);
+    fprintf(stderr, "SeaJSON Error: init_json_from_file_async could not start a thread\n");
+    return NULL;
+  }
+  return load;
+}
+
+int seajson_load_is_done(seajson_load *load) {
+  seajson_mutex_lock(&load->lock);
+  int done = load->done;
+  seajson_mutex_unlock(&load->lock);
+  return done;
+}
+
+seajson seajson_load_wait(seajson_load *load, seajson_index *index) {
+  seajson_mutex_lock(&load->lock);
+  while (!load->done) {
+    seajson_cond_wait(&load->progress, &load->lock);
+  }
+  seajson_mutex_unlock(&load->lock);
+  seajson_thread_join(load->thread);
+  seajson json = load->json;
+  if (index) {
+    *index = load->index;
+  } else {
+    free_seajson_index(load->index);
+  }
+  use_document_allocator(NULL);
+  seajson_mutex_destroy(&load->lock);
+  seajson_cond_destroy(&load->progress);
+  sea_free(load->filename);
+  sea_free(load);
+  return json;
+}
+
+/* Iteration */
+
+/* Type tag of the value json[start, end) going by how it starts */
+static seajson_type json_value_type(const char *json, size_t start, size_t end) {
+  switch (json[start]) {
+    case '\"': return SEAJSON_TYPE_STRING;
+    case '{': return SEAJSON_TYPE_OBJECT;
+    case '[': return SEAJSON_TYPE_ARRAY;
+    case 't': return SEAJSON_TYPE_TRUE;
+    case 'f': return SEAJSON_TYPE_FALSE;
+    case 'n': return SEAJSON_TYPE_NULL;
+    default: {
+      json_number number;
+      if (scan_json_number(json, end, start, &number) == SEAJSON_SCAN_FAILED) {
+        return SEAJSON_TYPE_INVALID;
+      }
+      return number.isDouble ? SEAJSON_TYPE_DOUBLE : SEAJSON_TYPE_INT;
+    }
+  }
+}
+
+static seajson_iterator iterate_json(const char *json, size_t length) {
+  seajson_iterator iterator;
+  iterator.json = json;
+  iterator.length = length;
+  iterator.pos = skip_json_whitespace(json, length, 0);
+  iterator.isObject = 0;
+  iterator.done = 1;
+  iterator.isValid = 0;
+  if (iterator.pos >= length || (json[iterator.pos] != '{' && json[iterator.pos] != '[')) {
+    fprintf(stderr, "SeaJSON Error: only objects and arrays can be iterated\n");
+    return iterator;
+  }
+  member_scanner scanner;
+  member_scanner_init(&scanner, json, length, iterator.pos);
+  iterator.pos = scanner.pos;
+  iterator.isObject = scanner.isObject;
+  iterator.done = scanner.done;
+  iterator.isValid = 1;
+  return iterator;
+}
+
+seajson_iterator seajson_iterate(seajson json) {
+  use_document_allocator(json);
+  size_t length = strlen(json);
+  SEAJSON_STAT_FULL_SCAN(SEAJSON_STAT_SEAJSON_ITERATOR_NEXT, length);
+  return iterate_json(json, length);
+}
+
+seajson_iterator seajson_iterate_view(seajson_view value) {
+  return iterate_json(value.start, value.length);
+}
+
+int seajson_iterator_next(seajson_iterator *iterator, seajson_view *key, seajson_view *value, seajson_type *type) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_SEAJSON_ITERATOR_NEXT);
+  if (iterator->done || !iterator->isValid) {
+    return 0;
+  }
+  /* The iterator only keeps where the next member starts, the scanner picks up from there */
+  member_scanner scanner;
+  scanner.json = iterator->json;
+  scanner.length = iterator->length;
+  scanner.index = NULL;
+  scanner.indexHint = 0;
+  scanner.pos = iterator->pos;
+  scanner.isObject = iterator->isObject;
+  scanner.done = 0;
+  scanner.failed = 0;
+  if (!member_scanner_next(&scanner)) {
+    fprintf(stderr, "SeaJSON Error: seajson_iterator_next found a broken member\n");
+    iterator->isValid = 0;
+    return 0;
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_SEAJSON_ITERATOR_NEXT, (scanner.done ? scanner.closePos + 1 : scanner.pos) - iterator->pos);
+  iterator->pos = scanner.pos;
+  iterator->done = scanner.done;
+  if (key) {
+    key->start = scanner.isObject ? iterator->json + scanner.keyStart : NULL;
+    key->length = scanner.isObject ? scanner.keyEnd - scanner.keyStart : 0;
+  }
+  if (value) {
+    value->start = iterator->json + scanner.valueStart;
+    value->length = scanner.valueEnd - scanner.valueStart;
+  }
+  if (type) {
+    *type = json_value_type(iterator->json, scanner.valueStart, scanner.valueEnd);
+  }
+  return 1;
+}
+
+int seajson_view_equals(seajson_view key, const char *name) {
+  if (key.start == NULL) {
+    return 0;
+  }
+  use_document_allocator(NULL);
+  return json_key_equals(key.start, 0, key.length, name, strlen(name));
+}
+
+long long seajson_view_unescape(seajson_view view, char *out, size_t capacity) {
+  if (view.start == NULL || capacity == 0) {
+    return -1;
+  }
+  const char *string = view.start;
+  size_t length = view.length;
+  /* String values still have their quotes, keys do not */
+  if (length >= 2 && string[0] == '\"') {
+    string++;
+    length -= 2;
+  }
+  return unescape_json_string(string, length, out, capacity);
+}
+
+/* Deduplication */
+
+struct seajson_dedup_entry {
+  uint64_t hash;
+  char *json;          /* Stored without whitespace between tokens, NULL if the slot is empty or was released */
+  size_t length;
+  size_t references;
+  int wasUsed;         /* Released slots are kept as tombstones so lookups still probe past them */
+};
+
+/* Compares json with an already minified copy, skipping the whitespace between json's tokens as it goes */
+static int json_equals_minified(const char *json, size_t length, const char *minified, size_t minifiedLength) {
+  size_t minifiedPos = 0;
+  int inString = 0;
+  int escaped = 0;
+  for (size_t i = 0; i < length; i++) {
+    char currentChar = json[i];
+    if (inString) {
+      if (escaped) {
+        escaped = 0;
+      } else if (currentChar == '\\') {
+        escaped = 1;
+      } else if (currentChar == '\"') {
+        inString = 0;
+      }
+    } else if (is_json_whitespace(currentChar)) {
+      continue;
+    } else if (currentChar == '\"') {
+      inString = 1;
+    }
+    if (minifiedPos >= minifiedLength || minified[minifiedPos++] != currentChar) {
+      return 0;
+    }
+  }
+  return minifiedPos == minifiedLength;
+}
+
+seajson_dedup new_seajson_dedup(void) {
+  seajson_dedup dedup;
+  dedup.entries = NULL;
+  dedup.entryCount = 0;
+  dedup.entryCapacity = 0;
+  dedup.uniqueBytes = 0;
+  dedup.sharedBytes = 0;
+  dedup.isValid = 1;
+  return dedup;
+}
+
+/* Keeps the table at most half full (tombstones included), capacity is always a power of 2 */
+static int grow_seajson_dedup(seajson_dedup *dedup) {
+  size_t newCapacity = dedup->entryCapacity ? dedup->entryCapacity * 2 : 64;
+  seajson_dedup_entry *newEntries = sea_malloc(sizeof(seajson_dedup_entry) * newCapacity);
+  if (newEntries == NULL) {
+    return 0;
+  }
+  memset(newEntries, 0, sizeof(seajson_dedup_entry) * newCapacity);
+  size_t liveCount = 0;
+  for (size_t i = 0; i < dedup->entryCapacity; i++) {
+    seajson_dedup_entry *entry = &dedup->entries[i];
+    if (entry->json == NULL) {
+      continue;
+    }
+    size_t slot = (size_t)entry->hash & (newCapacity - 1);
+    while (newEntries[slot].wasUsed) {
+      slot = (slot + 1) & (newCapacity - 1);
+    }
+    newEntries[slot] = *entry;
+    liveCount++;
+  }
+  sea_free(dedup->entries);
+  dedup->entries = newEntries;
+  dedup->entryCapacity = newCapacity;
+  dedup->entryCount = liveCount;
+  return 1;
+}
+
+/* Returns the shared copy of json[0, length) with a new reference taken, storing it first if it is new */
+static seajson dedup_value(seajson_dedup *dedup, const char *json, size_t length, uint64_t hash) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_DEDUP_SEAJSON);
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_DEDUP_SEAJSON, length);
+  use_document_allocator(NULL);
+  if (!dedup->isValid) {
+    return NULL;
+  }
+  if ((dedup->entryCount + 1) * 2 > dedup->entryCapacity && !grow_seajson_dedup(dedup)) {
+    fprintf(stderr, "SeaJSON Error: dedup_seajson could not allocate\n");
+    dedup->isValid = 0;
+    return NULL;
+  }
+  size_t mask = dedup->entryCapacity - 1;
+  size_t slot = (size_t)hash & mask;
+  size_t freeSlot = SEAJSON_SCAN_FAILED;
+  while (dedup->entries[slot].wasUsed) {
+    seajson_dedup_entry *entry = &dedup->entries[slot];
+    if (entry->json == NULL) {
+      if (freeSlot == SEAJSON_SCAN_FAILED) {
+        freeSlot = slot;
+      }
+    } else if (entry->hash == hash && json_equals_minified(json, length, entry->json, entry->length)) {
+      entry->references++;
+      dedup->sharedBytes += entry->length;
+      return entry->json;
+    }
+    slot = (slot + 1) & mask;
+  }
+  if (freeSlot == SEAJSON_SCAN_FAILED) {
+    freeSlot = slot;
+  }
+  char *copy = sea_malloc(length + 1);
+  if (copy == NULL) {
+    fprintf(stderr, "SeaJSON Error: dedup_seajson could not allocate\n");
+    return NULL;
+  }
+  if (!dedup->entries[freeSlot].wasUsed) {
+    dedup->entryCount++;
+  }
+  size_t copyLength = copy_json_minified(json, length, copy);
+  copy[copyLength] = '\0';
+  if (copyLength < length) {
+    char *shrunk = sea_realloc(copy, copyLength + 1);
+    if (shrunk) {
+      copy = shrunk;
+    }
+  }
+  seajson_dedup_entry *entry = &dedup->entries[freeSlot];
+  entry->hash = hash;
+  entry->json = copy;
+  entry->length = copyLength;
+  entry->references = 1;
+  entry->wasUsed = 1;
+  dedup->uniqueBytes += copyLength;
+  return copy;
+}
+
+seajson dedup_seajson(seajson_dedup *dedup, seajson_view value) {
+  if (value.start == NULL) {
+    return NULL;
+  }
+  return dedup_value(dedup, value.start, value.length, hash_json_value(value.start, value.length));
+}
+
+seajson get_value_indexed_dedup(seajson_dedup *dedup, seajson json, const seajson_index *index, const char *path) {
+  uint64_t valueStart;
+  uint64_t valueEnd;
+  if (get_value_indexed(json, index, path, &valueStart, &valueEnd) != 0) {
+    return NULL;
+  }
+  /* Containers already have their hash in a hashed index, anything else is small enough to hash here */
+  uint64_t hash = 0;
+  int haveHash = 0;
+  if (index->hashContents && (json[valueStart] == '{' || json[valueStart] == '[')) {
+    size_t container = find_indexed_container(index, valueStart, 0);
+    if (container != SEAJSON_SCAN_FAILED) {
+      hash = index->containers[container].hash;
+      haveHash = 1;
+    }
+  }
+  if (!haveHash) {
+    hash = hash_json_value(json + valueStart, (size_t)(valueEnd - valueStart));
+  }
+  return dedup_value(dedup, json + valueStart, (size_t)(valueEnd - valueStart), hash);
+}
+
+seajson get_dictionary_dedup(seajson_dedup *dedup, seajson json, const char *key) {
+  use_document_allocator(json);
+  member_scanner scanner;
+  if (!find_top_level_member_terminated(json, key, &scanner) || json[scanner.valueStart] != '{') {
+    return NULL;
+  }
+  size_t valueLength = scanner.valueEnd - scanner.valueStart;
+  return dedup_value(dedup, json + scanner.valueStart, valueLength, hash_json_value(json + scanner.valueStart, valueLength));
+}
+
+seajson get_item_from_jarray_dedup(seajson_dedup *dedup, jarray array, long long index) {
+  size_t itemStart;
+  size_t itemLength;
+  /* find_jarray_item exits on these, this one is documented to return NULL instead */
+  if (!array.isValid || index < 0 || index >= array.itemCount) {
+    return NULL;
+  }
+  if (!find_jarray_item(array, index, &itemStart, &itemLength, "get_item_from_jarray_dedup", SEAJSON_STAT_DEDUP_SEAJSON)) {
+    return NULL;
+  }
+  return dedup_value(dedup, array.arrayString + itemStart, itemLength, hash_json_value(array.arrayString + itemStart, itemLength));
+}
+
+void release_seajson_dedup(seajson_dedup *dedup, seajson value) {
+  if (value == NULL || dedup->entryCapacity == 0) {
+    return;
+  }
+  use_document_allocator(NULL);
+  size_t length = strlen(value);
+  size_t mask = dedup->entryCapacity - 1;
+  size_t slot = (size_t)hash_json_value(value, length) & mask;
+  while (dedup->entries[slot].wasUsed) {
+    seajson_dedup_entry *entry = &dedup->entries[slot];
+    if (entry->json == value) {
+      if (--entry->references == 0) {
+        dedup->uniqueBytes -= entry->length;
+        sea_free(entry->json);
+        entry->json = NULL;
+      }
+      return;
+    }
+    slot = (slot + 1) & mask;
+  }
+  fprintf(stderr, "SeaJSON Error: release_seajson_dedup was given a value it does not own\n");
+}
+
+void free_seajson_dedup(seajson_dedup dedup) {
+  use_document_allocator(NULL);
+  for (size_t i = 0; i < dedup.entryCapacity; i++) {
+    sea_free(dedup.entries[i].json);
+  }
+  sea_free(dedup.entries);
+}
+
+/* Shared slices */
+
+struct seajson_shared {
+  seajson_refcount references;
+  seajson json;
+  size_t length;
+};
+
+static seajson_slice invalid_slice(void) {
+  seajson_slice slice;
+  slice.view.start = NULL;
+  slice.view.length = 0;
+  slice.shared = NULL;
+  return slice;
+}
+
+/* json[start, end) of slice, holding its own reference to the buffer */
+static seajson_slice sub_slice(seajson_slice slice, size_t start, size_t end) {
+  seajson_slice result;
+  result.view.start = slice.view.start + start;
+  result.view.length = end - start;
+  result.shared = slice.shared;
+  seajson_refcount_retain(&slice.shared->references);
+  return result;
+}
+
+static void free_seajson_shared(seajson_shared *shared) {
+  seajson json = shared->json;
+  use_document_allocator(json);
+  sea_free(shared);
+  free_json(json);
+}
+
+seajson_slice share_seajson(seajson json) {
+  if (json == NULL) {
+    return invalid_slice();
+  }
+  use_document_allocator(json);
+  seajson_shared *shared = sea_malloc(sizeof(seajson_shared));
+  if (shared == NULL) {
+    fprintf(stderr, "SeaJSON Error: share_seajson could not allocate\n");
+    return invalid_slice();
+  }
+  shared->references = 1;
+  shared->json = json;
+  shared->length = strlen(json);
+  seajson_slice slice;
+  slice.view.start = json;
+  slice.view.length = shared->length;
+  slice.shared = shared;
+  return slice;
+}
+
+/* Finds key among the top level members of slice, only returning it if it is an object/array starting with openChar */
+static seajson_slice find_member_slice(seajson_slice slice, const char *key, char openChar) {
+  if (slice.shared == NULL) {
+    return invalid_slice();
+  }
+  use_document_allocator(slice.shared->json);
+  member_scanner scanner;
+  if (!find_top_level_member(slice.view.start, slice.view.length, key, &scanner)) {
+    SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_SLICE, scanner.pos);
+    return invalid_slice();
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_SLICE, scanner.valueEnd);
+  if (slice.view.start[scanner.valueStart] != openChar) {
+    return invalid_slice();
+  }
+  return sub_slice(slice, scanner.valueStart, scanner.valueEnd);
+}
+
+seajson_slice get_dictionary_slice(seajson_slice slice, const char *key) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_SLICE);
+  return find_member_slice(slice, key, '{');
+}
+
+seajson_slice get_array_slice(seajson_slice slice, const char *key) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_SLICE);
+  return find_member_slice(slice, key, '[');
+}
+
+seajson_slice get_item_slice(seajson_slice slice, long long index) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_GET_SLICE);
+  if (slice.shared == NULL || index < 0) {
+    return invalid_slice();
+  }
+  const char *json = slice.view.start;
+  size_t length = slice.view.length;
+  size_t pos = skip_json_whitespace(json, length, 0);
+  if (pos >= length || json[pos] != '[') {
+    return invalid_slice();
+  }
+  member_scanner items;
+  member_scanner_init(&items, json, length, pos);
+  while (member_scanner_next(&items)) {
+    if (index-- == 0) {
+      SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_SLICE, items.valueEnd);
+      return sub_slice(slice, items.valueStart, items.valueEnd);
+    }
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_GET_SLICE, items.pos);
+  return invalid_slice();
+}
+
+seajson_slice retain_seajson_slice(seajson_slice slice) {
+  if (slice.shared) {
+    seajson_refcount_retain(&slice.shared->references);
+  }
+  return slice;
+}
+
+void release_seajson_slice(seajson_slice slice) {
+  if (slice.shared && seajson_refcount_release(&slice.shared->references) == 0) {
+    free_seajson_shared(slice.shared);
+  }
+}
+
+seajson copy_seajson_slice(seajson_slice slice) {
+  if (slice.shared == NULL) {
+    return NULL;
+  }
+  use_document_allocator(slice.shared->json);
+  char *copy = sea_malloc(slice.view.length + 1);
+  if (copy == NULL) {
+    fprintf(stderr, "SeaJSON Error: copy_seajson_slice could not allocate\n");
+    return NULL;
+  }
+  memcpy(copy, slice.view.start, slice.view.length);
+  copy[slice.view.length] = '\0';
+  return adopt_document(copy);
+}
+
+seajson detach_seajson_slice(seajson_slice slice) {
+  seajson_shared *shared = slice.shared;
+  if (shared == NULL) {
+    return NULL;
+  }
+  /* Nothing else can see the buffer once this is its last reference, so a slice of all of it can just take it */
+  if (slice.view.start == shared->json && slice.view.length == shared->length && seajson_refcount_load(&shared->references) == 1) {
+    seajson json = shared->json;
+    use_document_allocator(json);
+    sea_free(shared);
+    return json;
+  }
+  seajson copy = copy_seajson_slice(slice);
+  if (copy) {
+    release_seajson_slice(slice);
+  }
+  return copy;
+}
+
+/* Document cache */
+
+#define SEAJSON_CACHE_DEFAULT_BUDGET ((uint64_t)256 * 1024 * 1024)
+
+typedef struct seajson_cache_entry seajson_cache_entry;
+struct seajson_cache_entry {
+  char *filename;
+  uint64_t filenameHash;
+  uint64_t size;
+  int64_t modified;
+  seajson_slice document;       /* The cache's own reference */
+  seajson_cache_entry *next;    /* Next in the same bucket */
+  seajson_cache_entry *newer;   /* Least recently used list, cacheNewest to cacheOldest */
+  seajson_cache_entry *older;
+};
+
+static seajson_mutex cacheLock = SEAJSON_MUTEX_INIT;
+static seajson_cache_entry **cacheBuckets;
+static size_t cacheBucketCount;
+static seajson_cache_entry *cacheNewest;
+static seajson_cache_entry *cacheOldest;
+static uint64_t cacheBudget = SEAJSON_CACHE_DEFAULT_BUDGET;
+static seajson_cache_stats cacheStats;
+
+static uint64_t hash_cache_filename(const char *filename) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const unsigned char *c = (const unsigned char *)filename; *c; c++) {
+    hash = (hash ^ *c) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/* Everything from here to seajson_set_cache_budget needs cacheLock held */
+static seajson_cache_entry *find_cache_entry(const char *filename, uint64_t hash) {
+  if (cacheBucketCount == 0) {
+    return NULL;
+  }
+  seajson_cache_entry *entry = cacheBuckets[hash & (cacheBucketCount - 1)];
+  while (entry && (entry->filenameHash != hash || strcmp(entry->filename, filename) != 0)) {
+    entry = entry->next;
+  }
+  return entry;
+}
+
+static void unlink_cache_entry_lru(seajson_cache_entry *entry) {
+  if (entry->newer) {
+    entry->newer->older = entry->older;
+  } else {
+    cacheNewest = entry->older;
+  }
+  if (entry->older) {
+    entry->older->newer = entry->newer;
+  } else {
+    cacheOldest = entry->newer;
+  }
+}
+
+static void push_cache_entry_lru(seajson_cache_entry *entry) {
+  entry->newer = NULL;
+  entry->older = cacheNewest;
+  if (cacheNewest) {
+    cacheNewest->newer = entry;
+  } else {
+    cacheOldest = entry;
+  }
+  cacheNewest = entry;
+}
+
+static int grow_cache_buckets(void) {
+  size_t newCount = cacheBucketCount ? cacheBucketCount * 2 : 64;
+  seajson_cache_entry **newBuckets = sea_malloc(newCount * sizeof(seajson_cache_entry *));
+  if (newBuckets == NULL) {
+    return 0;
+  }
+  memset(newBuckets, 0, newCount * sizeof(seajson_cache_entry *));
+  for (size_t i = 0; i < cacheBucketCount; i++) {
+    seajson_cache_entry *entry = cacheBuckets[i];
+    while (entry) {
+      seajson_cache_entry *next = entry->next;
+      size_t bucket = entry->filenameHash & (newCount - 1);
+      entry->next = newBuckets[bucket];
+      newBuckets[bucket] = entry;
+      entry = next;
+    }
+  }
+  sea_free(cacheBuckets);
+  cacheBuckets = newBuckets;
+  cacheBucketCount = newCount;
+  return 1;
+}
+
+/* Handles given out keep the document itself around, this only drops the cache's reference */
+static void remove_cache_entry(seajson_cache_entry *entry) {
+  seajson_cache_entry **link = &cacheBuckets[entry->filenameHash & (cacheBucketCount - 1)];
+  while (*link != entry) {
+    link = &(*link)->next;
+  }
+  *link = entry->next;
+  unlink_cache_entry_lru(entry);
+  cacheStats.documents--;
+  cacheStats.bytes -= entry->size;
+  release_seajson_slice(entry->document);
+  use_document_allocator(NULL);
+  sea_free(entry->filename);
+  sea_free(entry);
+}
+
+static void trim_cache(void) {
+  while (cacheOldest && cacheStats.bytes > cacheBudget) {
+    cacheStats.evictions++;
+    remove_cache_entry(cacheOldest);
+  }
+}
+
+static seajson_slice insert_cache_entry(const char *filename, uint64_t hash, uint64_t size, int64_t modified, seajson_slice document) {
+  if (cacheStats.documents >= cacheBucketCount && !grow_cache_buckets()) {
+    return document;
+  }
+  seajson_cache_entry *entry = sea_malloc(sizeof(seajson_cache_entry));
+  size_t filenameLength = strlen(filename);
+  char *filenameCopy = sea_malloc(filenameLength + 1);
+  if (entry == NULL || filenameCopy == NULL) {
+    /* Still hand it out, it just is not cached */
+    sea_free(entry);
+    sea_free(filenameCopy);
+    return document;
+  }
+  memcpy(filenameCopy, filename, filenameLength + 1);
+  entry->filename = filenameCopy;
+  entry->filenameHash = hash;
+  entry->size = size;
+  entry->modified = modified;
+  entry->document = document;
+  size_t bucket = hash & (cacheBucketCount - 1);
+  entry->next = cacheBuckets[bucket];
+  cacheBuckets[bucket] = entry;
+  push_cache_entry_lru(entry);
+  cacheStats.documents++;
+  cacheStats.bytes += size;
+  seajson_slice handle = retain_seajson_slice(document);
+  trim_cache();
+  return handle;
+}
+
+seajson_slice init_json_from_file_cached(const char *filename) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_INIT_JSON_FROM_FILE);
+  use_document_allocator(NULL);
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "SeaJSON Error: init_json_from_file_cached could not open %s\n", filename);
+    return invalid_slice();
+  }
+  uint64_t size;
+  int64_t modified;
+  if (!get_file_identity(fp, &size, &modified) || size >= SIZE_MAX) {
+    fclose(fp);
+    fprintf(stderr, "SeaJSON Error: init_json_from_file_cached could not get the size of %s\n", filename);
+    return invalid_slice();
+  }
+  uint64_t hash = hash_cache_filename(filename);
+  seajson_mutex_lock(&cacheLock);
+  seajson_cache_entry *entry = find_cache_entry(filename, hash);
+  if (entry && entry->size == size && entry->modified == modified) {
+    cacheStats.hits++;
+    unlink_cache_entry_lru(entry);
+    push_cache_entry_lru(entry);
+    seajson_slice handle = retain_seajson_slice(entry->document);
+    seajson_mutex_unlock(&cacheLock);
+    fclose(fp);
+    return handle;
+  }
+  int isReload = (entry != NULL);
+  seajson_mutex_unlock(&cacheLock);
+  /* Read without the lock, so loading one file never holds up hits on the others */
+  char *json = sea_malloc((size_t)size + 1);
+  if (json == NULL || !read_file_chunks(fp, json, size, NULL)) {
+    fclose(fp);
+    sea_free(json);
+    fprintf(stderr, "SeaJSON Error: init_json_from_file_cached could not read %s\n", filename);
+    return invalid_slice();
+  }
+  fclose(fp);
+  json[size] = '\0';
+  seajson_slice document = share_seajson(json);
+  if (document.shared == NULL) {
+    sea_free(json);
+    return document;
+  }
+  seajson_mutex_lock(&cacheLock);
+  use_document_allocator(NULL);
+  if (isReload) {
+    cacheStats.reloads++;
+  } else {
+    cacheStats.misses++;
+  }
+  entry = find_cache_entry(filename, hash);
+  if (entry && entry->size == size && entry->modified == modified) {
+    /* Another thread loaded the same version while this one was reading, keep theirs */
+    seajson_slice handle = retain_seajson_slice(entry->document);
+    seajson_mutex_unlock(&cacheLock);
+    release_seajson_slice(document);
+    return handle;
+  }
+  if (entry) {
+    remove_cache_entry(entry);
+  }
+  seajson_slice handle = insert_cache_entry(filename, hash, size, modified, document);
+  seajson_mutex_unlock(&cacheLock);
+  return handle;
+}
+
+void seajson_set_cache_budget(uint64_t bytes) {
+  seajson_mutex_lock(&cacheLock);
+  cacheBudget = bytes;
+  trim_cache();
+  seajson_mutex_unlock(&cacheLock);
+}
+
+seajson_cache_stats seajson_get_cache_stats(void) {
+  seajson_mutex_lock(&cacheLock);
+  seajson_cache_stats stats = cacheStats;
+  seajson_mutex_unlock(&cacheLock);
+  return stats;
+}
+
+void seajson_clear_cache(void) {
+  seajson_mutex_lock(&cacheLock);
+  while (cacheOldest) {
+    remove_cache_entry(cacheOldest);
+  }
+  use_document_allocator(NULL);
+  sea_free(cacheBuckets);
+  cacheBuckets = NULL;
+  cacheBucketCount = 0;
+  seajson_mutex_unlock(&cacheLock);
+}
+
+/* Queries */
+
+/* A dotted path, split up into NULL terminated keys that all live in storage */
+typedef struct {
+  char *storage;
+  char **keys;
+  size_t keyCount;
+} query_path;
+
+typedef enum {
+  QUERY_EQUAL,
+  QUERY_NOT_EQUAL,
+  QUERY_LESS,
+  QUERY_LESS_EQUAL,
+  QUERY_GREATER,
+  QUERY_GREATER_EQUAL
+} query_comparison;
+
+typedef struct {
+  query_path field;
+  query_comparison comparison;
+  seajson_type type;      /* Of the literal, SEAJSON_TYPE_DOUBLE for every number */
+  char *string;           /* Unescaped, or the minified text of an object/array */
+  size_t stringLength;
+  json_number number;
+} query_predicate;
+
+struct seajson_query {
+  query_path array;
+  query_predicate *predicates;
+  size_t predicateCount;
+  query_path projection;
+};
+
+static int is_query_key_char(char currentChar) {
+  return currentChar != '\0' && strchr(".[]=!<>&", currentChar) == NULL && !is_json_whitespace(currentChar);
+}
+
+static size_t skip_query_spaces(const char *query, size_t pos) {
+  while (query[pos] == ' ') {
+    pos++;
+  }
+  return pos;
+}
+
+/* Reads keys separated by . from pos, returns the pos after them or SEAJSON_SCAN_FAILED */
+static size_t compile_query_path(const char *query, size_t pos, query_path *path) {
+  size_t end = pos;
+  size_t keyCount = 0;
+  while (is_query_key_char(query[end]) || (query[end] == '.' && end > pos)) {
+    if (query[end] == '.') {
+      if (!is_query_key_char(query[end + 1])) {
+        return SEAJSON_SCAN_FAILED;
       }
-      offset++;
+    } else if (end == pos || query[end - 1] == '.') {
+      keyCount++;
     }
-    for (int i = stringPos + offset; i < jsonLen; i++) {
-      returnJson[i-offset] = json[i];
+    end++;
+  }
+  path->storage = sea_malloc(end - pos + 1);
+  path->keys = sea_malloc(sizeof(char *) * (keyCount ? keyCount : 1));
+  path->keyCount = 0;
+  if (path->storage == NULL || path->keys == NULL) {
+    return SEAJSON_SCAN_FAILED;
+  }
+  memcpy(path->storage, query + pos, end - pos);
+  path->storage[end - pos] = '\0';
+  for (size_t i = 0; i < end - pos; i++) {
+    if (i == 0 || path->storage[i - 1] == '\0') {
+      path->keys[path->keyCount++] = path->storage + i;
     }
-    returnJson[jsonLen - keyLen - 5] = '\0';
-    return returnJson;
+    if (path->storage[i] == '.') {
+      path->storage[i] = '\0';
+    }
+  }
+  return end;
+}
+
+static void free_query_path(query_path *path) {
+  sea_free(path->storage);
+  sea_free(path->keys);
+}
+
+/* pos is right after the ?, returns the pos of the ] or SEAJSON_SCAN_FAILED */
+static size_t compile_query_predicate(const char *query, size_t queryLength, size_t pos, query_predicate *predicate) {
+  pos = compile_query_path(query, skip_query_spaces(query, pos), &predicate->field);
+  if (pos == SEAJSON_SCAN_FAILED || predicate->field.keyCount == 0) {
+    return SEAJSON_SCAN_FAILED;
+  }
+  /* JSONPath's @ for the item itself would otherwise be looked up as a key and quietly match nothing */
+  if (strcmp(predicate->field.keys[0], "@") == 0) {
+    return SEAJSON_SCAN_FAILED;
+  }
+  pos = skip_query_spaces(query, pos);
+  if (query[pos] == '=' && query[pos + 1] == '=') {
+    predicate->comparison = QUERY_EQUAL;
+  } else if (query[pos] == '!' && query[pos + 1] == '=') {
+    predicate->comparison = QUERY_NOT_EQUAL;
+  } else if (query[pos] == '<') {
+    predicate->comparison = (query[pos + 1] == '=') ? QUERY_LESS_EQUAL : QUERY_LESS;
+  } else if (query[pos] == '>') {
+    predicate->comparison = (query[pos + 1] == '=') ? QUERY_GREATER_EQUAL : QUERY_GREATER;
   } else {
-    /* key not in remove_string_seajson */
-    /* TODO: Allocate new json and return it, for now just return our pointer */
-    return json;
+    return SEAJSON_SCAN_FAILED;
+  }
+  pos = skip_query_spaces(query, pos + ((query[pos + 1] == '=') ? 2 : 1));
+  if (query[pos] == '\"') {
+    size_t stringEnd = find_json_string_end(query, queryLength, pos + 1);
+    if (stringEnd >= queryLength) {
+      return SEAJSON_SCAN_FAILED;
+    }
+    size_t rawLength = stringEnd - pos - 1;
+    predicate->type = SEAJSON_TYPE_STRING;
+    predicate->string = sea_malloc(rawLength + 1);
+    if (predicate->string == NULL) {
+      return SEAJSON_SCAN_FAILED;
+    }
+    long long unescapedLength = unescape_json_string(query + pos + 1, rawLength, predicate->string, rawLength + 1);
+    if (unescapedLength < 0) {
+      return SEAJSON_SCAN_FAILED;
+    }
+    predicate->stringLength = (size_t)unescapedLength;
+    pos = stringEnd + 1;
+  } else if (query[pos] == '{' || query[pos] == '[') {
+    size_t literalEnd = skip_json_value(query, queryLength, pos);
+    if (literalEnd == SEAJSON_SCAN_FAILED) {
+      return SEAJSON_SCAN_FAILED;
+    }
+    predicate->type = (query[pos] == '{') ? SEAJSON_TYPE_OBJECT : SEAJSON_TYPE_ARRAY;
+    predicate->string = sea_malloc(literalEnd - pos + 1);
+    if (predicate->string == NULL) {
+      return SEAJSON_SCAN_FAILED;
+    }
+    predicate->stringLength = copy_json_minified(query + pos, literalEnd - pos, predicate->string);
+    pos = literalEnd;
+  } else if (strncmp(query + pos, "true", 4) == 0 || strncmp(query + pos, "null", 4) == 0) {
+    predicate->type = (query[pos] == 't') ? SEAJSON_TYPE_TRUE : SEAJSON_TYPE_NULL;
+    pos += 4;
+  } else if (strncmp(query + pos, "false", 5) == 0) {
+    predicate->type = SEAJSON_TYPE_FALSE;
+    pos += 5;
+  } else {
+    predicate->type = SEAJSON_TYPE_DOUBLE;
+    pos = scan_json_number(query, queryLength, pos, &predicate->number);
+    if (pos == SEAJSON_SCAN_FAILED) {
+      return SEAJSON_SCAN_FAILED;
+    }
+  }
+  if (predicate->type != SEAJSON_TYPE_DOUBLE && predicate->comparison != QUERY_EQUAL && predicate->comparison != QUERY_NOT_EQUAL) {
+    /* Only numbers have an order */
+    return SEAJSON_SCAN_FAILED;
   }
+  return skip_query_spaces(query, pos);
 }
 
-seajson remove_item_seajson(seajson json, const char *key) {
-  int stringPos = get_pos_item_seajson(json,key); /* TODO: This ONLY works on strings !!! */
-  if (stringPos != -1) {
-    unsigned long keyLen = strlen(key);
-    unsigned long jsonLen = strlen(json);
-    unsigned long offset = (keyLen + 5);
-    stringPos -= offset;
-    seajson returnJson = malloc(sizeof(char) * (jsonLen - keyLen - 5));
-    for (int i = 0; i < stringPos; i++) {
-      returnJson[i] = json[i];
+void free_seajson_query(seajson_query *query) {
+  if (query == NULL) {
+    return;
+  }
+  use_document_allocator(NULL);
+  free_query_path(&query->array);
+  free_query_path(&query->projection);
+  for (size_t i = 0; i < query->predicateCount; i++) {
+    free_query_path(&query->predicates[i].field);
+    sea_free(query->predicates[i].string);
+  }
+  sea_free(query->predicates);
+  sea_free(query);
+}
+
+seajson_query *compile_seajson_query(const char *query) {
+  use_document_allocator(NULL);
+  seajson_query *compiled = sea_malloc(sizeof(seajson_query));
+  if (compiled == NULL) {
+    fprintf(stderr, "SeaJSON Error: compile_seajson_query could not allocate\n");
+    return NULL;
+  }
+  memset(compiled, 0, sizeof(seajson_query));
+  size_t queryLength = strlen(query);
+  /* Every predicate after the first one needs a && in front of it, so this is enough of them */
+  size_t predicateCapacity = 1;
+  for (size_t i = 0; i + 1 < queryLength; i++) {
+    if (query[i] == '&' && query[i + 1] == '&') {
+      predicateCapacity++;
     }
-    /* TODO: Handle if the ending " cannot be found */
-    int inception = 0;
-    int inceptionInString = 0;
-    for (int i = stringPos + offset; i < jsonLen; i++) {
-      if (json[i] == '\"') {
-        if (json[i-1] != '\\') {
-          if (inception == 0) {
-            offset++;
-            break;
-          } else {
-            inceptionInString = !inceptionInString;
-          }
-        }
-      } else if (json[i] == '{') {
-        if (!inceptionInString) {
-          inception++;
-        }
-      } else if (json[i] == '}') {
-        if (!inceptionInString) {
-          inception--;
-        }
-      } else if (json[i] == '[') {
-        if (!inceptionInString) {
-          inception++;
-        }
-      } else if (json[i] == ']') {
-        if (!inceptionInString) {
-          inception--;
-        }
-      } else if (json[i] == ',') {
-        if (!inceptionInString) {
-          if (inception == 0) {
-            offset++;
-            break;
-          }
-        }
+  }
+  compiled->predicates = sea_malloc(sizeof(query_predicate) * predicateCapacity);
+  size_t pos = compile_query_path(query, 0, &compiled->array);
+  if (compiled->predicates == NULL || pos == SEAJSON_SCAN_FAILED || query[pos] != '[') {
+    goto failed;
+  }
+  pos++;
+  if (query[pos] == '*') {
+    pos++;
+  } else if (query[pos] == '?') {
+    pos++;
+    for (;;) {
+      if (compiled->predicateCount >= predicateCapacity) {
+        goto failed;
       }
-      offset++;
+      query_predicate *predicate = &compiled->predicates[compiled->predicateCount++];
+      memset(predicate, 0, sizeof(query_predicate));
+      pos = compile_query_predicate(query, queryLength, pos, predicate);
+      if (pos == SEAJSON_SCAN_FAILED) {
+        goto failed;
+      }
+      if (query[pos] != '&') {
+        break;
+      }
+      if (query[pos + 1] != '&') {
+        goto failed;
+      }
+      pos += 2;
+    }
+  } else {
+    goto failed;
+  }
+  if (query[pos] != ']') {
+    goto failed;
+  }
+  pos++;
+  int hasProjection = (query[pos] == '.');
+  if (!hasProjection && query[pos] != '\0') {
+    goto failed;
+  }
+  pos = compile_query_path(query, pos + hasProjection, &compiled->projection);
+  if (pos == SEAJSON_SCAN_FAILED || query[pos] != '\0' || (hasProjection && compiled->projection.keyCount == 0)) {
+    goto failed;
+  }
+  return compiled;
+failed:
+  fprintf(stderr, "SeaJSON Error: compile_seajson_query could not parse %s (at %zu)\n", query, pos == SEAJSON_SCAN_FAILED ? queryLength : pos);
+  free_seajson_query(compiled);
+  return NULL;
+}
+
+/* Follows path down from the value in json[start, end), returns 1 with the offsets of the value it ends on or 0. An empty path ends on the value itself, with end left as is. */
+static int find_query_value(const char *json, size_t start, size_t end, const query_path *path, size_t *valueStart, size_t *valueEnd) {
+  *valueStart = skip_json_whitespace(json, end, start);
+  *valueEnd = end;
+  for (size_t i = 0; i < path->keyCount; i++) {
+    member_scanner scanner;
+    if (!find_top_level_member(json + *valueStart, *valueEnd - *valueStart, path->keys[i], &scanner)) {
+      return 0;
+    }
+    *valueEnd = *valueStart + scanner.valueEnd;
+    *valueStart += scanner.valueStart;
+  }
+  return *valueStart < *valueEnd;
+}
+
+static int compare_query_numbers(const json_number *value, const json_number *literal) {
+  if (!value->isDouble && !literal->isDouble) {
+    return (value->integer > literal->integer) - (value->integer < literal->integer);
+  }
+  double valueNumber = value->isDouble ? value->number : (double)value->integer;
+  double literalNumber = literal->isDouble ? literal->number : (double)literal->integer;
+  return (valueNumber > literalNumber) - (valueNumber < literalNumber);
+}
+
+/* A field that is not there never matches, not even for != */
+static int query_predicate_matches(const query_predicate *predicate, const char *json, size_t start, size_t end) {
+  size_t valueStart;
+  size_t valueEnd;
+  if (!find_query_value(json, start, end, &predicate->field, &valueStart, &valueEnd)) {
+    return 0;
+  }
+  int order;
+  if (predicate->type == SEAJSON_TYPE_STRING) {
+    if (json[valueStart] != '\"') {
+      return 0;
+    }
+    order = !json_key_equals(json, valueStart + 1, valueEnd - 1, predicate->string, predicate->stringLength);
+  } else if (predicate->type == SEAJSON_TYPE_DOUBLE) {
+    json_number number;
+    if (json[valueStart] != '-' && !isdigit((unsigned char)json[valueStart])) {
+      return 0;
+    }
+    if (scan_json_number(json, valueEnd, valueStart, &number) == SEAJSON_SCAN_FAILED) {
+      return 0;
+    }
+    order = compare_query_numbers(&number, &predicate->number);
+  } else if (predicate->type == SEAJSON_TYPE_OBJECT || predicate->type == SEAJSON_TYPE_ARRAY) {
+    if (json[valueStart] != (predicate->type == SEAJSON_TYPE_OBJECT ? '{' : '[')) {
+      return 0;
+    }
+    order = !json_equals_minified(json + valueStart, valueEnd - valueStart, predicate->string, predicate->stringLength);
+  } else {
+    order = (json_value_type(json, valueStart, valueEnd) != predicate->type);
+  }
+  switch (predicate->comparison) {
+    case QUERY_EQUAL:
+      return order == 0;
+    case QUERY_NOT_EQUAL:
+      return order != 0;
+    case QUERY_LESS:
+      return order < 0;
+    case QUERY_LESS_EQUAL:
+      return order <= 0;
+    case QUERY_GREATER:
+      return order > 0;
+    case QUERY_GREATER_EQUAL:
+      return order >= 0;
+  }
+  return 0;
+}
+
+long long run_seajson_query(seajson json, const seajson_query *query, seajson_query_callback callback, void *context) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_RUN_SEAJSON_QUERY);
+  use_document_allocator(json);
+  size_t arrayStart;
+  size_t arrayEnd;
+  /* Items are skipped over once to find the next one, and each predicate and the projection then look up their own field in it (stopping at the first predicate that fails) */
+  member_scanner items;
+  if (query->array.keyCount == 0) {
+    /* The document is the array, so it is only known in windows like in lookups */
+    arrayStart = start_terminated_json(json, &arrayEnd);
+    if (arrayStart == SEAJSON_SCAN_FAILED || json[arrayStart] != '[') {
+      return -1;
+    }
+    member_scanner_init_terminated(&items, json, arrayEnd, arrayStart);
+  } else {
+    /* Once the first key is found the rest of the path is inside its value */
+    member_scanner scanner;
+    if (!find_top_level_member_terminated(json, query->array.keys[0], &scanner)) {
+      return -1;
+    }
+    query_path rest = query->array;
+    rest.keys++;
+    rest.keyCount--;
+    if (!find_query_value(json, scanner.valueStart, scanner.valueEnd, &rest, &arrayStart, &arrayEnd) || json[arrayStart] != '[') {
+      return -1;
+    }
+    member_scanner_init(&items, json, arrayEnd, arrayStart);
+  }
+  long long itemIndex = -1;
+  long long matchCount = 0;
+  while (member_scanner_next(&items)) {
+    itemIndex++;
+    int matched = 1;
+    for (size_t i = 0; i < query->predicateCount && matched; i++) {
+      matched = query_predicate_matches(&query->predicates[i], json, items.valueStart, items.valueEnd);
+    }
+    if (!matched) {
+      continue;
+    }
+    size_t valueStart;
+    size_t valueEnd = items.valueEnd;
+    if (!find_query_value(json, items.valueStart, items.valueEnd, &query->projection, &valueStart, &valueEnd)) {
+      continue;
+    }
+    matchCount++;
+    seajson_view value;
+    value.start = json + valueStart;
+    value.length = valueEnd - valueStart;
+    if (callback && callback(value, itemIndex, context) != 0) {
+      break;
+    }
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_RUN_SEAJSON_QUERY, items.pos);
+  return items.failed ? -1 : matchCount;
+}
+
+static int collect_query_match(seajson_view value, long long itemIndex, void *context) {
+  (void)itemIndex;
+  jarray_builder *builder = context;
+  /* The builder was made with the global allocator, not the document's */
+  use_document_allocator(NULL);
+  if (!reserve_jarray_builder(builder, value.length + 1, 1)) {
+    return 1;
+  }
+  push_jarray_builder_item(builder, value.start, value.length);
+  return 0;
+}
+
+jarray query_seajson(seajson json, const char *query) {
+  jarray failed;
+  failed.itemCount = 0;
+  failed.arrayString = NULL;
+  failed.isValid = 0;
+  seajson_query *compiled = compile_seajson_query(query);
+  if (compiled == NULL) {
+    return failed;
+  }
+  jarray_builder builder = new_jarray_builder(0);
+  long long matchCount = run_seajson_query(json, compiled, collect_query_match, &builder);
+  free_seajson_query(compiled);
+  if (matchCount < 0 || !builder.isValid) {
+    free_jarray_builder(builder);
+    return failed;
+  }
+  return finalize_jarray_builder(&builder);
+}
+
+/* Batch loading */
+
+/* The part of the batch a worker still has to load, other workers steal from the back of it once theirs runs out */
+typedef struct {
+  seajson_mutex lock;
+  size_t next;
+  size_t end;
+} batch_range;
+
+typedef struct {
+  seajson_batch *batch;
+  const seajson_batch_options *options;
+  batch_range *ranges;
+  size_t workerCount;
+} batch_shared;
+
+typedef struct {
+  batch_shared *shared;
+  size_t id;
+  size_t failedCount;
+} batch_worker;
+
+static size_t cpu_count(void) {
+#ifndef _WIN32
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count > 0) ? (size_t)count : 1;
+#else
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors ? (size_t)info.dwNumberOfProcessors : 1;
+#endif
+}
+
+static int take_batch_item(batch_shared *shared, size_t id, size_t *item) {
+  batch_range *own = &shared->ranges[id];
+  seajson_mutex_lock(&own->lock);
+  if (own->next < own->end) {
+    *item = own->next++;
+    seajson_mutex_unlock(&own->lock);
+    return 1;
+  }
+  seajson_mutex_unlock(&own->lock);
+  /* Steal half of what the next worker with anything left has, so stealing does not have to happen for every item */
+  for (size_t i = 1; i < shared->workerCount; i++) {
+    batch_range *victim = &shared->ranges[(id + i) % shared->workerCount];
+    seajson_mutex_lock(&victim->lock);
+    size_t remaining = victim->end - victim->next;
+    if (remaining == 0) {
+      seajson_mutex_unlock(&victim->lock);
+      continue;
+    }
+    size_t stolenEnd = victim->end;
+    victim->end -= (remaining + 1) / 2;
+    size_t stolenStart = victim->end;
+    seajson_mutex_unlock(&victim->lock);
+    /* The victim is unlocked first so two workers stealing from each other can never deadlock */
+    seajson_mutex_lock(&own->lock);
+    own->next = stolenStart + 1;
+    own->end = stolenEnd;
+    seajson_mutex_unlock(&own->lock);
+    *item = stolenStart;
+    return 1;
+  }
+  return 0;
+}
+
+static void load_batch_item(batch_worker *worker, seajson_batch_item *item) {
+  const seajson_batch_options *options = worker->shared->options;
+  item->json = init_json_from_compressed_file(item->filename, &item->index);
+  if (item->json == NULL || !item->index.isValid) {
+    /* A document that read in but would not index (cut off for one) is a failure too */
+    if (item->json) {
+      free_json(item->json);
+      item->json = NULL;
+    }
+    worker->failedCount++;
+    return;
+  }
+  if (options->callback) {
+    item->result = options->callback(item->filename, item->json, &item->index, options->context);
+  }
+  if (options->freeDocuments) {
+    free_json(item->json);
+    free_seajson_index(item->index);
+    item->json = NULL;
+    item->index = new_seajson_index();
+  }
+}
+
+static void *batch_worker_main(void *argument) {
+  batch_worker *worker = argument;
+  size_t item;
+  while (take_batch_item(worker->shared, worker->id, &item)) {
+    load_batch_item(worker, &worker->shared->batch->items[item]);
+  }
+  return NULL;
+}
+
+static void run_seajson_batch(seajson_batch *batch, const seajson_batch_options *options) {
+  size_t workerCount = options->threadCount ? options->threadCount : cpu_count();
+  if (workerCount > batch->itemCount) {
+    workerCount = batch->itemCount;
+  }
+  if (workerCount == 0) {
+    return;
+  }
+  use_document_allocator(NULL);
+  batch_shared shared;
+  shared.batch = batch;
+  shared.options = options;
+  shared.workerCount = workerCount;
+  shared.ranges = sea_malloc(sizeof(batch_range) * workerCount);
+  batch_worker *workers = sea_malloc(sizeof(batch_worker) * workerCount);
+  seajson_thread *threads = sea_malloc(sizeof(seajson_thread) * workerCount);
+  int *started = sea_malloc(sizeof(int) * workerCount);
+  if (shared.ranges == NULL || workers == NULL || threads == NULL || started == NULL) {
+    fprintf(stderr, "SeaJSON Error: load_seajson_batch could not allocate\n");
+    batch->isValid = 0;
+    goto done;
+  }
+  for (size_t i = 0; i < workerCount; i++) {
+    seajson_mutex_init(&shared.ranges[i].lock);
+    shared.ranges[i].next = batch->itemCount * i / workerCount;
+    shared.ranges[i].end = batch->itemCount * (i + 1) / workerCount;
+    workers[i].shared = &shared;
+    workers[i].id = i;
+    workers[i].failedCount = 0;
+  }
+  /* This thread is worker 0, and the range of a worker that could not be started just gets stolen by the others */
+  for (size_t i = 1; i < workerCount; i++) {
+    started[i] = seajson_thread_start(&threads[i], batch_worker_main, &workers[i]);
+  }
+  batch_worker_main(&workers[0]);
+  for (size_t i = 1; i < workerCount; i++) {
+    if (started[i]) {
+      seajson_thread_join(threads[i]);
+    }
+  }
+  for (size_t i = 0; i < workerCount; i++) {
+    batch->failedCount += workers[i].failedCount;
+    seajson_mutex_destroy(&shared.ranges[i].lock);
+  }
+done:
+  use_document_allocator(NULL);
+  sea_free(shared.ranges);
+  sea_free(workers);
+  sea_free(threads);
+  sea_free(started);
+}
+
+static seajson_batch new_seajson_batch(size_t itemCount) {
+  seajson_batch batch;
+  batch.items = NULL;
+  batch.itemCount = 0;
+  batch.failedCount = 0;
+  batch.ownedFilenames = NULL;
+  batch.isValid = 1;
+  use_document_allocator(NULL);
+  batch.items = sea_malloc(sizeof(seajson_batch_item) * (itemCount ? itemCount : 1));
+  if (batch.items == NULL) {
+    fprintf(stderr, "SeaJSON Error: load_seajson_batch could not allocate\n");
+    batch.isValid = 0;
+    return batch;
+  }
+  batch.itemCount = itemCount;
+  for (size_t i = 0; i < itemCount; i++) {
+    batch.items[i].filename = NULL;
+    batch.items[i].json = NULL;
+    batch.items[i].index = new_seajson_index();
+    batch.items[i].result = NULL;
+  }
+  return batch;
+}
+
+seajson_batch load_seajson_batch(const char *const *filenames, size_t count, const seajson_batch_options *options) {
+  seajson_batch_options defaults;
+  memset(&defaults, 0, sizeof(defaults));
+  seajson_batch batch = new_seajson_batch(count);
+  if (!batch.isValid) {
+    return batch;
+  }
+  for (size_t i = 0; i < count; i++) {
+    batch.items[i].filename = filenames[i];
+  }
+  run_seajson_batch(&batch, options ? options : &defaults);
+  return batch;
+}
+
+static int compare_filenames(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Adds directory/name to names, growing it as needed. Returns 0 if it could not allocate. */
+static int push_batch_filename(char ***names, size_t *count, size_t *capacity, const char *directory, const char *name) {
+  if (*count == *capacity) {
+    size_t newCapacity = *capacity ? *capacity * 2 : 64;
+    char **newNames = sea_realloc(*names, sizeof(char *) * newCapacity);
+    if (newNames == NULL) {
+      return 0;
     }
-    for (int i = stringPos + offset; i < jsonLen; i++) {
-      returnJson[i-offset] = json[i];
+    *names = newNames;
+    *capacity = newCapacity;
+  }
+  size_t directoryLength = strlen(directory);
+  size_t nameLength = strlen(name);
+  char *filename = sea_malloc(directoryLength + nameLength + 2);
+  if (filename == NULL) {
+    return 0;
+  }
+  memcpy(filename, directory, directoryLength);
+  filename[directoryLength] = '/';
+  memcpy(filename + directoryLength + 1, name, nameLength + 1);
+  (*names)[(*count)++] = filename;
+  return 1;
+}
+
+static int has_suffix(const char *name, const char *suffix) {
+  size_t nameLength = strlen(name);
+  size_t suffixLength = strlen(suffix);
+  return nameLength >= suffixLength && strcmp(name + nameLength - suffixLength, suffix) == 0;
+}
+
+seajson_batch load_seajson_directory(const char *directory, const char *suffix, const seajson_batch_options *options) {
+  use_document_allocator(NULL);
+  char **names = NULL;
+  size_t count = 0;
+  size_t capacity = 0;
+  int failed = 0;
+#ifndef _WIN32
+  DIR *dir = opendir(directory);
+  if (dir == NULL) {
+    fprintf(stderr, "SeaJSON Error: load_seajson_directory could not open %s\n", directory);
+    failed = 1;
+  }
+  struct dirent *entry;
+  while (!failed && (entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.' || (suffix && !has_suffix(entry->d_name, suffix))) {
+      continue;
     }
-    returnJson[jsonLen - keyLen - 5] = '\0';
-    return returnJson;
+    failed = !push_batch_filename(&names, &count, &capacity, directory, entry->d_name);
+    struct stat fileStat;
+    if (!failed && (stat(names[count - 1], &fileStat) != 0 || !S_ISREG(fileStat.st_mode))) {
+      sea_free(names[--count]);
+    }
+  }
+  if (dir) {
+    closedir(dir);
+  }
+#else
+  size_t directoryLength = strlen(directory);
+  char *pattern = sea_malloc(directoryLength + 3);
+  HANDLE find = INVALID_HANDLE_VALUE;
+  WIN32_FIND_DATAA entry;
+  if (pattern) {
+    memcpy(pattern, directory, directoryLength);
+    memcpy(pattern + directoryLength, "/*", 3);
+    find = FindFirstFileA(pattern, &entry);
+    sea_free(pattern);
+  }
+  if (find == INVALID_HANDLE_VALUE) {
+    fprintf(stderr, "SeaJSON Error: load_seajson_directory could not open %s\n", directory);
+    failed = 1;
   } else {
-    /* key not in remove_string_seajson */
-    /* TODO: Allocate new json and return it, for now just return our pointer */
-    return json;
+    do {
+      if (entry.cFileName[0] == '.' || (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || (suffix && !has_suffix(entry.cFileName, suffix))) {
+        continue;
+      }
+      failed = !push_batch_filename(&names, &count, &capacity, directory, entry.cFileName);
+    } while (!failed && FindNextFileA(find, &entry));
+    FindClose(find);
+  }
+#endif
+  seajson_batch batch;
+  if (failed) {
+    batch = new_seajson_batch(0);
+    batch.isValid = 0;
+  } else {
+    /* Directories list in whatever order the filesystem likes, sorting makes the order of the items the same every time */
+    qsort(names, count, sizeof(char *), compare_filenames);
+    batch = load_seajson_batch((const char *const *)names, count, options);
+  }
+  use_document_allocator(NULL);
+  /* Once there are items they point into names, even if the batch did not finish loading */
+  if (batch.items == NULL || failed) {
+    for (size_t i = 0; i < count; i++) {
+      sea_free(names[i]);
+    }
+    sea_free(names);
+    return batch;
   }
+  batch.ownedFilenames = names;
+  return batch;
 }
 
-seajson set_item_seajson(seajson json, const char *key, const char *value) {
-  int stringPos = get_pos_item_seajson(json,key); /* TODO: This ONLY works on strings !!! */
-  if (stringPos != -1) {
-    unsigned long keyLen = strlen(key);
-    unsigned long valueLen = strlen(value);
-    unsigned long jsonLen = strlen(json);
-    unsigned long offset = 0;
-    stringPos += 2;
-    seajson returnJson = malloc(sizeof(char) * (jsonLen + keyLen + valueLen + 6));
-    for (int i = 0; i < stringPos; i++) {
-      returnJson[i] = json[i];
+void free_seajson_batch(seajson_batch batch) {
+  for (size_t i = 0; i < batch.itemCount; i++) {
+    if (batch.items[i].json) {
+      free_json(batch.items[i].json);
     }
-    /* TODO: Handle if the ending " cannot be found */
-    int inception = 0;
-    int inceptionInString = 0;
-    for (int i = stringPos; i < jsonLen; i++) {
-      if (json[i] == '\"') {
-        if (json[i-1] != '\\') {
-          inceptionInString = !inceptionInString;
-        }
-      } else if (json[i] == '{') {
-        if (!inceptionInString) {
-          inception++;
-        }
-      } else if (json[i] == '}') {
-        if (!inceptionInString) {
-          if (inception == 0) {
-            break;
+    free_seajson_index(batch.items[i].index);
+  }
+  use_document_allocator(NULL);
+  if (batch.ownedFilenames) {
+    for (size_t i = 0; i < batch.itemCount; i++) {
+      sea_free(batch.ownedFilenames[i]);
+    }
+    sea_free(batch.ownedFilenames);
+  }
+  sea_free(batch.items);
+}
+
+/* SAX parsing */
+
+typedef enum {
+  SAX_VALUE,
+  SAX_KEY,
+  SAX_AFTER_VALUE
+} sax_state;
+
+/* Calls handler->name with its arguments if it is set, stopping the parse if it returns non zero */
+#define SAX_EMIT(name, ...) do { \
+    if (handler->name && handler->name(__VA_ARGS__) != 0) { \
+      result = 1; \
+      goto done; \
+    } \
+  } while (0)
+
+/* Like find_json_string_end, but also checks the string is valid json (no raw control characters, only known escapes). Returns length if it is not. */
+static size_t find_valid_json_string_end(const char *json, size_t length, size_t pos) {
+  while (pos < length) {
+    unsigned char currentChar = (unsigned char)json[pos];
+    if (currentChar == '\"') {
+      return pos;
+    }
+    if (currentChar < 0x20) {
+      return length;
+    }
+    if (currentChar == '\\') {
+      if (++pos >= length) {
+        return length;
+      }
+      switch (json[pos]) {
+        case '\"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+          break;
+        case 'u':
+          if (length - pos <= 4 || read_json_hex4(json + pos + 1) < 0) {
+            return length;
           }
-          inception--;
+          pos += 4;
+          break;
+        default:
+          return length;
+      }
+    }
+    pos++;
+  }
+  return length;
+}
+
+static int sax_parse(const char *json, size_t length, const seajson_sax_handler *handler, void *context) {
+  /* Whether every open container is an object, one bit each */
+  unsigned char stackObjects[64];
+  unsigned char *objects = stackObjects;
+  size_t objectsCapacity = sizeof(stackObjects) * 8;
+  size_t depth = 0;
+  int result = -1;
+  sax_state state = SAX_VALUE;
+  size_t pos = skip_json_whitespace(json, length, 0);
+  for (;;) {
+    if (state == SAX_KEY) {
+      if (pos >= length || json[pos] != '\"') {
+        goto done;
+      }
+      size_t keyEnd = find_valid_json_string_end(json, length, pos + 1);
+      if (keyEnd >= length) {
+        goto done;
+      }
+      seajson_view key;
+      key.start = json + pos + 1;
+      key.length = keyEnd - pos - 1;
+      SAX_EMIT(key, key, context);
+      pos = skip_json_whitespace(json, length, keyEnd + 1);
+      if (pos >= length || json[pos] != ':') {
+        goto done;
+      }
+      pos = skip_json_whitespace(json, length, pos + 1);
+      state = SAX_VALUE;
+      continue;
+    }
+    if (state == SAX_AFTER_VALUE) {
+      pos = skip_json_whitespace(json, length, pos);
+      if (depth == 0) {
+        /* Only whitespace is allowed after the root value */
+        result = (pos < length) ? -1 : 0;
+        goto done;
+      }
+      int inObject = (objects[(depth - 1) / 8] >> ((depth - 1) % 8)) & 1;
+      if (pos >= length) {
+        goto done;
+      }
+      if (json[pos] == ',') {
+        pos = skip_json_whitespace(json, length, pos + 1);
+        state = inObject ? SAX_KEY : SAX_VALUE;
+      } else if (json[pos] == (inObject ? '}' : ']')) {
+        depth--;
+        pos++;
+        if (inObject) {
+          SAX_EMIT(endObject, context);
+        } else {
+          SAX_EMIT(endArray, context);
         }
-      } else if (json[i] == '[') {
-        if (!inceptionInString) {
-          inception++;
+      } else {
+        goto done;
+      }
+      continue;
+    }
+    if (pos >= length) {
+      goto done;
+    }
+    char currentChar = json[pos];
+    if (currentChar == '{' || currentChar == '[') {
+      int isObject = (currentChar == '{');
+      if (depth == objectsCapacity) {
+        size_t newCapacity = objectsCapacity * 2;
+        unsigned char *newObjects = sea_malloc(newCapacity / 8);
+        if (newObjects == NULL) {
+          fprintf(stderr, "SeaJSON Error: parse_seajson_sax could not allocate\n");
+          goto done;
         }
-      } else if (json[i] == ']') {
-        if (!inceptionInString) {
-          inception--;
+        memcpy(newObjects, objects, objectsCapacity / 8);
+        if (objects != stackObjects) {
+          sea_free(objects);
         }
-      } else if (json[i] == ',') {
-        if (!inceptionInString) {
-          if (inception == 0) {
-            break;
-          }
+        objects = newObjects;
+        objectsCapacity = newCapacity;
+      }
+      if (isObject) {
+        objects[depth / 8] |= (unsigned char)(1 << (depth % 8));
+        SAX_EMIT(startObject, context);
+      } else {
+        objects[depth / 8] &= (unsigned char)~(1 << (depth % 8));
+        SAX_EMIT(startArray, context);
+      }
+      depth++;
+      pos = skip_json_whitespace(json, length, pos + 1);
+      if (pos < length && json[pos] == (isObject ? '}' : ']')) {
+        depth--;
+        pos++;
+        if (isObject) {
+          SAX_EMIT(endObject, context);
+        } else {
+          SAX_EMIT(endArray, context);
         }
+        state = SAX_AFTER_VALUE;
+      } else {
+        state = isObject ? SAX_KEY : SAX_VALUE;
       }
-      offset++;
-    }
-    /* Copy value to returnJson */
-    for (int i = 0; i < valueLen; i++) {
-      returnJson[i+stringPos] = value[i];
+      continue;
     }
-    /* Copy rest of json */
-    for (int i = stringPos + offset; i < jsonLen; i++) {
-      returnJson[(i-offset)+valueLen] = json[i];
+    seajson_view value;
+    value.start = json + pos;
+    if (currentChar == '\"') {
+      size_t stringEnd = find_valid_json_string_end(json, length, pos + 1);
+      if (stringEnd >= length) {
+        goto done;
+      }
+      value.start++;
+      value.length = stringEnd - pos - 1;
+      pos = stringEnd + 1;
+      SAX_EMIT(string, value, context);
+    } else if (currentChar == '-' || (currentChar >= '0' && currentChar <= '9')) {
+      seajson_number number;
+      size_t numberEnd = scan_json_number(json, length, pos, &number);
+      if (numberEnd == SEAJSON_SCAN_FAILED) {
+        goto done;
+      }
+      value.length = numberEnd - pos;
+      pos = numberEnd;
+      SAX_EMIT(number, value, number, context);
+    } else if (length - pos >= 4 && memcmp(json + pos, "true", 4) == 0) {
+      pos += 4;
+      SAX_EMIT(boolean, 1, context);
+    } else if (length - pos >= 5 && memcmp(json + pos, "false", 5) == 0) {
+      pos += 5;
+      SAX_EMIT(boolean, 0, context);
+    } else if (length - pos >= 4 && memcmp(json + pos, "null", 4) == 0) {
+      pos += 4;
+      SAX_EMIT(null, context);
+    } else {
+      goto done;
     }
-    /* TODO: NULL terminate returnJson */
-    return returnJson;
-  } else {
-    /* key not in remove_string_seajson, call add_item_seajson */
-    return add_item_seajson(json, key, value);
+    state = SAX_AFTER_VALUE;
+  }
+done:
+  if (result < 0) {
+    fprintf(stderr, "SeaJSON Error: parse_seajson_sax found broken json at %zu\n", pos);
+  }
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_PARSE_SEAJSON_SAX, pos);
+  if (objects != stackObjects) {
+    sea_free(objects);
   }
+  return result;
 }
 
-#if 0
+#undef SAX_EMIT
 
-/* from a failed attempt to make set_item_seajson, I made a function which renames a key... */
-seajson set_item_seajson(seajson json, const char *key, const char *value) {
-  int stringPos = get_pos_item_seajson(json,key); /* TODO: This ONLY works on strings !!! */
-  if (stringPos != -1) {
-    unsigned long keyLen = strlen(key);
-    unsigned long valueLen = strlen(value);
-    unsigned long jsonLen = strlen(json);
-    unsigned long offset = 0;
-    seajson returnJson = malloc(sizeof(char) * (jsonLen + keyLen + valueLen + 6));
-    for (int i = 0; i < stringPos; i++) {
-      returnJson[i] = json[i];
+int parse_seajson_sax(seajson json, const seajson_sax_handler *handler, void *context) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_PARSE_SEAJSON_SAX);
+  use_document_allocator(NULL);
+  size_t length = strlen(json);
+  SEAJSON_STAT_FULL_SCAN(SEAJSON_STAT_PARSE_SEAJSON_SAX, length);
+  return sax_parse(json, length, handler, context);
+}
+
+int parse_seajson_sax_view(seajson_view json, const seajson_sax_handler *handler, void *context) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_PARSE_SEAJSON_SAX);
+  use_document_allocator(NULL);
+  return sax_parse(json.start, json.length, handler, context);
+}
+
+/* Formatting */
+
+#define SEAJSON_FORMAT_BUFFER_SIZE ((size_t)64 * 1024)
+
+static seajson_formatter new_seajson_formatter(const char *indent, seajson_write_callback write, void *context) {
+  use_document_allocator(NULL);
+  seajson_formatter formatter;
+  formatter.write = write;
+  formatter.context = context;
+  formatter.buffer = sea_malloc(SEAJSON_FORMAT_BUFFER_SIZE);
+  formatter.bufferLength = 0;
+  formatter.indent = indent;
+  formatter.indentLength = indent ? strlen(indent) : 0;
+  formatter.depth = 0;
+  formatter.inString = 0;
+  formatter.escaped = 0;
+  formatter.openPending = 0;
+  formatter.isValid = (formatter.buffer != NULL);
+  if (!formatter.isValid) {
+    fprintf(stderr, "SeaJSON Error: new_seajson_formatter could not allocate\n");
+  }
+  return formatter;
+}
+
+seajson_formatter new_seajson_minifier(seajson_write_callback write, void *context) {
+  return new_seajson_formatter(NULL, write, context);
+}
+
+seajson_formatter new_seajson_pretty_printer(const char *indent, seajson_write_callback write, void *context) {
+  return new_seajson_formatter(indent ? indent : "  ", write, context);
+}
+
+static void flush_formatter(seajson_formatter *formatter) {
+  if (formatter->bufferLength && formatter->isValid && formatter->write(formatter->buffer, formatter->bufferLength, formatter->context) != 0) {
+    formatter->isValid = 0;
+  }
+  formatter->bufferLength = 0;
+}
+
+static void formatter_write(seajson_formatter *formatter, const char *data, size_t length) {
+  if (length > SEAJSON_FORMAT_BUFFER_SIZE - formatter->bufferLength) {
+    flush_formatter(formatter);
+    if (length >= SEAJSON_FORMAT_BUFFER_SIZE) {
+      /* Too big to be worth buffering */
+      if (formatter->isValid && formatter->write(data, length, formatter->context) != 0) {
+        formatter->isValid = 0;
+      }
+      return;
     }
-    /* TODO: Handle if the ending " cannot be found */
-    int inception = 0;
-    int inceptionInString = 0;
-    for (int i = stringPos; i < jsonLen; i++) {
-      if (json[i] == '\"') {
-        if (json[i-1] != '\\') {
-          if (inception == 0) {
-            offset++;
-            break;
-          } else {
-            inceptionInString = !inceptionInString;
-          }
-        }
-      } else if (json[i] == '{') {
-        if (!inceptionInString) {
-          inception++;
-        }
-      } else if (json[i] == '}') {
-        if (!inceptionInString) {
-          inception--;
-        }
-      } else if (json[i] == '[') {
-        if (!inceptionInString) {
-          inception++;
-        }
-      } else if (json[i] == ']') {
-        if (!inceptionInString) {
-          inception--;
-        }
-      } else if (json[i] == ',') {
-        if (!inceptionInString) {
-          if (inception == 0) {
-            offset++;
-            break;
-          }
-        }
+  }
+  memcpy(formatter->buffer + formatter->bufferLength, data, length);
+  formatter->bufferLength += length;
+}
+
+static void formatter_newline(seajson_formatter *formatter) {
+  formatter_write(formatter, "\n", 1);
+  for (uint64_t i = 0; i < formatter->depth; i++) {
+    formatter_write(formatter, formatter->indent, formatter->indentLength);
+  }
+}
+
+/* The newline after a { or [ waits until there is something in it, so empty ones stay {} and [] */
+static void formatter_open_pending(seajson_formatter *formatter) {
+  if (formatter->openPending) {
+    formatter->openPending = 0;
+    formatter_newline(formatter);
+  }
+}
+
+int seajson_formatter_feed(seajson_formatter *formatter, const char *chunk, size_t length) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_SEAJSON_FORMATTER_FEED);
+  SEAJSON_STAT_SCANNED(SEAJSON_STAT_SEAJSON_FORMATTER_FEED, length);
+  int pretty = (formatter->indent != NULL);
+  size_t i = 0;
+  while (i < length && formatter->isValid) {
+    if (formatter->inString) {
+      if (formatter->escaped) {
+        formatter->escaped = 0;
+        formatter_write(formatter, chunk + i, 1);
+        i++;
+        continue;
       }
-      offset++;
+      size_t run = find_byte_of(chunk + i, length - i, &stringChars);
+      formatter_write(formatter, chunk + i, run);
+      i += run;
+      if (i >= length) {
+        break;
+      }
+      if (chunk[i] == '\\') {
+        formatter->escaped = 1;
+      } else {
+        formatter->inString = 0;
+      }
+      formatter_write(formatter, chunk + i, 1);
+      i++;
+      continue;
     }
-    /* Copy value to returnJson */
-    for (int i = 0; i < valueLen; i++) {
-      returnJson[i+stringPos] = value[i];
+    /* Whitespace is only ever dropped, so everything up to the next byte that matters is copied in one go */
+    size_t run = find_byte_of(chunk + i, length - i, pretty ? &prettyChars : &minifyChars);
+    if (run) {
+      formatter_open_pending(formatter);
+      formatter_write(formatter, chunk + i, run);
+      i += run;
+      continue;
     }
-    /* Copy rest of json */
-    for (int i = stringPos + offset; i < jsonLen; i++) {
-      returnJson[(i-offset)+valueLen] = json[i];
+    char currentChar = chunk[i++];
+    if (is_json_whitespace(currentChar)) {
+      continue;
+    }
+    if (currentChar == '\"') {
+      formatter_open_pending(formatter);
+      formatter->inString = 1;
+      formatter_write(formatter, &currentChar, 1);
+      continue;
+    }
+    /* Only pretty printing stops on anything else */
+    if (currentChar == '{' || currentChar == '[') {
+      formatter_open_pending(formatter);
+      formatter_write(formatter, &currentChar, 1);
+      formatter->depth++;
+      formatter->openPending = 1;
+    } else if (currentChar == '}' || currentChar == ']') {
+      if (formatter->depth) {
+        formatter->depth--;
+      }
+      if (formatter->openPending) {
+        formatter->openPending = 0;
+      } else {
+        formatter_newline(formatter);
+      }
+      formatter_write(formatter, &currentChar, 1);
+    } else if (currentChar == ',') {
+      formatter_write(formatter, ",", 1);
+      formatter_newline(formatter);
+    } else {
+      formatter_write(formatter, ": ", 2);
     }
-    /* TODO: NULL terminate returnJson */
-    return returnJson;
-  } else {
-    /* key not in remove_string_seajson, call add_item_seajson */
-    return add_item_seajson(json, key, value);
   }
+  return formatter->isValid ? 0 : -1;
 }
-#endif
 
-jarray new_jarray(void) {
-  jarray returnJarray;
-  returnJarray.arrayString = "[]";
-  returnJarray.itemCount = 0;
-  returnJarray.isValid = 1;
-  return returnJarray;
+int seajson_formatter_finish(seajson_formatter *formatter) {
+  flush_formatter(formatter);
+  use_document_allocator(NULL);
+  sea_free(formatter->buffer);
+  formatter->buffer = NULL;
+  if (formatter->inString || formatter->depth) {
+    fprintf(stderr, "SeaJSON Error: seajson_formatter_finish json ended in the middle of a %s\n", formatter->inString ? "string" : "container");
+    formatter->isValid = 0;
+  }
+  return formatter->isValid ? 0 : -1;
+}
+
+size_t minify_seajson_in_place(seajson json) {
+  SEAJSON_STAT_SCOPE(SEAJSON_STAT_REMOVE_WHITESPACE_FROM_JSON);
+  size_t length = copy_json_minified(json, strlen(json), json);
+  json[length] = '\0';
+  return length;
+}
+
+static int write_to_byte_buffer(const char *data, size_t length, void *context) {
+  byte_buffer *buffer = context;
+  byte_buffer_append(buffer, data, length);
+  return buffer->failed ? -1 : 0;
+}
+
+seajson pretty_print_seajson(seajson json, const char *indent) {
+  seajson_formatter formatter = new_seajson_pretty_printer(indent, write_to_byte_buffer, NULL);
+  /* The output belongs to json's allocator, the formatter's own buffer to the global one */
+  use_document_allocator(json);
+  size_t length = strlen(json);
+  byte_buffer out = { NULL, 0, 0, 0 };
+  formatter.context = &out;
+  byte_buffer_reserve(&out, length + length / 2 + 1);
+  seajson_formatter_feed(&formatter, json, length);
+  int result = seajson_formatter_finish(&formatter);
+  use_document_allocator(json);
+  byte_buffer_push(&out, '\0');
+  if (result != 0 || out.failed) {
+    sea_free(out.data);
+    return NULL;
+  }
+  return adopt_document((seajson)out.data);
+}
+
+typedef struct {
+  FILE *fp;
+  long long written;
+} format_file_output;
+
+static int write_to_format_file(const char *data, size_t length, void *context) {
+  format_file_output *output = context;
+  if (fwrite(data, 1, length, output->fp) != length) {
+    return -1;
+  }
+  output->written += (long long)length;
+  return 0;
+}
+
+/* Streams in through the formatter to out, decompressing in if it needs to be. Returns the bytes written or -1. */
+static long long format_seajson_file(FILE *in, FILE *out, const char *indent) {
+  format_file_output output = { out, 0 };
+  seajson_formatter formatter = new_seajson_formatter(indent, write_to_format_file, &output);
+  compressed_reader reader;
+  char *block = sea_malloc(SEAJSON_COMPRESSED_BLOCK_SIZE);
+  if (block == NULL || !formatter.isValid || open_compressed_reader(&reader, in) != 0) {
+    sea_free(block);
+    seajson_formatter_finish(&formatter);
+    return -1;
+  }
+  size_t readCount;
+  while ((readCount = compressed_reader_read(&reader, block, SEAJSON_COMPRESSED_BLOCK_SIZE)) > 0) {
+    if (seajson_formatter_feed(&formatter, block, readCount) != 0) {
+      break;
+    }
+  }
+  int failed = reader.failed;
+  close_compressed_reader(&reader);
+  use_document_allocator(NULL);
+  sea_free(block);
+  if (seajson_formatter_finish(&formatter) != 0 || failed) {
+    return -1;
+  }
+  return output.written;
+}
+
+long long minify_seajson_file(FILE *in, FILE *out) {
+  return format_seajson_file(in, out, NULL);
+}
+
+long long pretty_print_seajson_file(FILE *in, FILE *out, const char *indent) {
+  return format_seajson_file(in, out, indent ? indent : "  ");
 }
 
 /* Only kept for backwards compatibility with original SeaJSON library - THIS FUNCTION IS NOT SAFE !!!! DO NOT USE !!! */
@@ -9,44 +9,808 @@
  * Snoolie K / 0xilis.
 */
 
+#ifndef SEAJSON_H
+#define SEAJSON_H
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef char* seajson;
 
 typedef struct {
-  int itemCount;
+  long long itemCount;
   char* arrayString;
   int isValid;
 } jarray;
 
+/*
+ * Container index. Records where every object and array starts and ends
+ * as 64 bit offsets, so lookups can jump over nested values without
+ * reading them. It is built incrementally: feed the document in order in
+ * chunks of any size and the scan picks up where the last chunk stopped,
+ * so it can run while a file is still being read in. A hashed index also
+ * gives every container a hash of its contents (whitespace between tokens
+ * does not count) for finding repeated sub-documents.
+ */
+typedef struct {
+  uint64_t start;  /* The { or [ */
+  uint64_t end;    /* Right after the matching } or ], 0 while it is still open */
+  uint64_t after;  /* The first container after this one, for jumping to the next sibling */
+  uint64_t hash;   /* Content hash, hashed indexes only */
+  uint64_t hashedBytes;  /* How many bytes went into hash */
+} seajson_index_container;
+
+typedef struct {
+  seajson_index_container *containers;
+  uint64_t containerCount;
+  uint64_t containerCapacity;
+  uint64_t *openContainers;
+  uint64_t depth;
+  uint64_t openCapacity;
+  uint64_t length;  /* Bytes fed so far */
+  uint64_t runningHash;
+  uint64_t hashedBytes;
+  int inString;
+  int escaped;
+  int hashContents;
+  int isValid;
+} seajson_index;
+
 /* Functions */
 
-seajson init_json_from_file(const char *restrict filename);
+seajson init_json_from_file(const char *filename);
 void free_json(seajson json);
 char* get_string(seajson json, const char *value);
 unsigned long get_int(seajson json, const char *value);
 seajson get_dictionary(seajson json, const char *value);
 jarray get_array(seajson json, const char *value);
 jarray new_jarray(void);
-char* get_item_from_jarray(jarray array, int index);
+char* get_item_from_jarray(jarray array, long long index);
 void free_jarray(jarray array);
 seajson remove_whitespace_from_json(seajson json);
 jarray remove_whitespace_from_jarray(jarray array);
-char* get_string_from_jarray(jarray array, int index);
-int get_int_from_jarray(jarray array, int index);
+char* get_string_from_jarray(jarray array, long long index);
+int get_int_from_jarray(jarray array, long long index);
 jarray add_item_to_jarray(jarray array, char* item);
-/* Maybe soon: jarray set_item_of_jarray(jarray array, int index, char* item); */
-jarray remove_item_of_jarray(jarray array, int index);
+/* Maybe soon: jarray set_item_of_jarray(jarray array, long long index, char* item); */
+jarray remove_item_of_jarray(jarray array, long long index);
 int seaJSONBuildVersion(void);
 seajson add_string_seajson(seajson json, char* key, char *value);
 seajson add_item_seajson(seajson json, char* key, char *value);
-int get_pos_string_seajson(seajson json, const char *value);
+long long get_pos_string_seajson(seajson json, const char *value);
 seajson remove_string_seajson(seajson json, const char *key);
 seajson remove_item_seajson(seajson json, const char *key);
-int get_pos_item_seajson(seajson json, const char *value);
+long long get_pos_item_seajson(seajson json, const char *value);
 seajson set_item_seajson(seajson json, const char *key, const char *value);
 
+/* Value types. These are also the tags stored in SeaJSON binary files, so never renumber them. */
+typedef enum {
+  SEAJSON_TYPE_INVALID = 0,
+  SEAJSON_TYPE_NULL = 1,
+  SEAJSON_TYPE_FALSE = 2,
+  SEAJSON_TYPE_TRUE = 3,
+  SEAJSON_TYPE_INT = 4,
+  SEAJSON_TYPE_DOUBLE = 5,
+  SEAJSON_TYPE_STRING = 6,
+  SEAJSON_TYPE_ARRAY = 7,
+  SEAJSON_TYPE_OBJECT = 8
+} seajson_type;
+
+/* A parsed number, integer is also set for doubles (truncated, saturating at LLONG_MIN/LLONG_MAX) and number for integers */
+typedef struct {
+  long long integer;
+  double number;
+  int isDouble;
+} seajson_number;
+
+/*
+ * SeaJSON binary is a tape of typed values. Strings are stored
+ * length-prefixed, already unescaped and NULL terminated, numbers are
+ * stored already parsed and arrays/objects store their byte size so
+ * they can be skipped without reading them. A seajson_binary is either
+ * the owner of a tape (from seajson_to_binary or init_binary_from_file)
+ * or a view of a value inside of one (mapping is NULL for views).
+ */
+typedef struct {
+  const unsigned char *value;
+  const unsigned char *end;
+  void *mapping;
+  size_t mappingSize;
+  int isMapped;
+  int isValid;
+} seajson_binary;
+
+seajson_binary seajson_to_binary(seajson json);
+seajson binary_to_seajson(seajson_binary binary);
+int write_binary_to_file(seajson_binary binary, const char *filename);
+seajson_binary init_binary_from_file(const char *filename);
+void free_binary(seajson_binary binary);
+seajson_type get_type_of_binary(seajson_binary binary);
+seajson_binary get_value_from_binary(seajson_binary binary, const char *key);
+const char* get_string_from_binary(seajson_binary binary, const char *key);
+long long get_int_from_binary(seajson_binary binary, const char *key);
+double get_double_from_binary(seajson_binary binary, const char *key);
+size_t get_count_of_binary(seajson_binary binary);
+seajson_binary get_item_from_binary(seajson_binary binary, size_t index);
+const char* binary_as_string(seajson_binary binary);
+long long binary_as_int(seajson_binary binary);
+double binary_as_double(seajson_binary binary);
+int binary_as_bool(seajson_binary binary);
+
+/*
+ * Schema decoding. Describe a struct with an array of seajson_field
+ * (usually with the SEAJSON_*_FIELD macros below, which use the member
+ * name as the key) and decode_seajson fills it in one pass over the
+ * json without allocating. Keys not in the schema are skipped, members
+ * whose key is missing are left untouched.
+ */
+typedef enum {
+  SEAJSON_FIELD_STRING,       /* char array member, the string is truncated to fit */
+  SEAJSON_FIELD_INT,          /* any integer member, size picks the type */
+  SEAJSON_FIELD_DOUBLE,       /* float or double member */
+  SEAJSON_FIELD_BOOL,         /* any integer member, set to 1 or 0 */
+  SEAJSON_FIELD_INT_ARRAY,    /* fixed size array of integers */
+  SEAJSON_FIELD_DOUBLE_ARRAY, /* fixed size array of float/double */
+  SEAJSON_FIELD_OBJECT,       /* nested struct described by fields */
+  SEAJSON_FIELD_OBJECT_ARRAY  /* fixed size array of nested structs described by fields */
+} seajson_field_type;
+
+#define SEAJSON_NO_COUNT ((size_t)-1)
+
+typedef struct seajson_field {
+  const char *key;
+  size_t keyLength;
+  seajson_field_type type;
+  size_t offset;
+  size_t size;          /* Size of the member, or of one item for arrays */
+  size_t capacity;      /* Max items for arrays */
+  size_t countOffset;   /* Offset of a size_t member that gets the item count, or SEAJSON_NO_COUNT */
+  const struct seajson_field *fields;
+  size_t fieldCount;
+} seajson_field;
+
+#define SEAJSON_FIELD_COUNT(fields) (sizeof(fields) / sizeof((fields)[0]))
+#define SEAJSON_MEMBER_SIZE(type, member) sizeof(((type *)0)->member)
+#define SEAJSON_ITEM_SIZE(type, member) sizeof(((type *)0)->member[0])
+
+#define SEAJSON_STRING_FIELD(type, member) \
+  { #member, sizeof(#member) - 1, SEAJSON_FIELD_STRING, offsetof(type, member), SEAJSON_MEMBER_SIZE(type, member), 0, SEAJSON_NO_COUNT, NULL, 0 }
+#define SEAJSON_INT_FIELD(type, member) \
+  { #member, sizeof(#member) - 1, SEAJSON_FIELD_INT, offsetof(type, member), SEAJSON_MEMBER_SIZE(type, member), 0, SEAJSON_NO_COUNT, NULL, 0 }
+#define SEAJSON_DOUBLE_FIELD(type, member) \
+  { #member, sizeof(#member) - 1, SEAJSON_FIELD_DOUBLE, offsetof(type, member), SEAJSON_MEMBER_SIZE(type, member), 0, SEAJSON_NO_COUNT, NULL, 0 }
+#define SEAJSON_BOOL_FIELD(type, member) \
+  { #member, sizeof(#member) - 1, SEAJSON_FIELD_BOOL, offsetof(type, member), SEAJSON_MEMBER_SIZE(type, member), 0, SEAJSON_NO_COUNT, NULL, 0 }
+#define SEAJSON_INT_ARRAY_FIELD(type, member) \
+  { #member, sizeof(#member) - 1, SEAJSON_FIELD_INT_ARRAY, offsetof(type, member), SEAJSON_ITEM_SIZE(type, member), \
+    SEAJSON_MEMBER_SIZE(type, member) / SEAJSON_ITEM_SIZE(type, member), SEAJSON_NO_COUNT, NULL, 0 }
+#define SEAJSON_DOUBLE_ARRAY_FIELD(type, member) \
+  { #member, sizeof(#member) - 1, SEAJSON_FIELD_DOUBLE_ARRAY, offsetof(type, member), SEAJSON_ITEM_SIZE(type, member), \
+    SEAJSON_MEMBER_SIZE(type, member) / SEAJSON_ITEM_SIZE(type, member), SEAJSON_NO_COUNT, NULL, 0 }
+#define SEAJSON_OBJECT_FIELD(type, member, subfields) \
+  { #member, sizeof(#member) - 1, SEAJSON_FIELD_OBJECT, offsetof(type, member), SEAJSON_MEMBER_SIZE(type, member), 0, \
+    SEAJSON_NO_COUNT, subfields, SEAJSON_FIELD_COUNT(subfields) }
+#define SEAJSON_OBJECT_ARRAY_FIELD(type, member, countMember, subfields) \
+  { #member, sizeof(#member) - 1, SEAJSON_FIELD_OBJECT_ARRAY, offsetof(type, member), SEAJSON_ITEM_SIZE(type, member), \
+    SEAJSON_MEMBER_SIZE(type, member) / SEAJSON_ITEM_SIZE(type, member), offsetof(type, countMember), subfields, SEAJSON_FIELD_COUNT(subfields) }
+
+int decode_seajson(seajson json, const seajson_field *fields, size_t fieldCount, void *out);
+
+/*
+ * Instrumentation. Counters are per thread and are only collected when
+ * SeaJSON is built with SEAJSON_STATS defined, otherwise the functions
+ * below still exist but everything stays 0. Time is inclusive, so
+ * get_string_from_jarray also counts towards get_item_from_jarray.
+ */
+typedef enum {
+  SEAJSON_STAT_INIT_JSON_FROM_FILE,
+  SEAJSON_STAT_GET_STRING,
+  SEAJSON_STAT_GET_INT,
+  SEAJSON_STAT_GET_DICTIONARY,
+  SEAJSON_STAT_GET_ARRAY,
+  SEAJSON_STAT_GET_ITEM_FROM_JARRAY,
+  SEAJSON_STAT_REMOVE_WHITESPACE_FROM_JSON,
+  SEAJSON_STAT_GET_STRING_FROM_JARRAY,
+  SEAJSON_STAT_GET_INT_FROM_JARRAY,
+  SEAJSON_STAT_REMOVE_ITEM_OF_JARRAY,
+  SEAJSON_STAT_ADD_ITEM_TO_JARRAY,
+  SEAJSON_STAT_ADD_STRING_SEAJSON,
+  SEAJSON_STAT_ADD_ITEM_SEAJSON,
+  SEAJSON_STAT_GET_POS_STRING_SEAJSON,
+  SEAJSON_STAT_GET_POS_ITEM_SEAJSON,
+  SEAJSON_STAT_REMOVE_STRING_SEAJSON,
+  SEAJSON_STAT_REMOVE_ITEM_SEAJSON,
+  SEAJSON_STAT_SET_ITEM_SEAJSON,
+  SEAJSON_STAT_SEAJSON_TO_BINARY,
+  SEAJSON_STAT_BINARY_TO_SEAJSON,
+  SEAJSON_STAT_INIT_BINARY_FROM_FILE,
+  SEAJSON_STAT_DECODE_SEAJSON,
+  SEAJSON_STAT_APPLY_SEAJSON_PATCH,
+  SEAJSON_STAT_SET_PATH_SEAJSON_MUTABLE,
+  SEAJSON_STAT_GET_INT32_ARRAY,
+  SEAJSON_STAT_GET_INT64_ARRAY,
+  SEAJSON_STAT_GET_DOUBLE_ARRAY,
+  SEAJSON_STAT_PROJECT_SEAJSON_LINES,
+  SEAJSON_STAT_SEAJSON_INDEX_FEED,
+  SEAJSON_STAT_GET_VALUE_INDEXED,
+  SEAJSON_STAT_SEAJSON_ITERATOR_NEXT,
+  SEAJSON_STAT_DEDUP_SEAJSON,
+  SEAJSON_STAT_GET_SLICE,
+  SEAJSON_STAT_SEAJSON_INDEX_SPLICE,
+  SEAJSON_STAT_RUN_SEAJSON_QUERY,
+  SEAJSON_STAT_PARSE_SEAJSON_SAX,
+  SEAJSON_STAT_SEAJSON_FORMATTER_FEED,
+  SEAJSON_STAT_FUNCTION_COUNT
+} seajson_stat_function;
+
+typedef struct {
+  unsigned long long calls[SEAJSON_STAT_FUNCTION_COUNT];
+  unsigned long long bytesScanned[SEAJSON_STAT_FUNCTION_COUNT];
+  unsigned long long nanoseconds[SEAJSON_STAT_FUNCTION_COUNT];
+  unsigned long long fullScans;      /* Times a whole document was read just to find its length */
+  unsigned long long allocations;
+  unsigned long long bytesAllocated;
+  unsigned long long cacheHits;
+  unsigned long long cacheMisses;
+  unsigned long long poolHits;       /* Allocations served from a pool free list */
+  unsigned long long poolMisses;     /* Allocations that had to carve a new pool block */
+} seajson_stats;
+
+int seajson_stats_enabled(void);
+seajson_stats seajson_get_stats(void);
+void seajson_reset_stats(void);
+void seajson_dump_stats(FILE *fp);
+
+/*
+ * Allocator hooks. Everything SeaJSON allocates goes through the global
+ * allocator (malloc/realloc/free by default), set it before using
+ * SeaJSON from other threads. A document can also get its own allocator:
+ * anything allocated while working on that document (results, temporary
+ * buffers, and sub-documents, which inherit the allocator) then comes
+ * from it, and free_json/free_jarray give it back to it. Strings returned
+ * for a document with its own allocator should be freed with
+ * seajson_free_from, everything else with seajson_free (plain free() is
+ * only fine while the default allocator is used). The allocator is kept
+ * in a header in front of the document, so seajson_set_document_allocator
+ * moves it (json has to come from allocator): use the document it returns
+ * from then on, or NULL if there was no memory for the move (json is
+ * freed then). Passing a NULL allocator takes the header off again.
+ */
+typedef struct {
+  void *(*malloc)(void *context, size_t size);
+  void *(*realloc)(void *context, void *ptr, size_t size);
+  void (*free)(void *context, void *ptr);
+  void *context;
+} seajson_allocator;
+
+void seajson_set_allocator(const seajson_allocator *allocator);
+seajson_allocator seajson_get_allocator(void);
+seajson seajson_set_document_allocator(seajson json, const seajson_allocator *allocator);
+seajson init_json_from_file_with_allocator(const char *filename, const seajson_allocator *allocator);
+void seajson_free(void *ptr);
+void seajson_free_from(seajson json, void *ptr);
+
+/*
+ * Built in size class pools. Pass this to seajson_set_allocator (or use
+ * it as a document allocator) and small results come from per-thread
+ * slabs of 16 to 1024 byte blocks instead of malloc. Blocks can be freed
+ * on any thread, they go back to the thread that made them. A slab goes
+ * back to the system once all of its blocks are freed (each thread keeps
+ * the one it is allocating from), and a thread's slabs are freed or
+ * handed on when it exits. seajson_pool_trim gives back every empty slab
+ * of the calling thread and of threads that have exited.
+ */
+const seajson_allocator *seajson_pool_allocator(void);
+void seajson_pool_trim(void);
+
+/*
+ * JSON Patch (RFC 6902 add/remove/replace, paths are JSON Pointers).
+ * Collect any number of operations and apply_seajson_patch makes the new
+ * document in one copy of the original. Unlike RFC 6902 every operation
+ * is resolved against the original document rather than the result of
+ * the previous one, so array indexes always mean the original items and
+ * operations that touch the same value (or a value inside of one that
+ * is removed/replaced) are rejected. Values are raw json text. Patches
+ * read with parse_seajson_patch are real RFC 6902 documents, so those
+ * resolve each operation against the result of the last one instead.
+ * They still take one copy for every run of operations that do not
+ * depend on each other, another copy is only made when an operation's
+ * path goes through or holds something an earlier one changed (or uses
+ * an index of an array an earlier one added to or removed from, appends
+ * with "-" aside).
+ */
+typedef enum {
+  SEAJSON_PATCH_ADD,
+  SEAJSON_PATCH_REMOVE,
+  SEAJSON_PATCH_REPLACE
+} seajson_patch_type;
+
+typedef struct {
+  seajson_patch_type type;
+  char *path;
+  char *value;
+} seajson_patch_op;
+
+typedef struct {
+  seajson_patch_op *ops;
+  size_t count;
+  size_t capacity;
+  int sequential;  /* Set by parse_seajson_patch, each op sees the result of the last */
+  int isValid;
+} seajson_patch;
+
+seajson_patch new_seajson_patch(void);
+seajson_patch parse_seajson_patch(seajson patchJson);
+int seajson_patch_add(seajson_patch *patch, const char *path, const char *value);
+int seajson_patch_replace(seajson_patch *patch, const char *path, const char *value);
+int seajson_patch_remove(seajson_patch *patch, const char *path);
+seajson apply_seajson_patch(seajson json, seajson_patch patch);
+void free_seajson_patch(seajson_patch patch);
+
+/*
+ * Mutable documents, for updating values of a big document without
+ * copying it every time. Values that are the same size or shorter are
+ * overwritten in place and padded with spaces, longer ones use up that
+ * padding first and then the slack bytes kept free at the end of the
+ * buffer, so the buffer is only reallocated once the slack runs out.
+ * json is always a NULL terminated document that can be passed to every
+ * other function. Paths are JSON Pointers, adding a key that is not
+ * there yet rebuilds the document.
+ */
+typedef struct {
+  char *json;
+  size_t length;
+  size_t capacity;
+  size_t slack;
+  int isValid;
+} seajson_mutable;
+
+seajson_mutable new_seajson_mutable(seajson json, size_t slack);
+int set_item_seajson_mutable(seajson_mutable *doc, const char *key, const char *value);
+int set_path_seajson_mutable(seajson_mutable *doc, const char *path, const char *value);
+void free_seajson_mutable(seajson_mutable doc);
+
+/*
+ * jarray builder, for making big arrays. Items are appended to a buffer
+ * that grows by doubling instead of being copied into a new jarray for
+ * every item like add_item_to_jarray does, and where each item starts is
+ * kept so ranges of items can be removed without scanning. Items are raw
+ * json text. finalize_jarray_builder hands the buffer over to a normal
+ * jarray (free it with free_jarray) and leaves the builder empty, ready
+ * to build another one.
+ */
+typedef struct {
+  char *buffer;
+  size_t length;
+  size_t capacity;
+  size_t *itemOffsets;
+  size_t itemCount;
+  size_t itemCapacity;
+  int isValid;
+} jarray_builder;
+
+jarray_builder new_jarray_builder(size_t itemCapacity);
+jarray_builder jarray_builder_from_jarray(jarray array);
+int append_item_to_jarray_builder(jarray_builder *builder, const char *item);
+int append_items_to_jarray_builder(jarray_builder *builder, const char *const *items, size_t count);
+int remove_items_of_jarray_builder(jarray_builder *builder, size_t index, size_t count);
+jarray finalize_jarray_builder(jarray_builder *builder);
+void free_jarray_builder(jarray_builder builder);
+
+/*
+ * Typed numeric arrays. Parses every number of the array under key (a
+ * key of the top level object) straight into out in one pass, nothing
+ * is allocated per item. Returns how many items the array has, which
+ * can be more than capacity (only capacity of them are written), or -1
+ * if it is not there or has something that is not a number in it (for
+ * the int ones, a whole number that fits, so 1.5 is not taken). The
+ * _alloc versions return a right sized buffer instead, made by the
+ * document's allocator (free it with seajson_free_from), and set count.
+ */
+long long get_int32_array(seajson json, const char *key, int32_t *out, size_t capacity);
+long long get_int64_array(seajson json, const char *key, int64_t *out, size_t capacity);
+long long get_double_array(seajson json, const char *key, double *out, size_t capacity);
+int32_t *get_int32_array_alloc(seajson json, const char *key, size_t *count);
+int64_t *get_int64_array_alloc(seajson json, const char *key, size_t *count);
+double *get_double_array_alloc(seajson json, const char *key, size_t *count);
+
+/*
+ * JSON Lines projection. Reads one record per line from in and writes
+ * an object with only the selected fields of it to out, skipping records
+ * that do not match every match. Paths are JSON Pointers so nested
+ * fields work too, and every value that is not on the way to one of them
+ * is skipped over without being looked inside of. Fields that a record
+ * does not have are left out, values are copied as is and matches compare
+ * the raw json text of the value. Returns the number of records written,
+ * or -1 if reading/writing failed.
+ */
+typedef struct {
+  const char *path;
+  const char *name;   /* Key in the output, NULL to use the last token of path */
+} seajson_projection_field;
+
+typedef struct {
+  const char *path;
+  const char *value;  /* Raw json text, "\"error\"" for a string */
+} seajson_projection_match;
+
+typedef struct {
+  const seajson_projection_field *fields;
+  size_t fieldCount;
+  const seajson_projection_match *matches;
+  size_t matchCount;
+} seajson_projection;
+
+long long project_seajson_lines(FILE *in, FILE *out, const seajson_projection *projection);
+
+/*
+ * Compressed input. init_json_from_compressed_file loads plain, gzip or
+ * zstd files (going by the magic number, not the file name), decompressing
+ * straight into the returned document in bounded blocks and feeding index
+ * (can be NULL) as it goes, so the decompressed text is only ever in
+ * memory once. gzip needs SEAJSON_USE_ZLIB (link with -lz) and zstd needs
+ * SEAJSON_USE_ZSTD (link with -lzstd), without them those files fail to
+ * load. Returns NULL on failure. project_seajson_lines decompresses its
+ * input the same way.
+ */
+seajson init_json_from_compressed_file(const char *filename, seajson_index *index);
+
+/*
+ * Indexing (see seajson_index). seajson_index_feed returns 0 or -1 once
+ * the brackets stop making sense, seajson_index_finish returns 0 if the
+ * whole document was fed and everything was closed. index_seajson
+ * indexes a document already in memory and init_json_from_file_indexed
+ * indexes each chunk of the file as it is read. new_seajson_index_hashed
+ * and index_seajson_hashed also hash every container (see seajson_dedup),
+ * which costs a multiply per byte. get_value_indexed finds
+ * the value at a JSON Pointer path and returns 0 with its offsets, or -1.
+ */
+seajson_index new_seajson_index(void);
+seajson_index new_seajson_index_hashed(void);
+int seajson_index_feed(seajson_index *index, const char *chunk, size_t length);
+int seajson_index_finish(seajson_index *index);
+seajson_index index_seajson(seajson json);
+seajson_index index_seajson_hashed(seajson json);
+seajson init_json_from_file_indexed(const char *filename, seajson_index *index);
+int get_value_indexed(seajson json, const seajson_index *index, const char *path, uint64_t *valueStart, uint64_t *valueEnd);
+void free_seajson_index(seajson_index index);
+
+/*
+ * Incremental reindexing. The _indexed edits do the same as
+ * set_item_seajson, add_item_seajson and remove_item_seajson, but find the
+ * key through index and then update index to describe the returned
+ * document instead of it having to be built again: only the changed bytes
+ * are read, and the containers after them are shifted over (a hashed index
+ * also rehashes the containers around the edit, reusing the hashes of the
+ * containers inside them so only their own scalars are read again). They
+ * return NULL like the plain ones, leaving index alone. The containers
+ * around the edit are found by walking down from the root, skipping
+ * siblings. seajson_index_splice does the same
+ * update for an edit made some other way, where json[start, newEnd) is
+ * what replaced old[start, oldEnd) and both begin outside of a string. An
+ * edit that does not line up with the containers falls back to indexing
+ * json again. Returns 0, or -1 if json could not be indexed.
+ */
+int seajson_index_splice(seajson_index *index, seajson json, uint64_t start, uint64_t oldEnd, uint64_t newEnd);
+seajson set_item_seajson_indexed(seajson json, seajson_index *index, const char *key, const char *value);
+seajson add_item_seajson_indexed(seajson json, seajson_index *index, const char *key, const char *value);
+seajson remove_item_seajson_indexed(seajson json, seajson_index *index, const char *key);
+
+/*
+ * Async loading. init_json_from_file_async returns right away and reads
+ * the file on another thread, indexing every chunk as soon as it lands so
+ * the indexing is done by the time the read is. Built with
+ * SEAJSON_USE_IO_URING (link with -luring) the reads go through io_uring
+ * with several in flight at once, otherwise a reader thread does them.
+ * callback (can be NULL) runs on the loading thread once it is done, json
+ * is NULL if the file could not be read. seajson_load_wait must always be
+ * called, it blocks until the load is done, hands over the json and index
+ * (pass NULL to not keep the index) and frees the handle.
+ */
+typedef struct seajson_load seajson_load;
+typedef void (*seajson_load_callback)(seajson json, const seajson_index *index, void *context);
+
+seajson_load *init_json_from_file_async(const char *filename, seajson_load_callback callback, void *context);
+int seajson_load_is_done(seajson_load *load);
+seajson seajson_load_wait(seajson_load *load, seajson_index *index);
+
+/*
+ * Iteration. Walks the members of an object (or the items of an array) in
+ * one pass without allocating, for when the keys are not known up front.
+ * Each member comes back as views into the document: the key without its
+ * quotes (start is NULL for array items), the raw json text of the value
+ * and its type. A nested object or array value can be walked with
+ * seajson_iterate_view, a document from get_dictionary with
+ * seajson_iterate. seajson_iterator_next returns 1 for every member and 0
+ * at the end, isValid is 0 if it stopped at broken json. Views are not
+ * NULL terminated, seajson_view_equals compares a key view with a name and
+ * seajson_view_unescape copies a key or string value view into out
+ * unescaped (view.length + 1 is always enough room, less truncates it),
+ * returning its length or -1 if it has a broken escape.
+ */
+typedef struct {
+  const char *start;
+  size_t length;
+} seajson_view;
+
+typedef struct {
+  const char *json;
+  size_t length;
+  size_t pos;
+  int isObject;
+  int done;
+  int isValid;
+} seajson_iterator;
+
+seajson_iterator seajson_iterate(seajson json);
+seajson_iterator seajson_iterate_view(seajson_view value);
+int seajson_iterator_next(seajson_iterator *iterator, seajson_view *key, seajson_view *value, seajson_type *type);
+int seajson_view_equals(seajson_view key, const char *name);
+long long seajson_view_unescape(seajson_view view, char *out, size_t capacity);
+
+/*
+ * Deduplication. A seajson_dedup hands out one shared copy for every
+ * sub-document with the same contents (whitespace between tokens does not
+ * count, and copies are stored without it), so thousands of identical
+ * objects take up the memory of one. Values come from a hashed index
+ * (get_value_indexed_dedup, which uses the hash from the index instead of
+ * reading the value again), a key of the top level object, a jarray item or
+ * any view (see seajson_iterator). They are NULL if there is no such value.
+ * Shared values belong to the dedup, never free_json or change them: each
+ * one handed out should be given back with release_seajson_dedup, and
+ * free_seajson_dedup frees whatever is left. uniqueBytes counts what is
+ * stored and sharedBytes what was handed out again instead of copied.
+ */
+typedef struct seajson_dedup_entry seajson_dedup_entry;
+
+typedef struct {
+  seajson_dedup_entry *entries;
+  size_t entryCount;
+  size_t entryCapacity;
+  uint64_t uniqueBytes;
+  uint64_t sharedBytes;
+  int isValid;
+} seajson_dedup;
+
+seajson_dedup new_seajson_dedup(void);
+seajson dedup_seajson(seajson_dedup *dedup, seajson_view value);
+seajson get_value_indexed_dedup(seajson_dedup *dedup, seajson json, const seajson_index *index, const char *path);
+seajson get_dictionary_dedup(seajson_dedup *dedup, seajson json, const char *key);
+seajson get_item_from_jarray_dedup(seajson_dedup *dedup, jarray array, long long index);
+void release_seajson_dedup(seajson_dedup *dedup, seajson value);
+void free_seajson_dedup(seajson_dedup dedup);
+
+/*
+ * Scanning kernels. String, bracket, whitespace and escape scanning run on
+ * the best kernel the CPU supports, picked at startup: "avx512", "avx2",
+ * "sse4.2" or "scalar" (x86 builds with GCC or Clang have all of them,
+ * anything else or a build with SEAJSON_SCALAR_ONLY only has "scalar").
+ * The SEAJSON_KERNEL environment variable picks one by name instead, for
+ * benchmarking. seajson_kernel_name returns the one in use and
+ * seajson_set_kernel switches to another, returning 0 or -1 if this CPU
+ * can not run it. Like the allocator, only switch it before using SeaJSON
+ * from other threads.
+ */
+const char *seajson_kernel_name(void);
+int seajson_set_kernel(const char *name);
+
+/*
+ * Shared slices. share_seajson hands a document over to a reference
+ * counted buffer and returns a slice of all of it (it stays the caller's
+ * if that fails, shared is NULL then). get_dictionary_slice,
+ * get_array_slice and get_item_slice return a slice of a top level member
+ * or array item of a slice without copying anything, pointing into the
+ * same buffer and holding their own reference to it, so the buffer is only
+ * freed once every slice of it was given to release_seajson_slice (even
+ * the one from share_seajson can be released first). shared is NULL if
+ * there is no such value. view is not NULL terminated, it works with
+ * seajson_iterate_view and dedup_seajson. copy_seajson_slice makes a right
+ * sized document out of a slice (free it with free_json), and
+ * detach_seajson_slice does the same but also releases the slice, handing
+ * over the buffer itself without copying if the slice is all of it and
+ * the last one left. Both return NULL if they could not allocate, without
+ * releasing anything.
+ */
+typedef struct seajson_shared seajson_shared;
+
+typedef struct {
+  seajson_view view;
+  seajson_shared *shared;
+} seajson_slice;
+
+seajson_slice share_seajson(seajson json);
+seajson_slice get_dictionary_slice(seajson_slice slice, const char *key);
+seajson_slice get_array_slice(seajson_slice slice, const char *key);
+seajson_slice get_item_slice(seajson_slice slice, long long index);
+seajson_slice retain_seajson_slice(seajson_slice slice);
+void release_seajson_slice(seajson_slice slice);
+seajson copy_seajson_slice(seajson_slice slice);
+seajson detach_seajson_slice(seajson_slice slice);
+
+/*
+ * Document cache. init_json_from_file_cached keeps every document it
+ * loads in a process wide cache keyed by path, and only reads the file
+ * again once its size or modification time changed, so loading the same
+ * file over and over is just an fstat. It returns a slice of the whole
+ * document (see seajson_slice, shared is NULL if the file could not be
+ * read) that has to be given to release_seajson_slice, view.start is NULL
+ * terminated so it works with every function that takes a seajson as long
+ * as it is not changed or freed. Least recently used documents are dropped
+ * once the cached documents are over the budget (256MB unless changed with
+ * seajson_set_cache_budget, 0 keeps nothing), slices still out keep theirs
+ * alive until released. seajson_clear_cache drops everything. It is safe
+ * to use from several threads at once.
+ */
+typedef struct {
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long reloads;     /* Loaded again because the file changed */
+  unsigned long long evictions;
+  unsigned long long documents;
+  uint64_t bytes;
+} seajson_cache_stats;
+
+seajson_slice init_json_from_file_cached(const char *filename);
+void seajson_set_cache_budget(uint64_t bytes);
+seajson_cache_stats seajson_get_cache_stats(void);
+void seajson_clear_cache(void);
+
+/*
+ * Queries. A query picks items out of an array in one pass over it:
+ * platforms[?object_type=="generic_platform"].point goes down the dotted
+ * path to the array, keeps the items where every predicate (joined with
+ * &&) holds and yields the value at the dotted path after the ] of each
+ * one, or the whole item if there is none. [*] keeps every item and an
+ * empty path before the [ means the document itself is the array.
+ * Predicates compare a dotted field of the item with a json literal
+ * using == != < <= > >=, only numbers can use the ordering ones, and a
+ * field an item does not have never matches. Object and array literals
+ * are compared as text with whitespace ignored, so key order counts.
+ * There is no @ for the item itself. compile_seajson_query returns NULL
+ * if the query can not be parsed. run_seajson_query calls callback
+ * (can be NULL) with a view of every match and the index of its item,
+ * stopping early if it returns non zero, and returns how many matched or
+ * -1 if the array is not there or the json is broken. query_seajson
+ * compiles and runs a query in one go, collecting the matches into a
+ * jarray (isValid is 0 if anything failed).
+ */
+typedef struct seajson_query seajson_query;
+typedef int (*seajson_query_callback)(seajson_view value, long long itemIndex, void *context);
+
+seajson_query *compile_seajson_query(const char *query);
+long long run_seajson_query(seajson json, const seajson_query *query, seajson_query_callback callback, void *context);
+jarray query_seajson(seajson json, const char *query);
+void free_seajson_query(seajson_query *query);
+
+/*
+ * Batch loading. load_seajson_batch loads and indexes every file in
+ * filenames (plain, gzip or zstd, see init_json_from_compressed_file) on a
+ * pool of threads, threadCount of them or one per CPU if it is 0. Each
+ * thread starts with its own share of the files and steals from the
+ * others once it runs out, so a few big files do not leave the rest of the
+ * threads idle. callback (can be NULL) runs on the loading thread right
+ * after a file was indexed, in no particular order, and whatever it
+ * returns is kept as that item's result. With freeDocuments set the
+ * document and index are freed as soon as the callback returns, otherwise
+ * they stay in the batch. Items are always in the order of filenames no
+ * matter which thread loaded them, json is NULL (and failedCount counts
+ * it) if a file could not be loaded. load_seajson_directory does the same
+ * for every regular file in directory that ends in suffix (NULL for every
+ * file), sorted by name. isValid is 0 if the batch itself could not be
+ * set up. free_seajson_batch frees every document and index still in it,
+ * results are left to the caller.
+ */
+typedef void *(*seajson_batch_callback)(const char *filename, seajson json, const seajson_index *index, void *context);
+
+typedef struct {
+  size_t threadCount;
+  int freeDocuments;
+  seajson_batch_callback callback;
+  void *context;
+} seajson_batch_options;
+
+typedef struct {
+  const char *filename;
+  seajson json;
+  seajson_index index;
+  void *result;
+} seajson_batch_item;
+
+typedef struct {
+  seajson_batch_item *items;
+  size_t itemCount;
+  size_t failedCount;
+  char **ownedFilenames;  /* Filenames found by load_seajson_directory, NULL otherwise */
+  int isValid;
+} seajson_batch;
+
+seajson_batch load_seajson_batch(const char *const *filenames, size_t count, const seajson_batch_options *options);
+seajson_batch load_seajson_directory(const char *directory, const char *suffix, const seajson_batch_options *options);
+void free_seajson_batch(seajson_batch batch);
+
+/*
+ * SAX parsing. parse_seajson_sax reads a document once from start to end
+ * and calls the handler for every token as it gets to it, without building
+ * anything or allocating (unless it nests over 512 deep). Keys and strings
+ * are views of the raw text between the quotes (still escaped, see
+ * seajson_view_unescape), numbers get their raw text and the parsed value.
+ * Callbacks that are NULL are skipped, one that returns non zero stops the
+ * parse. parse_seajson_sax_view parses a view instead. Returns 0 once the
+ * whole document was parsed, 1 if a callback stopped it or -1 if the json
+ * is broken (callbacks will already have run for everything before the
+ * broken part).
+ */
+typedef struct {
+  int (*startObject)(void *context);
+  int (*endObject)(void *context);
+  int (*startArray)(void *context);
+  int (*endArray)(void *context);
+  int (*key)(seajson_view key, void *context);
+  int (*string)(seajson_view value, void *context);
+  int (*number)(seajson_view value, seajson_number number, void *context);
+  int (*boolean)(int value, void *context);
+  int (*null)(void *context);
+} seajson_sax_handler;
+
+int parse_seajson_sax(seajson json, const seajson_sax_handler *handler, void *context);
+int parse_seajson_sax_view(seajson_view json, const seajson_sax_handler *handler, void *context);
+
+/*
+ * Formatting. A formatter is a streaming transform: feed it a document
+ * in chunks of any size (strings and escapes can be split between them)
+ * and it hands the output to write in blocks of up to 64KB, write returns
+ * 0 or non zero to stop. A minifier drops every bit of whitespace between
+ * tokens, a pretty printer puts each member and item on its own line
+ * indented by indent per level ("  " if NULL, it has to outlive the
+ * formatter) with a space after every :, keeping empty objects and
+ * arrays as {} and []. seajson_formatter_feed returns 0 or -1 once write
+ * failed, seajson_formatter_finish flushes what is left and frees the
+ * formatter's buffer, returning -1 if write failed or the json stopped in
+ * the middle of a string or container. Runs between the bytes that matter
+ * are found with the scanning kernels. minify_seajson_in_place minifies
+ * json without allocating and returns its new length,
+ * pretty_print_seajson returns a pretty printed copy (NULL on failure),
+ * and minify_seajson_file and pretty_print_seajson_file stream a file
+ * (gzip or zstd compressed ones too, see init_json_from_compressed_file)
+ * to out without holding it in memory, returning the bytes written or -1.
+ */
+typedef int (*seajson_write_callback)(const char *data, size_t length, void *context);
+
+typedef struct {
+  seajson_write_callback write;
+  void *context;
+  char *buffer;
+  size_t bufferLength;
+  const char *indent;  /* NULL when minifying */
+  size_t indentLength;
+  uint64_t depth;
+  int inString;
+  int escaped;
+  int openPending;
+  int isValid;
+} seajson_formatter;
+
+seajson_formatter new_seajson_minifier(seajson_write_callback write, void *context);
+seajson_formatter new_seajson_pretty_printer(const char *indent, seajson_write_callback write, void *context);
+int seajson_formatter_feed(seajson_formatter *formatter, const char *chunk, size_t length);
+int seajson_formatter_finish(seajson_formatter *formatter);
+size_t minify_seajson_in_place(seajson json);
+seajson pretty_print_seajson(seajson json, const char *indent);
+long long minify_seajson_file(FILE *in, FILE *out);
+long long pretty_print_seajson_file(FILE *in, FILE *out, const char *indent);
+
 /* Only kept for backwards compatibility with original SeaJSON library - THIS FUNCTION IS NOT SAFE !!!! DO NOT USE !!! */
 char * getstring(char *funckey, char *dict);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEAJSON_H */
@@ -0,0 +1,544 @@
+/*
+ * Copyright (C) 2023 Snoolie K / 0xilis. All rights reserved.
+ *
+ * This document is the property of Snoolie K / 0xilis.
+ * It is considered confidential and proprietary.
+ *
+ * This document may not be reproduced or transmitted in any form,
+ * in whole or in part, without the express written permission of
+ * Snoolie K / 0xilis.
+*/
+
+#ifndef SEAJSON_HPP
+#define SEAJSON_HPP
+
+#include "seajson.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#if defined(__has_include)
+#if __has_include(<version>)
+#include <version>
+#endif
+#endif
+#if defined(__cpp_lib_span)
+#include <span>
+#endif
+
+/*
+ * Header-only C++17 wrapper. Document and Array own their buffer and free
+ * it when they go out of scope, they can be moved but not copied. Value is
+ * a view of a value inside of a Document or Array (it does not own
+ * anything, so it must not outlive them) and everything read from it is a
+ * std::string_view into the original buffer where the text can be used as
+ * is. Keys are hashed with constexpr, so a constexpr Key (or one made from
+ * a string literal or "name"_key, which compilers fold when optimizing)
+ * costs nothing at runtime, and lookups on a Document go through a hash
+ * table of its members that is built on first use. That table is not
+ * thread safe, build it (with any lookup) before sharing a const Document
+ * between threads. Needs C++17, Span is std::span when it is there.
+ */
+namespace SeaJSON {
+
+#if defined(__cpp_lib_span)
+template <typename T>
+using Span = std::span<T>;
+#else
+/* std::span is C++20, this is just enough of it for C++17 */
+template <typename T>
+class Span {
+public:
+  constexpr Span() noexcept : spanData(nullptr), spanSize(0) {}
+  constexpr Span(T *data, size_t size) noexcept : spanData(data), spanSize(size) {}
+  constexpr T *data() const noexcept { return spanData; }
+  constexpr size_t size() const noexcept { return spanSize; }
+  constexpr bool empty() const noexcept { return spanSize == 0; }
+  constexpr T &operator[](size_t index) const noexcept { return spanData[index]; }
+  constexpr T *begin() const noexcept { return spanData; }
+  constexpr T *end() const noexcept { return spanData + spanSize; }
+
+private:
+  T *spanData;
+  size_t spanSize;
+};
+#endif
+
+/* FNV-1a */
+constexpr uint64_t hash_key(std::string_view key) noexcept {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char currentChar : key) {
+    hash ^= (unsigned char)currentChar;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+class Key;
+
+namespace literals {
+constexpr Key operator""_key(const char *name, size_t length) noexcept;
+}
+
+class Key {
+public:
+  /* Stops at the first NULL, so a char buffer that is not full still works */
+  template <size_t N>
+  constexpr Key(const char (&name)[N]) noexcept : keyName(name, literal_length(name)), keyHash(hash_key(keyName)) {}
+  /* name must be NULL terminated */
+  constexpr explicit Key(const char *name) noexcept : keyName(name), keyHash(hash_key(keyName)) {}
+
+  constexpr std::string_view name() const noexcept { return keyName; }
+  constexpr const char *c_str() const noexcept { return keyName.data(); }
+  constexpr uint64_t hash() const noexcept { return keyHash; }
+
+private:
+  /* Only for _key, whose literal is always NULL terminated: c_str() goes straight to the C functions */
+  constexpr Key(std::string_view name, uint64_t hash) noexcept : keyName(name), keyHash(hash) {}
+  friend constexpr Key literals::operator""_key(const char *name, size_t length) noexcept;
+
+  template <size_t N>
+  static constexpr size_t literal_length(const char (&name)[N]) noexcept {
+    size_t length = 0;
+    while (length < N && name[length] != '\0') {
+      length++;
+    }
+    return length;
+  }
+
+  std::string_view keyName;
+  uint64_t keyHash;
+};
+
+namespace literals {
+constexpr Key operator""_key(const char *name, size_t length) noexcept {
+  return Key(std::string_view(name, length), hash_key(std::string_view(name, length)));
+}
+}
+
+class Value {
+public:
+  Value() noexcept : valueView{nullptr, 0}, valueType(SEAJSON_TYPE_INVALID) {}
+  Value(seajson_view view, seajson_type type) noexcept : valueView(view), valueType(type) {}
+
+  bool exists() const noexcept { return valueView.start != nullptr; }
+  explicit operator bool() const noexcept { return exists(); }
+  seajson_type type() const noexcept { return valueType; }
+  seajson_view view() const noexcept { return valueView; }
+  /* The json text of the value */
+  std::string_view raw() const noexcept { return exists() ? std::string_view(valueView.start, valueView.length) : std::string_view(); }
+
+  bool is_null() const noexcept { return valueType == SEAJSON_TYPE_NULL; }
+  bool is_object() const noexcept { return valueType == SEAJSON_TYPE_OBJECT; }
+  bool is_array() const noexcept { return valueType == SEAJSON_TYPE_ARRAY; }
+
+  /* Numbers are followed by a , } ] or the end of the document, so they can be parsed in place */
+  std::optional<long long> as_int() const noexcept {
+    if (valueType != SEAJSON_TYPE_INT) {
+      return std::nullopt;
+    }
+    return std::strtoll(valueView.start, nullptr, 10);
+  }
+  std::optional<double> as_double() const noexcept {
+    if (valueType != SEAJSON_TYPE_INT && valueType != SEAJSON_TYPE_DOUBLE) {
+      return std::nullopt;
+    }
+    return std::strtod(valueView.start, nullptr);
+  }
+  std::optional<bool> as_bool() const noexcept {
+    if (valueType != SEAJSON_TYPE_TRUE && valueType != SEAJSON_TYPE_FALSE) {
+      return std::nullopt;
+    }
+    return valueType == SEAJSON_TYPE_TRUE;
+  }
+  /* The string straight out of the buffer, only if it has no escapes (use as_string for those) */
+  std::optional<std::string_view> as_string_view() const noexcept {
+    if (valueType != SEAJSON_TYPE_STRING) {
+      return std::nullopt;
+    }
+    std::string_view contents(valueView.start + 1, valueView.length - 2);
+    if (contents.find('\\') != std::string_view::npos) {
+      return std::nullopt;
+    }
+    return contents;
+  }
+  /* Unescaped copy of the string */
+  std::optional<std::string> as_string() const {
+    if (valueType != SEAJSON_TYPE_STRING) {
+      return std::nullopt;
+    }
+    std::string unescaped(valueView.length, '\0');
+    long long length = seajson_view_unescape(valueView, &unescaped[0], unescaped.size() + 1);
+    if (length < 0) {
+      return std::nullopt;
+    }
+    unescaped.resize((size_t)length);
+    return unescaped;
+  }
+
+  /* Member of an object, walking its members in order */
+  Value operator[](const Key &key) const noexcept {
+    if (valueType != SEAJSON_TYPE_OBJECT) {
+      return Value();
+    }
+    seajson_iterator iterator = seajson_iterate_view(valueView);
+    seajson_view memberKey;
+    seajson_view memberValue;
+    seajson_type memberType;
+    while (seajson_iterator_next(&iterator, &memberKey, &memberValue, &memberType)) {
+      if (key_matches(memberKey, key)) {
+        return Value(memberValue, memberType);
+      }
+    }
+    return Value();
+  }
+  /* Item of an array, walking its items in order */
+  Value operator[](size_t index) const noexcept {
+    if (valueType != SEAJSON_TYPE_ARRAY) {
+      return Value();
+    }
+    seajson_iterator iterator = seajson_iterate_view(valueView);
+    seajson_view item;
+    seajson_type itemType;
+    for (size_t i = 0; seajson_iterator_next(&iterator, nullptr, &item, &itemType); i++) {
+      if (i == index) {
+        return Value(item, itemType);
+      }
+    }
+    return Value();
+  }
+
+  class Members;
+  Members members() const noexcept;
+
+  /* Raw keys are only unescaped if they have a \ in them */
+  static bool key_matches(seajson_view rawKey, const Key &key) noexcept {
+    std::string_view raw(rawKey.start, rawKey.length);
+    if (raw.find('\\') == std::string_view::npos) {
+      return raw == key.name();
+    }
+    return seajson_view_equals(rawKey, key.c_str());
+  }
+
+private:
+  seajson_view valueView;
+  seajson_type valueType;
+};
+
+/* for (auto [key, value] : value.members()), keys are raw (still escaped, without quotes) and empty for array items */
+class Value::Members {
+public:
+  class Iterator {
+  public:
+    Iterator() noexcept : iterator(), atEnd(true) {}
+    explicit Iterator(seajson_iterator start) noexcept : iterator(start), atEnd(false) { ++*this; }
+
+    std::pair<std::string_view, Value> operator*() const noexcept { return current; }
+    Iterator &operator++() noexcept {
+      seajson_view key;
+      seajson_view value;
+      seajson_type type;
+      if (!seajson_iterator_next(&iterator, &key, &value, &type)) {
+        atEnd = true;
+        return *this;
+      }
+      current.first = key.start ? std::string_view(key.start, key.length) : std::string_view();
+      current.second = Value(value, type);
+      return *this;
+    }
+    bool operator!=(const Iterator &other) const noexcept { return atEnd != other.atEnd; }
+    bool operator==(const Iterator &other) const noexcept { return atEnd == other.atEnd; }
+
+  private:
+    seajson_iterator iterator;
+    std::pair<std::string_view, Value> current;
+    bool atEnd;
+  };
+
+  explicit Members(const Value &value) noexcept : value(value) {}
+  Iterator begin() const noexcept {
+    if (!value.is_object() && !value.is_array()) {
+      return Iterator();
+    }
+    return Iterator(seajson_iterate_view(value.view()));
+  }
+  Iterator end() const noexcept { return Iterator(); }
+
+private:
+  Value value;
+};
+
+inline Value::Members Value::members() const noexcept {
+  return Members(*this);
+}
+
+/* Buffer from the get_*_array_alloc functions */
+template <typename T>
+class NumericArray {
+public:
+  NumericArray() noexcept : owner(nullptr), items(nullptr), count(0) {}
+  NumericArray(seajson owner, T *items, size_t count) noexcept : owner(owner), items(items), count(count) {}
+  NumericArray(NumericArray &&other) noexcept : owner(other.owner), items(std::exchange(other.items, nullptr)), count(std::exchange(other.count, 0)) {}
+  NumericArray &operator=(NumericArray &&other) noexcept {
+    if (this != &other) {
+      reset();
+      owner = other.owner;
+      items = std::exchange(other.items, nullptr);
+      count = std::exchange(other.count, 0);
+    }
+    return *this;
+  }
+  NumericArray(const NumericArray &) = delete;
+  NumericArray &operator=(const NumericArray &) = delete;
+  ~NumericArray() { reset(); }
+
+  explicit operator bool() const noexcept { return items != nullptr; }
+  Span<const T> span() const noexcept { return Span<const T>(items, count); }
+  size_t size() const noexcept { return count; }
+  const T &operator[](size_t index) const noexcept { return items[index]; }
+  const T *begin() const noexcept { return items; }
+  const T *end() const noexcept { return items + count; }
+
+private:
+  void reset() noexcept {
+    if (items) {
+      seajson_free_from(owner, items);
+      items = nullptr;
+      count = 0;
+    }
+  }
+
+  seajson owner;
+  T *items;
+  size_t count;
+};
+
+class Array {
+public:
+  Array() noexcept : array{0, nullptr, 0} {}
+  explicit Array(jarray array) noexcept : array(array) {}
+  Array(Array &&other) noexcept : array(std::exchange(other.array, jarray{0, nullptr, 0})), itemCache(std::move(other.itemCache)), itemsCached(std::exchange(other.itemsCached, false)) {}
+  Array &operator=(Array &&other) noexcept {
+    if (this != &other) {
+      reset();
+      array = std::exchange(other.array, jarray{0, nullptr, 0});
+      itemCache = std::move(other.itemCache);
+      itemsCached = std::exchange(other.itemsCached, false);
+    }
+    return *this;
+  }
+  Array(const Array &) = delete;
+  Array &operator=(const Array &) = delete;
+  ~Array() { reset(); }
+
+  bool valid() const noexcept { return array.isValid && array.arrayString; }
+  explicit operator bool() const noexcept { return valid(); }
+  size_t size() const noexcept { return valid() ? (size_t)array.itemCount : 0; }
+  const jarray &get() const noexcept { return array; }
+  jarray release() noexcept {
+    itemCache.clear();
+    itemsCached = false;
+    return std::exchange(array, jarray{0, nullptr, 0});
+  }
+
+  /* Views of every item, found in one pass the first time they are asked for */
+  Span<const Value> items() const {
+    if (!itemsCached && valid()) {
+      seajson_view arrayView = { array.arrayString, std::char_traits<char>::length(array.arrayString) };
+      seajson_iterator iterator = seajson_iterate_view(arrayView);
+      seajson_view item;
+      seajson_type itemType;
+      itemCache.reserve(size());
+      while (seajson_iterator_next(&iterator, nullptr, &item, &itemType)) {
+        itemCache.emplace_back(item, itemType);
+      }
+      itemsCached = true;
+    }
+    return Span<const Value>(itemCache.data(), itemCache.size());
+  }
+  Value operator[](size_t index) const {
+    Span<const Value> all = items();
+    return (index < all.size()) ? all[index] : Value();
+  }
+
+private:
+  void reset() noexcept {
+    if (array.arrayString) {
+      free_jarray(array);
+      array = jarray{0, nullptr, 0};
+    }
+    itemCache.clear();
+    itemsCached = false;
+  }
+
+  jarray array;
+  mutable std::vector<Value> itemCache;
+  mutable bool itemsCached = false;
+};
+
+class Document {
+public:
+  Document() noexcept = default;
+  /* Takes over json, which has to be a document SeaJSON made */
+  explicit Document(seajson json) noexcept : json(json) {}
+  Document(Document &&other) noexcept : json(std::exchange(other.json, nullptr)), memberTable(std::move(other.memberTable)), membersBuilt(std::exchange(other.membersBuilt, false)) {}
+  Document &operator=(Document &&other) noexcept {
+    if (this != &other) {
+      reset();
+      json = std::exchange(other.json, nullptr);
+      memberTable = std::move(other.memberTable);
+      membersBuilt = std::exchange(other.membersBuilt, false);
+    }
+    return *this;
+  }
+  Document(const Document &) = delete;
+  Document &operator=(const Document &) = delete;
+  ~Document() { reset(); }
+
+  /* Plain, gzip or zstd files (see init_json_from_compressed_file), empty if it could not be loaded */
+  static Document load(const char *filename) { return Document(init_json_from_compressed_file(filename, nullptr)); }
+  /* Copies text into a buffer from the SeaJSON allocator */
+  static Document parse(std::string_view text) {
+    seajson_allocator allocator = seajson_get_allocator();
+    char *copy = (char *)allocator.malloc(allocator.context, text.size() + 1);
+    if (copy == nullptr) {
+      return Document();
+    }
+    std::copy(text.begin(), text.end(), copy);
+    copy[text.size()] = '\0';
+    return Document(copy);
+  }
+
+  explicit operator bool() const noexcept { return json != nullptr; }
+  seajson get() const noexcept { return json; }
+  seajson release() noexcept {
+    memberTable.clear();
+    membersBuilt = false;
+    return std::exchange(json, nullptr);
+  }
+  std::string_view text() const noexcept { return json ? std::string_view(json) : std::string_view(); }
+
+  /* Member of the top level object */
+  Value operator[](const Key &key) const {
+    build_member_table();
+    auto match = std::lower_bound(memberTable.begin(), memberTable.end(), key.hash(), [](const TableEntry &entry, uint64_t hash) { return entry.hash < hash; });
+    for (; match != memberTable.end() && match->hash == key.hash(); ++match) {
+      if (Value::key_matches(match->key, key)) {
+        return match->value;
+      }
+    }
+    return Value();
+  }
+  std::optional<std::string> string(const Key &key) const { return (*this)[key].as_string(); }
+  std::optional<std::string_view> string_view(const Key &key) const { return (*this)[key].as_string_view(); }
+  std::optional<long long> integer(const Key &key) const { return (*this)[key].as_int(); }
+  std::optional<double> number(const Key &key) const { return (*this)[key].as_double(); }
+  std::optional<bool> boolean(const Key &key) const { return (*this)[key].as_bool(); }
+  Value::Members members() const { return root().members(); }
+
+  /* Owning copies, for when they have to outlive this document */
+  Document dictionary(const Key &key) const { return Document(json ? get_dictionary(json, key.c_str()) : nullptr); }
+  Array array(const Key &key) const { return json ? Array(get_array(json, key.c_str())) : Array(); }
+
+  NumericArray<int32_t> int32_array(const Key &key) const {
+    size_t count = 0;
+    int32_t *items = json ? get_int32_array_alloc(json, key.c_str(), &count) : nullptr;
+    return NumericArray<int32_t>(json, items, count);
+  }
+  NumericArray<int64_t> int64_array(const Key &key) const {
+    size_t count = 0;
+    int64_t *items = json ? get_int64_array_alloc(json, key.c_str(), &count) : nullptr;
+    return NumericArray<int64_t>(json, items, count);
+  }
+  NumericArray<double> double_array(const Key &key) const {
+    size_t count = 0;
+    double *items = json ? get_double_array_alloc(json, key.c_str(), &count) : nullptr;
+    return NumericArray<double>(json, items, count);
+  }
+
+  Value root() const noexcept {
+    if (json == nullptr) {
+      return Value();
+    }
+    std::string_view all(json);
+    size_t start = all.find_first_not_of(" \t\r\n");
+    size_t end = all.find_last_not_of(" \t\r\n");
+    if (start == std::string_view::npos) {
+      return Value();
+    }
+    seajson_view rootView = { json + start, end - start + 1 };
+    seajson_type type = SEAJSON_TYPE_INVALID;
+    switch (json[start]) {
+      case '{': type = SEAJSON_TYPE_OBJECT; break;
+      case '[': type = SEAJSON_TYPE_ARRAY; break;
+      case '\"': type = SEAJSON_TYPE_STRING; break;
+      case 't': type = SEAJSON_TYPE_TRUE; break;
+      case 'f': type = SEAJSON_TYPE_FALSE; break;
+      case 'n': type = SEAJSON_TYPE_NULL; break;
+      default:
+        type = (rootView.length && std::string_view(rootView.start, rootView.length).find_first_of(".eE") != std::string_view::npos) ? SEAJSON_TYPE_DOUBLE : SEAJSON_TYPE_INT;
+        break;
+    }
+    return Value(rootView, type);
+  }
+
+private:
+  struct TableEntry {
+    uint64_t hash;
+    seajson_view key;
+    Value value;
+  };
+
+  /* One pass over the top level members, hashed the same way as Key so lookups never compare strings that can not match */
+  void build_member_table() const {
+    if (membersBuilt) {
+      return;
+    }
+    membersBuilt = true;
+    Value top = root();
+    if (!top.is_object()) {
+      return;
+    }
+    seajson_iterator iterator = seajson_iterate_view(top.view());
+    seajson_view key;
+    seajson_view value;
+    seajson_type type;
+    std::string unescaped;
+    while (seajson_iterator_next(&iterator, &key, &value, &type)) {
+      std::string_view raw(key.start, key.length);
+      uint64_t hash;
+      if (raw.find('\\') == std::string_view::npos) {
+        hash = hash_key(raw);
+      } else {
+        unescaped.assign(key.length, '\0');
+        long long length = seajson_view_unescape(key, &unescaped[0], unescaped.size() + 1);
+        hash = hash_key(std::string_view(unescaped.data(), length < 0 ? 0 : (size_t)length));
+      }
+      memberTable.push_back(TableEntry{hash, key, Value(value, type)});
+    }
+    /* Stable so the first of any duplicate keys is found first, like the C lookups do */
+    std::stable_sort(memberTable.begin(), memberTable.end(), [](const TableEntry &a, const TableEntry &b) { return a.hash < b.hash; });
+  }
+
+  void reset() noexcept {
+    if (json) {
+      free_json(json);
+      json = nullptr;
+    }
+    memberTable.clear();
+    membersBuilt = false;
+  }
+
+  seajson json = nullptr;
+  mutable std::vector<TableEntry> memberTable;
+  mutable bool membersBuilt = false;
+};
+
+}
+
+#endif /* SEAJSON_HPP */